@@ -28,10 +28,13 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <errno.h>
 #include <stdexcept>
 #include <chrono>
 #include <thread>
 #include <interfaces/atomic_ops.h>
+#include <filesystem/ioctl.h>
 #include <tscpp/buffer.h>
 #include "Logger.h"
 
@@ -72,6 +75,12 @@ void Logger::start()
         throw runtime_error("Error opening log file");
     setbuf(file, NULL);
 
+    // Reserve contiguous space for a new file, so that writes don't stall
+    // scanning the FAT for free clusters. Fails with EBUSY when appending
+    off_t reserve = preallocSize;
+    if (ioctl(fileno(file), IOCTL_PREALLOCATE, &reserve) != 0 && errno != EBUSY)
+        puts("Could not preallocate log file");
+
     // The boring part, start threads one by one and if they fail, undo
     // Perhaps excessive defensive programming as thread creation failure is
     // highly unlikely (only if ram is full)
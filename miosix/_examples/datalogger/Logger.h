@@ -164,6 +164,7 @@ private:
     static const unsigned int bufferSize       = 4096;///< Size of each buffer
     static const unsigned int numBuffers       = 4;   ///< Number of buffers
     static constexpr bool logStatsEnabled      = true;///< Log logger stats?
+    static const unsigned int preallocSize     = 16*1024*1024;///< Reserved space
 
     /**
      * A record is a single serialized logged class. Records are used to
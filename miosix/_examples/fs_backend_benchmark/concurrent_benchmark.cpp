@@ -0,0 +1,146 @@
+/**
+ * This program can be used to test how much concurrent accesses to different
+ * files of the same filesystem slow each other down. A reader thread reads a
+ * file while a writer thread writes another one, and both report throughput
+ * and worst case latency. Run it with the writer disabled first to get the
+ * reader's baseline.
+ *
+ * NOTE: this program requires 8MByte of free space on the SD, and 64KByte
+ * available in your microcontroller for the buffers.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <miosix.h>
+
+using namespace std;
+using namespace std::chrono;
+using namespace miosix;
+
+static const char readFile[]="/sd/concurrent_r.dat";
+static const char writeFile[]="/sd/concurrent_w.dat";
+static const int sizek=32;           ///< Block size in KByte
+static const int sizeb=sizek*1024;   ///< Block size in Byte
+static const int readFileSize=4*1024*1024; ///< Read file size in Byte
+static const int writeFileSize=4*1024*1024; ///< Write file wraps at this size
+
+/**
+ * Statistics collected by a test thread
+ */
+struct Stats
+{
+    const char *name;
+    int fd;
+    bool write;
+    int blocks=0;
+    float totalTime=0.f;
+    float maxTime=0.f;
+};
+
+static bool createReadFile()
+{
+    struct stat st;
+    if(stat(readFile,&st)==0 && st.st_size==readFileSize) return true;
+    puts("Creating test file...");
+    char *data=new char[sizeb];
+    memset(data,0x55,sizeb);
+    int fd=open(readFile,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    bool ok=fd>=0;
+    for(int i=0;ok && i<readFileSize;i+=sizeb)
+        if(write(fd,data,sizeb)!=sizeb) ok=false;
+    if(fd>=0 && close(fd)!=0) ok=false;
+    delete[] data;
+    return ok;
+}
+
+static void testThread(void *argv)
+{
+    Stats *stats=reinterpret_cast<Stats*>(argv);
+    char *data=new char[sizeb];
+    memset(data,0xaa,sizeb);
+    int pos=0;
+    const int size=stats->write ? writeFileSize : readFileSize;
+    while(Thread::testTerminate()==false)
+    {
+        if(pos>=size)
+        {
+            pos=0;
+            lseek(stats->fd,0,SEEK_SET);
+        }
+        auto t=system_clock::now();
+        ssize_t result=stats->write ? write(stats->fd,data,sizeb)
+                                    : read(stats->fd,data,sizeb);
+        duration<float> d=system_clock::now()-t;
+        if(result!=sizeb)
+        {
+            printf("%s error\n",stats->name);
+            break;
+        }
+        pos+=sizeb;
+        stats->blocks++;
+        stats->totalTime+=d.count();
+        if(d.count()>stats->maxTime) stats->maxTime=d.count();
+    }
+    delete[] data;
+}
+
+static void printStats(const Stats& stats)
+{
+    if(stats.blocks==0) return;
+    printf("%s: speed:%0.1fKB/s max latency:%0.3fs\n",stats.name,
+           stats.blocks*sizek/stats.totalTime,stats.maxTime);
+}
+
+int main()
+{
+    if(createReadFile()==false)
+    {
+        perror("create");
+        return 1;
+    }
+    for(;;)
+    {
+        bool withWriter;
+        for(;;)
+        {
+            puts("Reader only, reader and writer, or quit (r/w/q)?");
+            char line[64];
+            fgets(line,sizeof(line),stdin);
+            if(line[0]=='q') goto quit;
+            withWriter=line[0]=='w';
+            if(line[0]=='w' || line[0]=='r') break;
+            puts("Error: insert 'r' or 'w' or 'q'");
+        }
+        Stats reader, writer;
+        reader.name="Reader";
+        reader.write=false;
+        reader.fd=open(readFile,O_RDONLY,0);
+        writer.name="Writer";
+        writer.write=true;
+        writer.fd=withWriter ? open(writeFile,O_WRONLY|O_CREAT|O_TRUNC,0644) : -1;
+        if(reader.fd<0 || (withWriter && writer.fd<0))
+        {
+            perror("open");
+            return 1;
+        }
+        Thread *r=Thread::create(testThread,4096,1,&reader,Thread::JOINABLE);
+        Thread *w=nullptr;
+        if(withWriter)
+            w=Thread::create(testThread,4096,1,&writer,Thread::JOINABLE);
+        Thread::sleep(10000);
+        r->terminate();
+        if(w) w->terminate();
+        r->join();
+        if(w) w->join();
+        close(reader.fd);
+        if(withWriter) close(writer.fd);
+        printStats(reader);
+        printStats(writer);
+    }
+    quit:
+    printf("Bye\n");
+}
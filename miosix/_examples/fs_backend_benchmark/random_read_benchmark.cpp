@@ -0,0 +1,90 @@
+/**
+ * This program can be used to test the speed of random reads from a large file
+ * in the FAT32 filesystem, which depends on how fast lseek can locate the
+ * cluster where the data is stored.
+ *
+ * The test file is created once and left on the SD card, so subsequent runs
+ * only measure reads. Run the test once as is, and once with
+ * FATFS_FASTSEEK_TABLE_SIZE set to 0 in miosix_settings.h to compare with
+ * following the cluster chain at every seek.
+ *
+ * NOTE: creating the test file requires 64MByte of free space on the SD
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <miosix.h>
+
+using namespace std;
+using namespace std::chrono;
+using namespace miosix;
+
+static const char filename[]="/sd/random_read.dat";
+static const int fileSize=64*1024*1024; ///< Test file size in Byte
+static const int blockSize=4096;        ///< Read size in Byte
+static const int numReads=256;          ///< Reads per test
+
+static unsigned char buffer[blockSize];
+
+static bool createTestFile()
+{
+    struct stat st;
+    if(stat(filename,&st)==0 && st.st_size==fileSize) return true;
+    puts("Creating test file, this may take a while...");
+    int fd=open(filename,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if(fd<0) return false;
+    for(int i=0;i<fileSize;i+=blockSize)
+    {
+        //Each block is filled with its own index, to verify reads
+        memset(buffer,(i/blockSize) & 0xff,blockSize);
+        if(write(fd,buffer,blockSize)!=blockSize)
+        {
+            close(fd);
+            return false;
+        }
+    }
+    return close(fd)==0;
+}
+
+int main()
+{
+    if(createTestFile()==false)
+    {
+        perror("create");
+        return 1;
+    }
+    int fd=open(filename,O_RDONLY,0);
+    if(fd<0)
+    {
+        perror("open");
+        return 1;
+    }
+    for(int test=0;test<4;test++)
+    {
+        float maxTime=0.f;
+        auto start=system_clock::now();
+        for(int i=0;i<numReads;i++)
+        {
+            int block=rand() % (fileSize/blockSize);
+            auto t=system_clock::now();
+            lseek(fd,block*blockSize,SEEK_SET);
+            if(read(fd,buffer,blockSize)!=blockSize || buffer[0]!=(block & 0xff))
+            {
+                puts("Read error");
+                close(fd);
+                return 1;
+            }
+            duration<float> d=system_clock::now()-t;
+            if(d.count()>maxTime) maxTime=d.count();
+        }
+        duration<float> d=system_clock::now()-start;
+        printf("%d random reads of %d bytes: average %0.2fms max %0.2fms\n",
+               numReads,blockSize,d.count()*1000.f/numReads,maxTime*1000.f);
+    }
+    close(fd);
+}
@@ -0,0 +1,96 @@
+#!/usr/bin/perl
+
+#
+# usage: perl trace2json.pl trace.bin > trace.json
+#
+# Converts the binary kernel trace read from /dev/trace of a Miosix board
+# compiled with WITH_KERNEL_TRACE into the Chrome trace event format, which can
+# be opened with https://ui.perfetto.dev or chrome://tracing
+#
+# The trace is a sequence of 16 byte little endian records, see
+# miosix/kernel/trace.h for the meaning of the fields.
+# The CPU track shows which thread was running, with a slice for every
+# interval a thread was scheduled. Each thread has its own track, named after
+# the address of the thread, with slices for the time spent blocked on mutexes
+# and queues or in a syscall. Interrupts are shown in a separate track.
+#
+
+use strict;
+use warnings;
+
+die "Use: perl trace2json.pl trace.bin\n" unless($#ARGV+1==1);
+open(my $in, '<:raw', $ARGV[0]) or die "Can't open $ARGV[0]: $!\n";
+
+my @names=('ContextSwitch','IrqEntry','IrqExit','MutexBlock','MutexUnblock',
+           'QueueBlock','QueueUnblock','SyscallEntry','SyscallExit','Lost');
+my @events;
+my %threads;
+my $current;     # Thread currently running
+my $runStart;    # Time the current thread was scheduled
+my $lastTime=0;
+my $cpuTid=0;    # Thread addresses are never 0 or 1, so reuse them as tid
+my $irqTid=1;
+
+# Timestamps are in nanoseconds, the Chrome trace format wants microseconds
+sub us { return sprintf('%.3f',$_[0]/1000); }
+
+sub event
+{
+	my ($ph,$tid,$time,$name,$extra)=@_;
+	$extra='' unless(defined($extra));
+	push(@events,"{\"ph\":\"$ph\",\"pid\":1,\"tid\":$tid,\"ts\":"
+		.us($time).",\"name\":\"$name\"$extra}");
+}
+
+my $record;
+while(read($in,$record,16)==16)
+{
+	my ($time,$arg,$type)=unpack('q< L< C x3',$record);
+	die "Unknown event $type, corrupted trace?\n" if($type>$#names);
+	my $name=$names[$type];
+	my $hex=sprintf('0x%08x',$arg);
+	$lastTime=$time;
+
+	if($name eq 'ContextSwitch') {
+		if(defined($current)) {
+			event('X',$cpuTid,$runStart,sprintf('Thread 0x%08x',$current),
+				',"dur":'.us($time-$runStart));
+		}
+		$current=$arg;
+		$runStart=$time;
+		$threads{$arg}=1;
+	} elsif($name eq 'IrqEntry') {
+		event('B',$irqTid,$time,"irq $arg");
+	} elsif($name eq 'IrqExit') {
+		event('E',$irqTid,$time,"irq $arg");
+	} elsif($name eq 'Lost') {
+		event('i',$cpuTid,$time,"$arg events lost",',"s":"g"');
+	} else {
+		# Block/unblock and syscalls are attributed to the running thread,
+		# skip them if no context switch has been seen yet
+		next unless(defined($current));
+		my ($ph,$what)=($name=~/(Block|Entry)$/) ? 'B' : 'E';
+		if($name=~/^Mutex/)    { $what="mutex $hex"; }
+		elsif($name=~/^Queue/) { $what="queue $hex"; }
+		else                   { $what="syscall $arg"; }
+		event($ph,$current,$time,$what);
+	}
+}
+close($in);
+
+if(defined($current)) {
+	event('X',$cpuTid,$runStart,sprintf('Thread 0x%08x',$current),
+		',"dur":'.us($lastTime-$runStart));
+}
+
+push(@events,'{"ph":"M","pid":1,"name":"process_name","args":{"name":"Miosix"}}');
+my %tracks=($cpuTid => 'CPU', $irqTid => 'Interrupts');
+$tracks{$_}=sprintf('Thread 0x%08x',$_) foreach(keys(%threads));
+foreach my $tid (sort { $a <=> $b } keys(%tracks)) {
+	push(@events,"{\"ph\":\"M\",\"pid\":1,\"tid\":$tid,"
+		."\"name\":\"thread_name\",\"args\":{\"name\":\"$tracks{$tid}\"}}");
+}
+
+print "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+print join(",\n",@events);
+print "\n]}\n";
@@ -0,0 +1,313 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+/*
+ * Kernel latency benchmark.
+ * Measures the latency of the kernel primitives most relevant for real-time
+ * applications, printing min/avg/max and percentiles as CSV rows so that the
+ * output can be collected from the serial port and compared across kernel
+ * versions and boards.
+ */
+
+#include <cstdio>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "miosix.h"
+#include "interfaces/arch_registers.h"
+#include "util/version.h"
+#include "latency_stats.h"
+
+using namespace std;
+using namespace miosix;
+
+static const char board[]=_MIOSIX_BOARDNAME;
+static LatencyStats stats;
+static volatile long long t0; //Time when the measured operation starts
+
+#ifndef SCHED_TYPE_EDF
+//Helper threads run at a higher priority than main, so that waking them
+//causes an immediate context switch
+static const int helperPriority=MAIN_PRIORITY+1;
+static_assert(helperPriority<PRIORITY_MAX,"Not enough priorities");
+#endif //SCHED_TYPE_EDF
+
+//
+// IRQ to thread wakeup latency through Queue::IRQput
+//
+
+#if defined(_ARCH_CORTEXM0_STM32F0) || defined(_ARCH_CORTEXM0PLUS_STM32L0)
+#define BENCH_IRQn EXTI0_1_IRQn
+#define BENCH_IRQHandler EXTI0_1_IRQHandler
+#elif defined(_ARCH_CORTEXM3_STM32F1) || defined(_ARCH_CORTEXM3_STM32F2) \
+   || defined(_ARCH_CORTEXM3_STM32L1) || defined(_ARCH_CORTEXM4_STM32F3) \
+   || defined(_ARCH_CORTEXM4_STM32F4) || defined(_ARCH_CORTEXM4_STM32L4) \
+   || defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
+#define BENCH_IRQn EXTI0_IRQn
+#define BENCH_IRQHandler EXTI0_IRQHandler
+#endif
+
+#if defined(BENCH_IRQn) && !defined(SCHED_TYPE_EDF)
+static Queue<char,1> irqQueue;
+
+/**
+ * The benchmark does not use the EXTI peripheral, the interrupt is triggered
+ * by software by setting it pending in the NVIC
+ */
+void __attribute__((naked)) BENCH_IRQHandler()
+{
+    saveContext();
+    asm volatile("bl _Z12benchIrqImplv");
+    restoreContext();
+}
+
+void __attribute__((used)) benchIrqImpl()
+{
+    bool hppw=false;
+    irqQueue.IRQput(0,hppw);
+    if(hppw) Scheduler::IRQfindNextThread();
+}
+
+static void irqWaiter(void *)
+{
+    char c;
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        irqQueue.get(c);
+        stats.add(getTime()-t0);
+    }
+}
+
+static void irqWakeup()
+{
+    NVIC_SetPriority(BENCH_IRQn,15); //Lowest priority
+    NVIC_ClearPendingIRQ(BENCH_IRQn);
+    NVIC_EnableIRQ(BENCH_IRQn);
+    Thread *t=Thread::create(irqWaiter,2048,helperPriority,nullptr,Thread::JOINABLE);
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        t0=getTime();
+        NVIC_SetPendingIRQ(BENCH_IRQn);
+        //The interrupt is taken here and the waiter runs to completion
+    }
+    t->join();
+    NVIC_DisableIRQ(BENCH_IRQn);
+    stats.print(board,"irq_queue_wakeup");
+}
+#else //BENCH_IRQn && !SCHED_TYPE_EDF
+static void irqWakeup()
+{
+    //Software triggered interrupt not available for this architecture
+    stats.print(board,"irq_queue_wakeup");
+}
+#endif //BENCH_IRQn && !SCHED_TYPE_EDF
+
+#ifndef SCHED_TYPE_EDF
+
+//
+// Mutex/FastMutex handoff latency, from unlock to the waiting thread running
+//
+
+template<typename M>
+struct HandoffData
+{
+    M mutex;
+    Semaphore go;
+};
+
+template<typename M>
+static void handoffWaiter(void *argv)
+{
+    auto data=reinterpret_cast<HandoffData<M>*>(argv);
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        data->go.wait();
+        data->mutex.lock(); //Blocks as main holds the mutex
+        stats.add(getTime()-t0);
+        data->mutex.unlock();
+    }
+}
+
+template<typename M>
+static void mutexHandoff(const char *name)
+{
+    HandoffData<M> data;
+    Thread *t=Thread::create(handoffWaiter<M>,2048,helperPriority,&data,
+                             Thread::JOINABLE);
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        data.mutex.lock();
+        data.go.signal(); //The waiter runs until it blocks on the mutex
+        t0=getTime();
+        data.mutex.unlock();
+    }
+    t->join();
+    stats.print(board,name);
+}
+
+//
+// ConditionVariable signal to wakeup latency
+//
+
+static Mutex cvMutex;
+static ConditionVariable cv;
+
+static void cvWaiter(void *)
+{
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        Lock<Mutex> l(cvMutex);
+        cv.wait(l);
+        stats.add(getTime()-t0);
+    }
+}
+
+static void condVarWakeup()
+{
+    //The waiter has higher priority, so it is already waiting when create
+    //returns, and it is waiting again when signal returns
+    Thread *t=Thread::create(cvWaiter,2048,helperPriority,nullptr,Thread::JOINABLE);
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        t0=getTime();
+        cv.signal();
+    }
+    t->join();
+    stats.print(board,"condvar_signal_wakeup");
+}
+
+//
+// Semaphore ping-pong, round trip time through two context switches
+//
+
+static Semaphore ping, pong;
+
+static void pongThread(void *)
+{
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        ping.wait();
+        pong.signal();
+    }
+}
+
+static void semaphorePingPong()
+{
+    Thread *t=Thread::create(pongThread,2048,helperPriority,nullptr,Thread::JOINABLE);
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        long long start=getTime();
+        ping.signal();
+        pong.wait();
+        stats.add(getTime()-start);
+    }
+    t->join();
+    stats.print(board,"semaphore_pingpong");
+}
+
+#endif //SCHED_TYPE_EDF
+
+//
+// Thread::create and join cost, including the thread running and exiting
+//
+
+static void emptyThread(void *) {}
+
+static void threadCreateJoin()
+{
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        long long start=getTime();
+        Thread *t=Thread::create(emptyThread,STACK_MIN,MAIN_PRIORITY,nullptr,
+                                 Thread::JOINABLE);
+        if(t==nullptr) break;
+        t->join();
+        stats.add(getTime()-start);
+    }
+    stats.print(board,"thread_create_join");
+}
+
+//
+// nanoSleep wakeup jitter, delay from the requested to the actual wakeup time
+//
+
+static void nanoSleepJitter()
+{
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        long long wakeup=getTime()+1000000; //1ms
+        Thread::nanoSleepUntil(wakeup);
+        stats.add(getTime()-wakeup);
+    }
+    stats.print(board,"nanosleep_jitter");
+}
+
+//
+// SVC round trip, measured by a process as it needs to run in userspace
+//
+
+static void svcRoundTrip()
+{
+    #ifdef WITH_PROCESSES
+    //The process prints its own CSV row
+    const char *arg[]={ "/bin/svc_benchmark", board, nullptr };
+    const char *env[]={ nullptr };
+    pid_t pid;
+    if(posix_spawn(&pid,arg[0],NULL,NULL,(char* const*)arg,(char* const*)env)==0)
+    {
+        int ec;
+        waitpid(pid,&ec,0);
+        return;
+    }
+    #endif //WITH_PROCESSES
+    stats.print(board,"svc_getpid");
+}
+
+int main()
+{
+    iprintf("Kernel latency benchmark\n%s\n\n",getMiosixVersion());
+    //Wait for the serial port to transmit the banner, not to disturb the
+    //measurements
+    Thread::sleep(100);
+    LatencyStats::printHeader();
+    irqWakeup();
+    #ifndef SCHED_TYPE_EDF
+    mutexHandoff<Mutex>("mutex_handoff");
+    mutexHandoff<FastMutex>("fastmutex_handoff");
+    condVarWakeup();
+    semaphorePingPong();
+    #else //SCHED_TYPE_EDF
+    //Benchmarks relying on thread priorities, not possible with EDF
+    stats.print(board,"mutex_handoff");
+    stats.print(board,"fastmutex_handoff");
+    stats.print(board,"condvar_signal_wakeup");
+    stats.print(board,"semaphore_pingpong");
+    #endif //SCHED_TYPE_EDF
+    threadCreateJoin();
+    nanoSleepJitter();
+    svcRoundTrip();
+    iprintf("\nEnd of benchmark\n");
+}
@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <cstdio>
+#include <algorithm>
+
+/**
+ * Collects latency samples and prints their statistics as a CSV row, so that
+ * results can be compared across kernel versions and boards.
+ * Shared between the kernel side of the benchmark and the svc_benchmark
+ * process, hence it only uses the C/C++ standard library.
+ */
+class LatencyStats
+{
+public:
+    /// Number of samples taken by each benchmark
+    static const int maxSamples=1000;
+
+    /**
+     * Add a sample, samples past maxSamples are ignored
+     * \param ns latency in nanoseconds
+     */
+    void add(long long ns)
+    {
+        if(n>=maxSamples) return;
+        samples[n++]=static_cast<unsigned int>(std::max(0LL,std::min(ns,0xffffffffLL)));
+    }
+
+    /**
+     * Print the CSV header, matching the rows printed by print()
+     */
+    static void printHeader()
+    {
+        iprintf("board,benchmark,samples,min_ns,avg_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+    }
+
+    /**
+     * Print the statistics of the samples collected so far as a CSV row, then
+     * clear them so that the object can be reused for the next benchmark
+     * \param board board name
+     * \param name benchmark name
+     */
+    void print(const char *board, const char *name)
+    {
+        if(n==0)
+        {
+            iprintf("%s,%s,0,,,,,,\n",board,name);
+            return;
+        }
+        std::sort(samples,samples+n);
+        unsigned long long sum=0;
+        for(int i=0;i<n;i++) sum+=samples[i];
+        iprintf("%s,%s,%d,%u,%u,%u,%u,%u,%u\n",board,name,n,samples[0],
+            static_cast<unsigned int>(sum/n),percentile(50),percentile(90),
+            percentile(99),samples[n-1]);
+        n=0;
+    }
+
+private:
+    /**
+     * \param p percentile, 1 to 100
+     * \return the requested percentile with the nearest rank method, samples
+     * must already be sorted
+     */
+    unsigned int percentile(int p) const
+    {
+        return samples[std::max(0,(p*n+99)/100-1)];
+    }
+
+    unsigned int samples[maxSamples];
+    int n=0;
+};
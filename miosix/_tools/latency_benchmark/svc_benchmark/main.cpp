@@ -0,0 +1,60 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+/*
+ * SVC round trip benchmark, spawned by the kernel latency benchmark.
+ * Measures the time taken by getpid(), the simplest syscall, in batches to
+ * amortize the cost of reading the time.
+ */
+
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include "../latency_stats.h"
+
+static LatencyStats stats;
+
+static long long now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return t.tv_sec*1000000000LL+t.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *board=argc>1 ? argv[1] : "unknown";
+    const int batch=100;
+    for(int i=0;i<LatencyStats::maxSamples;i++)
+    {
+        long long start=now();
+        for(int j=0;j<batch;j++) getpid();
+        stats.add((now()-start)/batch);
+    }
+    stats.print(board,"svc_getpid");
+    return 0;
+}
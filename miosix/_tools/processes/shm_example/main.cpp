@@ -0,0 +1,110 @@
+// Zero-copy producer/consumer example using shared memory.
+// When started without arguments this program creates a shared segment and
+// acts as the consumer, spawning a copy of itself that acts as the producer.
+// The producer fills frames directly in the shared segment, and the consumer
+// processes them in place, so no byte is ever copied through the kernel.
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <atomic>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <shared_memory.h>
+
+using namespace std;
+using namespace miosix;
+
+const char segmentName[]="frames";
+const unsigned int frameSize=1024;
+//Segment sizes are rounded up to a power of two, so the whole ring is made to
+//fit in 8KByte
+const unsigned int numFrames=7;
+const unsigned int framesToSend=1000;
+
+/**
+ * Single producer single consumer ring of frames, placed in the shared segment
+ */
+struct Ring
+{
+    atomic<unsigned int> head; ///< Frames written, only the producer writes it
+    atomic<unsigned int> tail; ///< Frames read, only the consumer writes it
+    unsigned char frames[numFrames][frameSize];
+};
+
+static void waitABit()
+{
+    timespec t={0,1000000};
+    nanosleep(&t,nullptr);
+}
+
+static int producer()
+{
+    //The consumer already created the segment, so don't pass O_CREAT
+    Ring *ring=reinterpret_cast<Ring*>(shmAttach(segmentName,sizeof(Ring)));
+    if(ring==nullptr)
+    {
+        perror("producer: shmAttach");
+        return 1;
+    }
+    for(unsigned int i=0;i<framesToSend;i++)
+    {
+        unsigned int head=ring->head.load(memory_order_relaxed);
+        while(head-ring->tail.load(memory_order_acquire)==numFrames) waitABit();
+        //Generate the frame in place, like a driver would do with DMA
+        unsigned char *frame=ring->frames[head % numFrames];
+        memset(frame,i & 0xff,frameSize);
+        ring->head.store(head+1,memory_order_release);
+    }
+    shmDetach();
+    return 0;
+}
+
+static int consumer(const char *path)
+{
+    //Unlink first in case a previous run left the segment around
+    shmUnlink(segmentName);
+    Ring *ring=reinterpret_cast<Ring*>(
+        shmAttach(segmentName,sizeof(Ring),O_CREAT|O_EXCL));
+    if(ring==nullptr)
+    {
+        perror("consumer: shmAttach");
+        return 1;
+    }
+    //The segment stays alive as long as we're attached to it
+    shmUnlink(segmentName);
+
+    pid_t pid;
+    const char *arg[]={ path, "producer", nullptr };
+    const char *env[]={ nullptr };
+    if(posix_spawn(&pid,arg[0],nullptr,nullptr,(char* const*)arg,
+                   (char* const*)env)!=0)
+    {
+        puts("consumer: spawn failed");
+        return 1;
+    }
+
+    unsigned int errors=0;
+    for(unsigned int i=0;i<framesToSend;i++)
+    {
+        unsigned int tail=ring->tail.load(memory_order_relaxed);
+        while(ring->head.load(memory_order_acquire)==tail) waitABit();
+        //Process the frame in place
+        const unsigned char *frame=ring->frames[tail % numFrames];
+        for(unsigned int j=0;j<frameSize;j++)
+            if(frame[j]!=(i & 0xff)) { errors++; break; }
+        ring->tail.store(tail+1,memory_order_release);
+    }
+    int ec;
+    waitpid(pid,&ec,0);
+    shmDetach();
+    printf("Received %u frames of %u bytes, %u errors\n",
+           framesToSend,frameSize,errors);
+    return errors==0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc==2 && strcmp(argv[1],"producer")==0) return producer();
+    return consumer(argc>0 ? argv[0] : "/bin/shm_example");
+}
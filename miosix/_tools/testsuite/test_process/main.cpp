@@ -50,6 +50,7 @@ static void fail(const char *cause);
 #include "../test_syscalls.h"
 
 static int sys_test_getpid_child(int argc, char *argv[]);
+static int spawn_benchmark();
 
 int main(int argc, char *argv[], char *envp[])
 {
@@ -59,6 +60,10 @@ int main(int argc, char *argv[], char *envp[])
     {
         if(strcmp("sys_test_getpid_child", argv[1])==0)
             return sys_test_getpid_child(argc, argv);
+        if(strcmp("spawn_benchmark", argv[1])==0)
+            return spawn_benchmark();
+        if(strcmp("exit_0", argv[1])==0)
+            return 0;
         if(strcmp("exit_123", argv[1])==0)
             exit(123);
         if(strcmp("sleep_and_exit_234", argv[1])==0)
@@ -155,3 +160,26 @@ unsigned short crc16(const void *message, unsigned int length)
 }
 
 #include "../test_syscalls.cpp"
+
+/**
+ * Measures the time to spawn a process and wait for its termination
+ */
+static int spawn_benchmark()
+{
+    const char *arg[] = { "/bin/test_process", "exit_0", nullptr };
+    const int iterations=100;
+    long long total=0, minTime=0, maxTime=0;
+    for(int i=0;i<iterations;i++)
+    {
+        long long t=miosix::getTime();
+        if(spawnAndWait(arg)!=0) fail("spawn_benchmark child exit code");
+        t=miosix::getTime()-t;
+        total+=t;
+        if(i==0 || t<minTime) minTime=t;
+        if(t>maxTime) maxTime=t;
+    }
+    iprintf("Spawn+wait latency: avg=%dus min=%dus max=%dus\n",
+        static_cast<int>(total/iterations/1000),
+        static_cast<int>(minTime/1000),static_cast<int>(maxTime/1000));
+    return 0;
+}
@@ -37,6 +37,10 @@ static void fs_test_4();
 static void fs_test_5();
 static void fs_test_6();
 static void fs_test_7();
+#ifndef IN_PROCESS
+static void fs_test_8();
+static void fs_test_9();
+#endif
 static void sys_test_pipe();
 #endif //WITH_FILESYSTEM
 static void sys_test_time();
@@ -46,6 +50,9 @@ static void sys_test_isatty();
 static void sys_test_spawn();
 #ifdef IN_PROCESS
 static void proc_test_global_ctor_dtor();
+static void proc_test_threads();
+static void proc_test_ring();
+static void proc_test_shm_detach();
 #endif
 #endif
 
@@ -62,6 +69,10 @@ void test_syscalls()
     fs_test_5();
     fs_test_6();
     fs_test_7();
+    #ifndef IN_PROCESS
+    fs_test_8();
+    fs_test_9();
+    #endif
     sys_test_pipe();
     #else //WITH_FILESYSTEM
     iprintf("Filesystem tests skipped, filesystem support is disabled\n");
@@ -73,6 +84,9 @@ void test_syscalls()
     sys_test_spawn();
     #ifdef IN_PROCESS
     proc_test_global_ctor_dtor();
+    proc_test_threads();
+    proc_test_ring();
+    proc_test_shm_detach();
     #endif
     #endif
     #ifndef IN_PROCESS
@@ -980,6 +994,245 @@ static void fs_test_7()
     pass();
 }
 
+#ifndef IN_PROCESS
+//
+// Filesystem test 8
+//
+/*
+tests:
+IOCTL_PREALLOCATE
+IOCTL_FILE_LAYOUT
+*/
+
+static FileLayout fs_t8_layout(int fd)
+{
+    FileLayout layout;
+    if(ioctl(fd,IOCTL_FILE_LAYOUT,&layout)!=0) fail("IOCTL_FILE_LAYOUT");
+    return layout;
+}
+
+static void fs_t8_write(int fd, unsigned int length)
+{
+    constexpr unsigned int chunksize=512;
+    unsigned char chunk[chunksize];
+    unsigned char c=0;
+    while(length>0)
+    {
+        unsigned int size=min(length,chunksize);
+        for(unsigned int i=0;i<size;i++) chunk[i]=c++;
+        if(write(fd,chunk,size)!=static_cast<ssize_t>(size)) fail("write");
+        length-=size;
+    }
+}
+
+static void fs_t8_check(int fd, unsigned int length)
+{
+    constexpr unsigned int chunksize=512;
+    unsigned char chunk[chunksize];
+    unsigned char c=0;
+    while(length>0)
+    {
+        unsigned int size=min(length,chunksize);
+        if(read(fd,chunk,size)!=static_cast<ssize_t>(size)) fail("read");
+        for(unsigned int i=0;i<size;i++) if(chunk[i]!=c++) fail("data");
+        length-=size;
+    }
+    if(read(fd,chunk,chunksize)!=0) fail("read past eof");
+}
+
+static void fs_test_8()
+{
+    test_name("Preallocation");
+    const char name[]="/sd/prealloc.dat";
+    unlink(name); //Leftover of a previous run, may fail
+    int fd=open(name,O_WRONLY|O_CREAT|O_TRUNC,0666);
+    if(fd<0) fail("open");
+    FileLayout before=fs_t8_layout(fd);
+    if(before.clusters!=0) fail("clusters of empty file");
+    const unsigned int cs=before.clusterSize;
+    const unsigned int freeClusters=before.freeClusters;
+    //Reserve four clusters, the last one partially
+    off_t size=3*cs+100;
+    if(ioctl(fd,IOCTL_PREALLOCATE,&size)!=0) fail("IOCTL_PREALLOCATE");
+    FileLayout reserved=fs_t8_layout(fd);
+    if(reserved.clusters!=4 || reserved.fragments!=1) fail("reserved chain");
+    if(reserved.freeClusters!=freeClusters-4) fail("free space after preallocate");
+    struct stat st;
+    if(fstat(fd,&st)!=0 || st.st_size!=0) fail("size after preallocate");
+    //Space can only be reserved for empty files
+    if(ioctl(fd,IOCTL_PREALLOCATE,&size)!=-1 || errno!=EBUSY)
+        fail("IOCTL_PREALLOCATE twice");
+    //Writing within the reserved space allocates no clusters
+    const unsigned int written=2*cs+123;
+    fs_t8_write(fd,written);
+    FileLayout full=fs_t8_layout(fd);
+    if(full.clusters!=4 || full.fragments!=1) fail("chain after write");
+    if(full.freeClusters!=freeClusters-4) fail("free space after write");
+    //Closing releases the clusters past the end of file
+    if(close(fd)!=0) fail("close");
+    fd=open(name,O_RDONLY);
+    if(fd<0) fail("reopen");
+    if(fstat(fd,&st)!=0 || st.st_size!=static_cast<off_t>(written)) fail("size after reopen");
+    FileLayout trimmed=fs_t8_layout(fd);
+    if(trimmed.clusters!=3 || trimmed.fragments!=1) fail("trimmed chain");
+    if(trimmed.freeClusters!=freeClusters-3) fail("free space after close");
+    fs_t8_check(fd,written);
+    if(ioctl(fd,IOCTL_PREALLOCATE,&size)!=-1 || errno!=EBADF)
+        fail("IOCTL_PREALLOCATE read only");
+    close(fd);
+    if(unlink(name)!=0) fail("unlink");
+    //No contiguous run of free clusters is this large, and the reservation
+    //of an empty file that is never written is released entirely
+    fd=open(name,O_WRONLY|O_CREAT|O_TRUNC,0666);
+    if(fd<0) fail("open");
+    if(fs_t8_layout(fd).freeClusters!=freeClusters) fail("free space leaked");
+    size=static_cast<off_t>(freeClusters+1)*cs;
+    int result=ioctl(fd,IOCTL_PREALLOCATE,&size);
+    //FAT32 files can't reach 4GB, so on large filesystems expect EFBIG
+    int expected=size>0xffffffff ? EFBIG : ENOSPC;
+    if(result!=-1 || errno!=expected) fail("IOCTL_PREALLOCATE too large");
+    FileLayout failed=fs_t8_layout(fd);
+    if(failed.clusters!=0 || failed.freeClusters!=freeClusters) fail("failed preallocate");
+    size=cs;
+    if(ioctl(fd,IOCTL_PREALLOCATE,&size)!=0) fail("IOCTL_PREALLOCATE");
+    close(fd);
+    fd=open(name,O_RDONLY);
+    if(fd<0) fail("reopen");
+    FileLayout empty=fs_t8_layout(fd);
+    if(empty.clusters!=0 || empty.freeClusters!=freeClusters) fail("unused reservation");
+    close(fd);
+    if(unlink(name)!=0) fail("unlink");
+    pass();
+}
+
+//
+// Filesystem test 9
+//
+/*
+tests:
+BlockCache
+*/
+
+/**
+ * Block device in RAM that counts the accesses
+ */
+class fs_t9_RamDisk : public Device
+{
+public:
+    fs_t9_RamDisk() : Device(Device::BLOCK)
+    {
+        for(unsigned int i=0;i<sizeof(data);i++) data[i]=pattern(i);
+    }
+
+    static unsigned char pattern(unsigned int offset)
+    {
+        return (offset/512)*7+offset;
+    }
+
+    ssize_t readBlock(void *buffer, size_t size, off_t where) override
+    {
+        if(where<0 || where+size>sizeof(data)) return -EIO;
+        memcpy(buffer,data+where,size);
+        reads++;
+        return size;
+    }
+
+    ssize_t writeBlock(const void *buffer, size_t size, off_t where) override
+    {
+        if(where<0 || where+size>sizeof(data)) return -EIO;
+        memcpy(data+where,buffer,size);
+        writes++;
+        return size;
+    }
+
+    int ioctl(int cmd, void *arg) override
+    {
+        if(cmd!=IOCTL_SYNC) return -ENOTTY;
+        syncs++;
+        return 0;
+    }
+
+    unsigned char data[32*512];
+    unsigned int reads=0, writes=0, syncs=0;
+};
+
+static void fs_t9_read(const intrusive_ref_ptr<BlockCache>& cache,
+        unsigned int lba, unsigned int count, fs_t9_RamDisk *disk)
+{
+    unsigned char buffer[4*512];
+    unsigned int size=count*512;
+    if(cache->readBlock(buffer,size,lba*512)!=static_cast<ssize_t>(size))
+        fail("readBlock");
+    //The disk is the reference, so only use on sectors that are not dirty
+    for(unsigned int i=0;i<size;i++)
+        if(buffer[i]!=disk->data[lba*512+i]) fail("data");
+}
+
+static void fs_test_9()
+{
+    test_name("Block cache");
+    auto disk=new fs_t9_RamDisk;
+    intrusive_ref_ptr<Device> diskRef(disk);
+    //Four sectors, two per device access
+    intrusive_ref_ptr<BlockCache> cache(new BlockCache(diskRef,4,2));
+    //Miss, then hit
+    fs_t9_read(cache,3,1,disk);
+    if(disk->reads!=1) fail("miss");
+    fs_t9_read(cache,3,1,disk);
+    if(disk->reads!=1) fail("hit");
+    //Overwriting part of a cached sector is deferred until sync
+    unsigned char chunk[100];
+    memset(chunk,0xa5,sizeof(chunk));
+    if(cache->writeBlock(chunk,sizeof(chunk),3*512+10)!=
+        static_cast<ssize_t>(sizeof(chunk))) fail("writeBlock");
+    if(disk->writes!=0) fail("write through");
+    unsigned char sector[512];
+    if(cache->readBlock(sector,512,3*512)!=512) fail("readBlock");
+    for(unsigned int i=0;i<512;i++)
+    {
+        unsigned char expected=i>=10 && i<110 ? 0xa5 :
+            fs_t9_RamDisk::pattern(3*512+i);
+        if(sector[i]!=expected) fail("read after write");
+        if(disk->data[3*512+i]!=fs_t9_RamDisk::pattern(3*512+i))
+            fail("disk modified before sync");
+    }
+    if(cache->ioctl(IOCTL_SYNC,nullptr)!=0) fail("sync");
+    if(disk->writes!=1 || disk->syncs!=1) fail("sync not written back");
+    if(memcmp(disk->data+3*512,sector,512)!=0) fail("data after sync");
+    fs_t9_read(cache,3,1,disk);
+    if(disk->reads!=1) fail("read after sync");
+    //The second sequential read also reads ahead the third sector
+    fs_t9_read(cache,10,1,disk);
+    fs_t9_read(cache,11,1,disk);
+    fs_t9_read(cache,12,1,disk);
+    if(disk->reads!=3) fail("read-ahead");
+    //Dirty sectors evicted together are written back in one access
+    unsigned char sector20[2*512];
+    for(unsigned int i=0;i<sizeof(sector20);i++) sector20[i]=i/3;
+    if(cache->writeBlock(sector20,512,20*512)!=512) fail("writeBlock");
+    if(cache->writeBlock(sector20+512,512,21*512)!=512) fail("writeBlock");
+    if(disk->reads!=3 || disk->writes!=1) fail("whole sector write");
+    fs_t9_read(cache,5,1,disk);
+    fs_t9_read(cache,7,1,disk);
+    if(disk->writes!=1) fail("early eviction");
+    fs_t9_read(cache,9,1,disk);
+    if(disk->writes!=2) fail("eviction");
+    if(memcmp(disk->data+20*512,sector20,sizeof(sector20))!=0)
+        fail("data after eviction");
+    if(cache->ioctl(IOCTL_SYNC,nullptr)!=0) fail("sync");
+    if(disk->writes!=2 || disk->syncs!=2) fail("sync of clean cache");
+    //Large transfers bypass the cache
+    fs_t9_read(cache,24,4,disk);
+    if(disk->reads!=7) fail("bypass");
+    BlockCacheStats stats;
+    if(cache->ioctl(IOCTL_BLOCK_CACHE_STATS,&stats)!=0) fail("stats");
+    if(stats.deviceReads!=disk->reads || stats.deviceWrites!=disk->writes)
+        fail("stats device accesses");
+    if(stats.readAheads!=1 || stats.writeBacks!=3) fail("stats");
+    pass();
+}
+#endif //IN_PROCESS
+
 //
 // Pipe test
 //
@@ -1201,6 +1454,16 @@ void sys_test_time()
     if (!(900000000<=dt&&dt<=1100000000))
         fail("usleep and clock_gettime do not agree");
 
+    //getTime must never go back in time, also across timer overflows. In
+    //processes this checks reading the time without syscalls
+    t0=miosix::getTime();
+    for(int i=0;i<100000;i++)
+    {
+        long long t1=miosix::getTime();
+        if(t1<t0) fail("getTime not monotonic");
+        t0=t1;
+    }
+
     pass();
 }
 
@@ -1414,6 +1677,264 @@ static void proc_test_global_ctor_dtor()
     pass();
 }
 
+//
+// Threads in processes
+//
+
+static pthread_mutex_t proc_threads_mutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t proc_threads_once=PTHREAD_ONCE_INIT;
+static volatile int proc_threads_counter=0;
+static volatile int proc_threads_onceCalls=0;
+
+static void proc_test_threads_once()
+{
+    //Give other threads the chance to call pthread_once
+    for(int i=0;i<10;i++) pthread_yield();
+    proc_threads_onceCalls++;
+}
+
+static void *proc_test_threads_thread(void *arg)
+{
+    const int n=reinterpret_cast<int>(arg);
+    pthread_once(&proc_threads_once,proc_test_threads_once);
+    errno=n; //errno is per-thread
+    for(int i=0;i<1000;i++)
+    {
+        pthread_mutex_lock(&proc_threads_mutex);
+        int c=proc_threads_counter;
+        if((i & 127)==0) pthread_yield(); //Try to provoke races
+        proc_threads_counter=c+1;
+        pthread_mutex_unlock(&proc_threads_mutex);
+    }
+    if(errno!=n) return nullptr;
+    return reinterpret_cast<void*>(n+100);
+}
+
+static volatile int proc_threads_detachedDone=0;
+
+static void *proc_test_threads_detached(void *)
+{
+    pthread_mutex_lock(&proc_threads_mutex);
+    proc_threads_detachedDone++;
+    pthread_mutex_unlock(&proc_threads_mutex);
+    return nullptr;
+}
+
+static pthread_cond_t proc_threads_cond=PTHREAD_COND_INITIALIZER;
+static volatile int proc_threads_queue=0;
+
+static void *proc_test_threads_producer(void *)
+{
+    for(int i=0;i<100;i++)
+    {
+        pthread_mutex_lock(&proc_threads_mutex);
+        while(proc_threads_queue!=0)
+            pthread_cond_wait(&proc_threads_cond,&proc_threads_mutex);
+        proc_threads_queue=i+1;
+        pthread_cond_broadcast(&proc_threads_cond);
+        pthread_mutex_unlock(&proc_threads_mutex);
+    }
+    return nullptr;
+}
+
+static void proc_test_threads()
+{
+    test_name("Threads in processes");
+    const int numThreads=4;
+    pthread_t t[numThreads];
+    for(int i=0;i<numThreads;i++)
+        if(pthread_create(&t[i],nullptr,proc_test_threads_thread,
+            reinterpret_cast<void*>(i))!=0) fail("pthread_create");
+    if(pthread_equal(pthread_self(),t[0])) fail("pthread_self");
+    for(int i=0;i<numThreads;i++)
+    {
+        void *result;
+        if(pthread_join(t[i],&result)!=0) fail("pthread_join");
+        if(result!=reinterpret_cast<void*>(i+100)) fail("thread result/errno");
+    }
+    if(pthread_join(t[0],nullptr)!=ESRCH) fail("pthread_join twice");
+    if(proc_threads_counter!=numThreads*1000) fail("pthread_mutex");
+    if(proc_threads_onceCalls!=1) fail("pthread_once");
+
+    //Condition variables
+    pthread_t producer;
+    if(pthread_create(&producer,nullptr,proc_test_threads_producer,nullptr)!=0)
+        fail("pthread_create producer");
+    for(int i=0;i<100;i++)
+    {
+        pthread_mutex_lock(&proc_threads_mutex);
+        while(proc_threads_queue==0)
+            pthread_cond_wait(&proc_threads_cond,&proc_threads_mutex);
+        if(proc_threads_queue!=i+1) fail("pthread_cond_wait");
+        proc_threads_queue=0;
+        pthread_cond_broadcast(&proc_threads_cond);
+        pthread_mutex_unlock(&proc_threads_mutex);
+    }
+    if(pthread_join(producer,nullptr)!=0) fail("pthread_join producer");
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    ts.tv_nsec+=10000000;
+    if(ts.tv_nsec>=1000000000) { ts.tv_sec++; ts.tv_nsec-=1000000000; }
+    pthread_mutex_lock(&proc_threads_mutex);
+    int ec=pthread_cond_timedwait(&proc_threads_cond,&proc_threads_mutex,&ts);
+    pthread_mutex_unlock(&proc_threads_mutex);
+    if(ec!=ETIMEDOUT) fail("pthread_cond_timedwait");
+
+    //Detached threads are reclaimed automatically
+    const int numDetached=numThreads*2;
+    pthread_t d[numDetached];
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED);
+    for(int i=0;i<numDetached;i++)
+        if(pthread_create(&d[i],&attr,proc_test_threads_detached,nullptr)!=0)
+            fail("pthread_create detached");
+    pthread_attr_destroy(&attr);
+    for(int i=0;i<100 && proc_threads_detachedDone<numDetached;i++)
+        usleep(1000);
+    if(proc_threads_detachedDone!=numDetached) fail("detached threads");
+    //Terminated detached threads are released when creating a thread, after
+    //which they no longer exist
+    bool reclaimed=false;
+    for(int i=0;i<100 && !reclaimed;i++)
+    {
+        pthread_t j;
+        auto empty=[](void*)->void* { return nullptr; };
+        if(pthread_create(&j,nullptr,empty,nullptr)!=0)
+            fail("pthread_create (reclaim)");
+        if(pthread_join(j,nullptr)!=0) fail("pthread_join (reclaim)");
+        reclaimed=true;
+        for(int k=0;k<numDetached;k++)
+        {
+            int ec=pthread_join(d[k],nullptr);
+            if(ec==EINVAL) reclaimed=false; //Still terminating
+            else if(ec!=ESRCH) fail("pthread_join detached");
+        }
+        if(!reclaimed) usleep(1000);
+    }
+    if(!reclaimed) fail("detached threads not reclaimed");
+    pass();
+}
+
+//
+// Syscall ring
+//
+
+extern "C" int __ringsubmit(void *ring);
+
+/**
+ * Syscall ring as laid out in memory, with room for two entries
+ */
+struct proc_ring
+{
+    unsigned int mask;
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    unsigned int reserved;
+    struct
+    {
+        unsigned int op;
+        int fd;
+        unsigned int ptr;
+        unsigned int arg;
+        long long offset;
+        long long result;
+    } entries[2];
+};
+
+static void proc_test_ring()
+{
+    test_name("Syscall ring");
+    static proc_ring ring;
+    struct stat st;
+    memset(&ring,0,sizeof(ring));
+    ring.mask=1;
+    ring.tail=1;
+    ring.entries[0].op=9; //FSTAT
+    ring.entries[0].fd=STDOUT_FILENO;
+    ring.entries[0].ptr=reinterpret_cast<unsigned int>(&st);
+    ring.entries[0].result=1;
+    if(__ringsubmit(&ring)!=1) fail("submit");
+    if(ring.head!=1 || ring.entries[0].result!=0) fail("fstat result");
+    //Bad entry pointers fail the entry, not the submit
+    ring.tail=2;
+    ring.entries[1]=ring.entries[0];
+    ring.entries[1].ptr=0;
+    if(__ringsubmit(&ring)!=1) fail("submit (bad pointer)");
+    if(ring.entries[1].result!=-EFAULT) fail("bad pointer result");
+
+    //The ring size computation must not overflow, or the kernel would write
+    //results at addresses chosen through head
+    const unsigned int badMasks[]={0x07ffffff,0x0fffffff,0xffffffff};
+    for(unsigned int mask : badMasks)
+    {
+        ring.mask=mask;
+        ring.head=0x01000000;
+        ring.tail=ring.head+1;
+        if(__ringsubmit(&ring)!=-EINVAL) fail("huge mask");
+        if(ring.head!=0x01000000) fail("huge mask executed");
+    }
+    //Mask not a power of two minus one
+    ring.mask=2;
+    ring.head=0;
+    ring.tail=1;
+    if(__ringsubmit(&ring)!=-EINVAL) fail("bad mask");
+    //More queued entries than the ring size
+    ring.mask=1;
+    ring.head=0;
+    ring.tail=3;
+    if(__ringsubmit(&ring)!=-EINVAL) fail("head out of range");
+    ring.head=0x80000000;
+    ring.tail=0x7fffffff;
+    if(__ringsubmit(&ring)!=-EINVAL) fail("head past tail");
+    if(ring.head!=0x80000000) fail("head past tail executed");
+    //Ring outside the process memory
+    if(__ringsubmit(nullptr)!=-EFAULT) fail("null ring");
+    pass();
+}
+
+//
+// Shared memory detach while a syscall uses the segment
+//
+
+static int proc_shm_pipe[2];
+
+static void *proc_test_shm_reader(void *arg)
+{
+    //Blocks in the kernel with a buffer inside the shared segment
+    ssize_t result=read(proc_shm_pipe[0],arg,4);
+    return reinterpret_cast<void*>(result);
+}
+
+static void proc_test_shm_detach()
+{
+    test_name("Shared memory detach");
+    const char name[]="/testsuite_shm";
+    char *segment=reinterpret_cast<char*>(miosix::shmAttach(name,1024,O_CREAT));
+    if(segment==nullptr) fail("shmAttach");
+    if(pipe(proc_shm_pipe)!=0) fail("pipe");
+    pthread_t t;
+    if(pthread_create(&t,nullptr,proc_test_shm_reader,segment)!=0)
+        fail("pthread_create");
+    usleep(10000); //Let the thread block in read
+    //Detaching does not wait for the read, which keeps the segment allocated
+    if(miosix::shmDetach()!=0) fail("shmDetach during syscall");
+    if(miosix::shmDetach()!=-1 || errno!=EINVAL) fail("shmDetach twice");
+    if(write(proc_shm_pipe[1],"test",4)!=4) fail("write");
+    void *result;
+    if(pthread_join(t,&result)!=0) fail("pthread_join");
+    if(result!=reinterpret_cast<void*>(4)) fail("read");
+    //The read completed in the segment even if it was no longer mapped
+    segment=reinterpret_cast<char*>(miosix::shmAttach(name,1024));
+    if(segment==nullptr) fail("shmAttach (2)");
+    if(memcmp(segment,"test",4)!=0) fail("read data");
+    if(miosix::shmDetach()!=0) fail("shmDetach");
+    if(miosix::shmUnlink(name)!=0) fail("shmUnlink");
+    close(proc_shm_pipe[0]);
+    close(proc_shm_pipe[1]);
+    pass();
+}
+
 #endif // IN_PROCESS
 
 #endif // WITH_PROCESSES
@@ -48,6 +48,12 @@
 #include <sys/wait.h>
 #ifndef IN_PROCESS
 #include <thread>
+#include <sys/ioctl.h>
+#include "filesystem/ioctl.h"
+#include "filesystem/blockcache/block_cache.h"
+#else
+#include <pthread.h>
+#include <shared_memory.h>
 #endif
 
 int spawnAndWait(const char *arg[]);
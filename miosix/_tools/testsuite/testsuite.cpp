@@ -120,6 +120,9 @@ static void test_24();
 static void test_25();
 static void test_26();
 static void test_27();
+#ifdef WITH_THREAD_POOL
+static void test_28();
+#endif //WITH_THREAD_POOL
 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
 void testCacheAndDMA();
 #endif //_ARCH_CORTEXM7_STM32F7/H7
@@ -131,6 +134,8 @@ static void benchmark_1();
 static void benchmark_2();
 static void benchmark_3();
 static void benchmark_4();
+static void benchmark_5();
+static void benchmark_6();
 //Exception thread safety test
 #ifndef __NO_EXCEPTIONS
 static void exception_test();
@@ -191,6 +196,9 @@ int main()
                 test_25();
                 test_26();
                 test_27();
+                #ifdef WITH_THREAD_POOL
+                test_28();
+                #endif //WITH_THREAD_POOL
                 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
                 testCacheAndDMA();
                 #endif //_ARCH_CORTEXM7_STM32F7/H7
@@ -223,6 +231,8 @@ int main()
                 benchmark_2();
                 benchmark_3();
                 benchmark_4();
+                benchmark_5();
+                benchmark_6();
 
                 ledOff();
                 Thread::sleep(500);//Ensure all threads are deleted.
@@ -3991,6 +4001,50 @@ static void test_27()
     pass();
 }
 
+//
+// Test 28
+//
+/*
+tests:
+ThreadPool
+MemoryProfiling::getThreadPoolStats
+*/
+
+#ifdef WITH_THREAD_POOL
+static void *t28_p1(void *argv)
+{
+    //Dirty part of the stack, a recycled stack must be filled again
+    volatile char buffer[128];
+    for(unsigned int i=0;i<sizeof(buffer);i++) buffer[i]=i;
+    if(MemoryProfiling::getStackSize()!=1024) fail("stack size not rounded");
+    return reinterpret_cast<void*>(MemoryProfiling::getAbsoluteFreeStack());
+}
+
+static void test_28()
+{
+    test_name("Thread pool");
+    Thread::sleep(10); //Make sure deleted threads have been deallocated
+    Thread *t=Thread::create(t28_p1,1000,MAIN_PRIORITY,nullptr,Thread::JOINABLE);
+    if(t==nullptr) fail("thread creation");
+    void *freeStack1;
+    t->join(&freeStack1);
+    //Now the idle thread returns the thread memory to the pool. If the pool
+    //for this size class was already full, it already had a free block
+    Thread::sleep(10);
+    ThreadPool::Stats before=MemoryProfiling::getThreadPoolStats();
+    if(before.freeBlocks==0) fail("pool empty");
+    t=Thread::create(t28_p1,1024,MAIN_PRIORITY,nullptr,Thread::JOINABLE);
+    if(t==nullptr) fail("thread creation");
+    ThreadPool::Stats after=MemoryProfiling::getThreadPoolStats();
+    if(after.hits!=before.hits+1) fail("pool not used");
+    if(after.freeBlocks!=before.freeBlocks-1) fail("free blocks");
+    void *freeStack2;
+    t->join(&freeStack2);
+    if(freeStack1!=freeStack2) fail("recycled stack not filled");
+    pass();
+}
+#endif //WITH_THREAD_POOL
+
 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
 static Thread *waiting=nullptr; /// Thread waiting on DMA completion IRQ
 
@@ -4270,6 +4324,7 @@ static void benchmark_1()
 /*
 tests:
 context switch speed
+context switch speed as the number of blocked threads grows
 */
 
 static bool b2_v1;
@@ -4302,11 +4357,54 @@ static int b2_f1(int priority)
     return b2_v2;
 }
 
+static void b2_p2(void *argv)
+{
+    //Stays blocked until terminated, only adds to the number of threads
+    while(Thread::testTerminate()==false) Thread::wait();
+}
+
+/**
+ * Measure context switches per second between two threads at max priority
+ * while numThreads-2 other threads with the same priority are blocked
+ * \param numThreads total number of threads, including the two that switch
+ * \return the number of context switches per second, or -1 if there was not
+ * enough memory to create all the threads
+ */
+static int b2_f2(int numThreads)
+{
+    Thread::setPriority(3);
+    vector<Thread*> blocked;
+    for(int i=0;i<numThreads-2;i++)
+    {
+        Thread *t=Thread::create(b2_p2,STACK_MIN,3,NULL,Thread::JOINABLE);
+        if(t==NULL) break;
+        blocked.push_back(t);
+    }
+    Thread::sleep(10); //Give time to all threads to block
+    int result=-1;
+    if(static_cast<int>(blocked.size())==numThreads-2) result=b2_f1(3);
+    for(auto t : blocked)
+    {
+        t->terminate();
+        t->join();
+    }
+    Thread::setPriority(0);
+    return result;
+}
+
 static void benchmark_2()
 {
     #ifndef SCHED_TYPE_EDF
     iprintf("%d context switch per second (max priority)\n",b2_f1(3));
     iprintf("%d context switch per second (min priority)\n",b2_f1(0));
+    const int numThreads[]={8,32,128};
+    for(int n : numThreads)
+    {
+        int cs=b2_f2(n);
+        if(cs<=0) iprintf("Not enough memory to run with %d threads\n",n);
+        else iprintf("%d context switch per second (%d threads, %d blocked)"
+            " %dns per context switch\n",cs,n,n-2,1000000000/cs);
+    }
     #else //SCHED_TYPE_EDF
     iprintf("Context switch benchmark not possible with EDF\n");
     #endif //SCHED_TYPE_EDF
@@ -4448,6 +4546,38 @@ static void benchmark_4()
     }
     iprintf("%d pthread_mutex lock/unlock pairs per second\n",i);
 
+    FastMutex m2;
+    b4_end=false;
+    #ifndef SCHED_TYPE_EDF
+    Thread::create(b4_t1,STACK_SMALL);
+    #else
+    Thread::create(b4_t1,STACK_SMALL,0);
+    #endif
+    Thread::yield();
+    i=0;
+    while(b4_end==false)
+    {
+        m2.lock();
+        m2.unlock();
+        i++;
+    }
+    iprintf("%d FastMutex lock/unlock pairs per second\n",i);
+
+    b4_end=false;
+    #ifndef SCHED_TYPE_EDF
+    Thread::create(b4_t1,STACK_SMALL);
+    #else
+    Thread::create(b4_t1,STACK_SMALL,0);
+    #endif
+    Thread::yield();
+    i=0;
+    while(b4_end==false)
+    {
+        if(pthread_mutex_trylock(&m1)==0) pthread_mutex_unlock(&m1);
+        i++;
+    }
+    iprintf("%d pthread_mutex trylock/unlock pairs per second\n",i);
+
     b4_end=false;
     #ifndef SCHED_TYPE_EDF
     Thread::create(b4_t1,STACK_SMALL);
@@ -4496,3 +4626,95 @@ static void benchmark_4()
     }
     iprintf("%d fast disable/enable interrupts pairs per second\n",i);
 }
+
+//
+// Benchmark 5
+//
+/*
+tests:
+worst case wakeup latency of a high priority thread while many other threads
+are periodically sleeping. This latency includes the time spent with
+interrupts disabled to insert threads in the sleeping list and wake them
+*/
+
+static volatile bool b5_end;
+
+static void b5_p1(void *argv)
+{
+    //Every wakeup reinserts this thread with the farthest wakeup time
+    const long long period=1000000; //1ms
+    long long t=getTime();
+    while(b5_end==false)
+    {
+        t+=period;
+        Thread::nanoSleepUntil(t);
+    }
+}
+
+/**
+ * \param numSleepers number of periodically sleeping threads
+ * \return the max wakeup latency in nanoseconds, or -1 if there was not
+ * enough memory to create all the threads
+ */
+static int b5_f1(int numSleepers)
+{
+    b5_end=false;
+    vector<Thread*> sleepers;
+    for(int i=0;i<numSleepers;i++)
+    {
+        Thread *t=Thread::create(b5_p1,STACK_MIN,0,NULL,Thread::JOINABLE);
+        if(t==NULL) break;
+        sleepers.push_back(t);
+    }
+    long long maxLatency=-1;
+    if(static_cast<int>(sleepers.size())==numSleepers)
+    {
+        Thread::setPriority(3);
+        //Not a multiple of the sleepers period, to wake at all possible phases
+        const long long period=1100000;
+        long long t=getTime();
+        for(int i=0;i<1000;i++)
+        {
+            t+=period;
+            Thread::nanoSleepUntil(t);
+            maxLatency=max(maxLatency,getTime()-t);
+        }
+        Thread::setPriority(0);
+    }
+    b5_end=true;
+    for(auto t : sleepers) t->join();
+    return static_cast<int>(maxLatency);
+}
+
+static void benchmark_5()
+{
+    #ifndef SCHED_TYPE_EDF
+    const int numSleepers[]={1,16,256};
+    for(int n : numSleepers)
+    {
+        int latency=b5_f1(n);
+        if(latency<0) iprintf("Not enough memory to run with %d sleeping threads\n",n);
+        else iprintf("Max wakeup latency with %d sleeping threads = %dns\n",n,latency);
+    }
+    #else //SCHED_TYPE_EDF
+    iprintf("Sleeping list benchmark not possible with EDF\n");
+    #endif //SCHED_TYPE_EDF
+}
+
+//
+// Benchmark 6
+//
+/*
+tests:
+time to spawn a process and wait for its termination
+*/
+
+static void benchmark_6()
+{
+    #ifdef WITH_PROCESSES
+    const char *arg[] = { "/bin/test_process", "spawn_benchmark", nullptr };
+    if(spawnAndWait(arg)!=0) iprintf("Spawn benchmark failed\n");
+    #else //WITH_PROCESSES
+    iprintf("Spawn benchmark not possible without processes\n");
+    #endif //WITH_PROCESSES
+}
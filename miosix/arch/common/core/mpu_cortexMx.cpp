@@ -71,6 +71,9 @@ MPUConfiguration::MPUConfiguration(const unsigned int *elfBase, unsigned int elf
                | MPU_RASR_C_Msk
                | 1 //Enable bit
                | sizeToMpu(imageSize)<<1;
+    //Region 5 is reserved for shared memory, disabled until setSharedRegion()
+    regValues[4]=MPU_RBAR_VALID_Msk | 5;
+    regValues[5]=0;
     #else //__MPU_PRESENT==1
     #warning architecture lacks MPU, memory protection for processes unsupported
     //Although we have no MPU, store enough information to still enable checking
@@ -79,27 +82,68 @@ MPUConfiguration::MPUConfiguration(const unsigned int *elfBase, unsigned int elf
     regValues[2]=(reinterpret_cast<unsigned int>(imageBase) & (~0x1f));
     regValues[1]=sizeToMpu(elfSize)<<1;
     regValues[3]=sizeToMpu(imageSize)<<1;
+    regValues[4]=0;
+    regValues[5]=0;
+    #endif //__MPU_PRESENT==1
+}
+
+void MPUConfiguration::setSharedRegion(const unsigned int *base,
+        unsigned int size)
+{
+    #if __MPU_PRESENT==1
+    regValues[4]=(reinterpret_cast<unsigned int>(base) & (~0x1f))
+               | MPU_RBAR_VALID_Msk | 5; //Region 5
+    regValues[5]=3<<MPU_RASR_AP_Pos //Privileged: RW, unprivileged: RW
+               | MPU_RASR_XN_Msk
+               | MPU_RASR_C_Msk
+               | 1 //Enable bit
+               | sizeToMpu(size)<<1;
+    #else //__MPU_PRESENT==1
+    regValues[4]=(reinterpret_cast<unsigned int>(base) & (~0x1f));
+    regValues[5]=sizeToMpu(size)<<1;
+    #endif //__MPU_PRESENT==1
+}
+
+void MPUConfiguration::IRQsetTimePageRegions(const unsigned int *page,
+        unsigned int pageSize, const unsigned int *timer, unsigned int timerSize)
+{
+    #if __MPU_PRESENT==1
+    MPU->RBAR=(reinterpret_cast<unsigned int>(page) & (~0x1f))
+            | MPU_RBAR_VALID_Msk | 3; //Region 3
+    MPU->RASR=2<<MPU_RASR_AP_Pos //Privileged: RW, unprivileged: RO
+            | MPU_RASR_XN_Msk
+            | MPU_RASR_C_Msk
+            | 1 //Enable bit
+            | sizeToMpu(pageSize)<<1;
+    MPU->RBAR=(reinterpret_cast<unsigned int>(timer) & (~0x1f))
+            | MPU_RBAR_VALID_Msk | 4; //Region 4
+    MPU->RASR=2<<MPU_RASR_AP_Pos //Privileged: RW, unprivileged: RO
+            | MPU_RASR_XN_Msk
+            | MPU_RASR_B_Msk //Device memory
+            | 1 //Enable bit
+            | sizeToMpu(timerSize)<<1;
     #endif //__MPU_PRESENT==1
 }
 
 void MPUConfiguration::dumpConfiguration()
 {
+    const int numbers[]={6,7,5};
     #if __MPU_PRESENT==1
-    for(int i=0;i<2;i++)
+    for(int i=0;i<3;i++)
     {
-        unsigned int base=regValues[2*i] & (~0x1f);
-        unsigned int end=base+(1<<(((regValues[2*i+1]>>1) & 31)+1));
+        if(!regionEnabled(i)) continue;
         char w=regValues[2*i+1] & (1<<MPU_RASR_AP_Pos) ? 'w' : '-';
         char x=regValues[2*i+1] & MPU_RASR_XN_Msk ? '-' : 'x';
-        iprintf("* MPU region %d 0x%08x-0x%08x r%c%c\n",i+6,base,end,w,x);
+        iprintf("* MPU region %d 0x%08x-0x%08x r%c%c\n",numbers[i],
+                regionStart(i),regionEnd(i),w,x);
     }
     #else //__MPU_PRESENT==1
     iprintf("* Architecture lacks MPU\n");
-    for(int i=0;i<2;i++)
+    for(int i=0;i<3;i++)
     {
-        unsigned int base=regValues[2*i] & (~0x1f);
-        unsigned int end=base+(1<<(((regValues[2*i+1]>>1) & 31)+1));
-        iprintf("* MPU region %d 0x%08x-0x%08x rwx\n",i+6,base,end);
+        if(!regionEnabled(i)) continue;
+        iprintf("* MPU region %d 0x%08x-0x%08x rwx\n",numbers[i],
+                regionStart(i),regionEnd(i));
     }
     #endif //__MPU_PRESENT==1
 }
@@ -142,36 +186,40 @@ pair<const unsigned int*, unsigned int> MPUConfiguration::roundRegionForMPU(
 
 bool MPUConfiguration::withinForReading(const void *ptr, size_t size) const
 {
-    size_t codeStart=regValues[0] & (~0x1f);
-    size_t codeEnd=codeStart+(1<<(((regValues[1]>>1) & 31)+1));
-    size_t dataStart=regValues[2] & (~0x1f);
-    size_t dataEnd=dataStart+(1<<(((regValues[3]>>1) & 31)+1));
     size_t base=reinterpret_cast<size_t>(ptr);
-    //The last check is to prevent a wraparound to be considered valid
-    return (   (base>=codeStart && base+size<codeEnd)
-            || (base>=dataStart && base+size<dataEnd)) && base+size>=base;
+    //Prevent a wraparound to be considered valid
+    if(base+size<base) return false;
+    for(int i=0;i<3;i++)
+    {
+        if(!regionEnabled(i)) continue;
+        if(base>=regionStart(i) && base+size<regionEnd(i)) return true;
+    }
+    return false;
 }
 
 bool MPUConfiguration::withinForWriting(const void *ptr, size_t size) const
 {
-    size_t dataStart=regValues[2] & (~0x1f);
-    size_t dataEnd=dataStart+(1<<(((regValues[3]>>1) & 31)+1));
     size_t base=reinterpret_cast<size_t>(ptr);
-    //The last check is to prevent a wraparound to be considered valid
-    return base>=dataStart && base+size<dataEnd && base+size>=base;
+    //Prevent a wraparound to be considered valid
+    if(base+size<base) return false;
+    //Region 0, the elf, is the only one that is not writable
+    for(int i=1;i<3;i++)
+    {
+        if(!regionEnabled(i)) continue;
+        if(base>=regionStart(i) && base+size<regionEnd(i)) return true;
+    }
+    return false;
 }
 
 bool MPUConfiguration::withinForReading(const char* str) const
 {
-    size_t codeStart=regValues[0] & (~0x1f);
-    size_t codeEnd=codeStart+(1<<(((regValues[1]>>1) & 31)+1));
-    size_t dataStart=regValues[2] & (~0x1f);
-    size_t dataEnd=dataStart+(1<<(((regValues[3]>>1) & 31)+1));
     size_t base=reinterpret_cast<size_t>(str);
-    if((base>=codeStart) && (base<codeEnd))
-        return strnlen(str,codeEnd-base)<codeEnd-base;
-    if((base>=dataStart) && (base<dataEnd))
-        return strnlen(str,dataEnd-base)<dataEnd-base;
+    for(int i=0;i<3;i++)
+    {
+        if(!regionEnabled(i)) continue;
+        size_t start=regionStart(i), end=regionEnd(i);
+        if(base>=start && base<end) return strnlen(str,end-base)<end-base;
+    }
     return false;
 }
 
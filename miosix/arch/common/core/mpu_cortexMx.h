@@ -76,6 +76,31 @@ public:
     MPUConfiguration(const unsigned int *elfBase, unsigned int elfSize,
             const unsigned int *imageBase, unsigned int imageSize);
     
+    /**
+     * \internal
+     * Map a memory area shared between processes in the spare MPU region.
+     * The area is readable and writable, but not executable
+     * \param base base address of the shared area, must be aligned to its size
+     * \param size size of the shared area, must be a power of two
+     */
+    void setSharedRegion(const unsigned int *base, unsigned int size);
+
+    /**
+     * \internal
+     * Make the time page and the os timer registers readable, but not writable
+     * nor executable, by all processes. As these regions are the same for all
+     * processes, they are configured once at boot instead of at every context
+     * switch, in regions 3 and 4.
+     * \param page base address of the time page, must be aligned to its size
+     * \param pageSize size of the time page, must be a power of two
+     * \param timer base address of the timer registers, must be aligned to
+     * its size
+     * \param timerSize size of the timer registers, must be a power of two
+     */
+    static void IRQsetTimePageRegions(const unsigned int *page,
+            unsigned int pageSize, const unsigned int *timer,
+            unsigned int timerSize);
+
     /**
      * \internal
      * This method is used to configure the Memoy Protection region for a 
@@ -89,6 +114,8 @@ public:
         MPU->RASR=regValues[1];
         MPU->RBAR=regValues[2];
         MPU->RASR=regValues[3];
+        MPU->RBAR=regValues[4];
+        MPU->RASR=regValues[5];
         __set_CONTROL(3);
         #endif //__MPU_PRESENT==1
     }
@@ -159,8 +186,30 @@ public:
 
     //Uses default copy constructor and operator=
 private:
+    /**
+     * \param i region index, 0 for the elf, 1 for the image and 2 for the
+     * shared area
+     * \return true if the region is configured
+     */
+    bool regionEnabled(int i) const { return regValues[2*i+1]!=0; }
+
+    /**
+     * \param i region index
+     * \return the start address of the region
+     */
+    size_t regionStart(int i) const { return regValues[2*i] & (~0x1f); }
+
+    /**
+     * \param i region index
+     * \return the end address of the region
+     */
+    size_t regionEnd(int i) const
+    {
+        return regionStart(i)+(1<<(((regValues[2*i+1]>>1) & 31)+1));
+    }
+
     ///These value are copied into the MPU registers to configure them
-    unsigned int regValues[4]; 
+    unsigned int regValues[6];
 };
 
 #endif //WITH_PROCESSES
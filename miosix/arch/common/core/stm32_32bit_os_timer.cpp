@@ -123,6 +123,18 @@ public:
 
     static inline void IRQstopTimer() { T::get()->CR1 &= ~TIM_CR1_CEN; }
     static inline void IRQstartTimer() { T::get()->CR1 |= TIM_CR1_CEN; }
+
+    #ifdef WITH_PROCESSES
+    static bool IRQgetUserspaceRegisters(const volatile unsigned int *& counter,
+            const volatile unsigned int *& status, unsigned int& overflowMask)
+    {
+        //Reading the timer registers has no side effects
+        counter=reinterpret_cast<const volatile unsigned int*>(&T::get()->CNT);
+        status=reinterpret_cast<const volatile unsigned int*>(&T::get()->SR);
+        overflowMask=TIM_SR_UIF;
+        return true;
+    }
+    #endif //WITH_PROCESSES
     
     static unsigned int IRQTimerFrequency()
     {
@@ -208,6 +208,8 @@ inline void MPUConfiguration::IRQenable()
     MPU->RASR=regValues[1];
     MPU->RBAR=regValues[2];
     MPU->RASR=regValues[3];
+    MPU->RBAR=regValues[4];
+    MPU->RASR=regValues[5];
     __set_CONTROL(3); 
 }
 
@@ -81,6 +81,15 @@ namespace miosix {
 /// (CPUTimeCounter is disabled).
 //#define WITH_CPU_TIME_COUNTER
 
+/// \def WITH_KERNEL_TRACE
+/// Allows to enable/disable KernelTrace, which records a timeline of context
+/// switches, blocking on mutexes and queues, interrupts and process syscalls
+/// that can be read from /dev/trace. By default it is not defined (tracing is
+/// disabled).
+//#define WITH_KERNEL_TRACE
+/// Number of events in the KernelTrace buffer (MUST be a power of 2)
+const unsigned int KERNEL_TRACE_BUFFER_SIZE=512;
+
 //
 // Filesystem options
 //
@@ -111,6 +120,36 @@ constexpr unsigned char FATFS_MAX_OPEN_FILES=8;
 /// FATFS partition if one concurrent truncate/write past the end per partition
 /// occurs.
 constexpr unsigned int FATFS_EXTEND_BUFFER=512;
+/// Seeking in a FATFS file requires following its cluster chain, which for
+/// large files may take hundreds of sector reads. When a seek would follow more
+/// than FATFS_FASTSEEK_MIN_CLUSTERS links, a table of the file fragments is
+/// built instead, and kept until the file is enlarged or truncated. This is the
+/// table size in 32 bit words, two per fragment plus two, and is allocated per
+/// open file only when needed. Files too fragmented to fit in the table are
+/// seeked by following the chain. Set to 0 to disable fast seek
+constexpr unsigned int FATFS_FASTSEEK_TABLE_SIZE=64;
+constexpr unsigned int FATFS_FASTSEEK_MIN_CLUSTERS=16;
+
+/// \def WITH_BLOCK_CACHE
+/// Uncomment to add a block cache between the filesystems mounted in /sd and
+/// the block device. The cache keeps recently used sectors in RAM, performs
+/// read-ahead on sequential reads and defers writes until the filesystem syncs,
+/// coalescing adjacent sectors into multi-block writes. It costs
+/// (BLOCK_CACHE_SIZE+BLOCK_CACHE_MAX_TRANSFER)*512 bytes of heap.
+/// WARNING: with the cache, writes are no longer written through. Data and
+/// filesystem metadata reach the disk only on fsync()/close() or when evicted,
+/// so up to BLOCK_CACHE_SIZE sectors are lost on a power failure. Applications
+/// that never sync their files, such as data loggers, should leave it disabled
+/// or use SYNC_AFTER_WRITE.
+/// By default it is not defined (writes go straight to the block device)
+//#define WITH_BLOCK_CACHE
+/// Number of 512 byte sectors held by the block cache. Must be greater than 0
+constexpr unsigned int BLOCK_CACHE_SIZE=16;
+/// Maximum number of sectors transferred by the block cache in a single device
+/// access, used for read-ahead and for writing back adjacent dirty sectors.
+/// A buffer of this many sectors is allocated in addition to the cache, and
+/// requests spanning more sectors bypass the cache. Must be greater than 0
+constexpr unsigned int BLOCK_CACHE_MAX_TRANSFER=4;
 
 /// \def WITH_LITTLEFS
 /// Allows to enable/disable LittleFS support to save code size
@@ -220,10 +259,60 @@ const unsigned int MAX_PROCESS_ARGS=16;
 /// does not contribute to the stack size.
 const unsigned int MAX_PROCESS_ARGS_BLOCK_SIZE=512;
 
+/// Maximum number of bytes of the process pool used to keep programs loaded
+/// from a non-XIP filesystem in RAM after the last process running them has
+/// terminated, so that spawning them again does not require reading them from
+/// disk. Retained programs are evicted in least recently used order, and also
+/// when the process pool runs out of memory, so they only occupy memory that no
+/// process needs. Every program in RAM, retained or not, also takes from the
+/// kernel heap a list node and two unordered_map nodes to index it, and once
+/// spawned a copy of its relocated .data. Zero disables retention
+const unsigned int PROGRAM_CACHE_RETAIN_BYTES=32*1024;
+
+/// Maximum size of a shared memory segment that processes can create to
+/// exchange data without copying it through the kernel. The size is rounded
+/// up to a power of two to fit in a memory protection region
+const unsigned int MAX_SHARED_SEGMENT_SIZE=64*1024;
+
+/// Number of buckets of the per-process hash table of threads blocked in a
+/// futex wait, looked up by the address being waited on. Processes with many
+/// threads waiting on different addresses benefit from more buckets, each
+/// one costs 8 bytes per process (MUST be a power of two)
+const unsigned int PROCESS_FUTEX_BUCKETS=8;
+
+/// \def WITH_THREAD_POOL
+/// Uncomment to recycle the memory of terminated threads instead of returning
+/// it to the heap. This is useful for applications that create and destroy
+/// short-lived threads at a high rate, as it prevents heap fragmentation and
+/// makes the time to create a thread more predictable, at the cost of keeping
+/// some memory reserved and rounding up the stack size of threads.
+/// By default it is not defined (thread memory is returned to the heap)
+//#define WITH_THREAD_POOL
+
+#ifdef WITH_THREAD_POOL
+/// Stack sizes of the thread pool size classes, in ascending order. The stack
+/// size of threads is rounded up to the first size class that fits, threads
+/// with a larger stack are not recycled (MUST be divisible by 4)
+constexpr unsigned int THREAD_POOL_CLASSES[]={STACK_MIN,1024,2048,4096};
+/// Maximum number of blocks kept by the thread pool for each size class
+constexpr unsigned int THREAD_POOL_MAX_FREE=4;
+#endif //WITH_THREAD_POOL
+
+/// \def WITH_TLSF_HEAP
+/// Uncomment to replace the newlib malloc with a two-level segregated fit
+/// allocator, whose malloc, free and realloc run in bounded time regardless of
+/// heap usage and fragmentation. Since the kernel is paused while allocating
+/// memory, this also bounds the latency added to higher priority threads by
+/// threads that use the heap. It also enables
+/// MemoryProfiling::getHeapFragmentation().
+/// By default it is not defined (newlib malloc is used)
+//#define WITH_TLSF_HEAP
+
 static_assert(STACK_IDLE>=STACK_MIN,"");
 static_assert(STACK_DEFAULT_FOR_PTHREAD>=STACK_MIN,"");
 static_assert(MIN_PROCESS_STACK_SIZE>=STACK_MIN,"");
 static_assert(SYSTEM_MODE_PROCESS_STACK_SIZE>=STACK_MIN,"");
+static_assert((PROCESS_FUTEX_BUCKETS & (PROCESS_FUTEX_BUCKETS-1))==0,"");
 
 /// Number of priorities (MUST be >1)
 /// PRIORITY_MAX-1 is the highest priority, 0 is the lowest. -1 is reserved as
@@ -0,0 +1,291 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "block_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+
+using namespace std;
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+BlockCache::BlockCache(intrusive_ref_ptr<Device> dev, unsigned int cacheSize,
+                       unsigned int maxTransfer)
+    : Device(Device::BLOCK), dev(dev), cacheSize(max(cacheSize,1u)),
+      maxTransfer(max(min(maxTransfer,this->cacheSize),1u))
+{
+    sectors=new Sector[this->cacheSize];
+    cacheData=new unsigned char[this->cacheSize*sectorSize];
+    staging=new unsigned char[this->maxTransfer*sectorSize];
+    for(unsigned int i=0;i<this->cacheSize;i++)
+    {
+        sectors[i].lastUse=0;
+        sectors[i].valid=false;
+        sectors[i].dirty=false;
+    }
+    memset(&stats,0,sizeof(stats));
+}
+
+ssize_t BlockCache::readBlock(void *buffer, size_t size, off_t where)
+{
+    if(where<0) return -EINVAL;
+    Lock<FastMutex> l(mutex);
+    auto dst=reinterpret_cast<unsigned char*>(buffer);
+    size_t done=0;
+    while(done<size)
+    {
+        unsigned int lba=(where+done)/sectorSize;
+        unsigned int offset=(where+done)%sectorSize;
+        Sector *s=find(lba);
+        if(s==nullptr)
+        {
+            //Count the uncached sectors entirely covered by the request
+            unsigned int full=offset==0 ? (size-done)/sectorSize : 0;
+            unsigned int run=0;
+            while(run<full && find(lba+run)==nullptr) run++;
+            if(run>maxTransfer)
+            {
+                //Large transfer, bypass the cache
+                ssize_t len=run*sectorSize;
+                stats.misses+=run;
+                stats.deviceReads++;
+                ssize_t res=dev->readBlock(dst+done,len,
+                                           static_cast<off_t>(lba)*sectorSize);
+                if(res!=len) return res<0 ? res : -EIO;
+                done+=len;
+                nextSequential=lba+run;
+                continue;
+            }
+            unsigned int needed=max(run,1u);
+            unsigned int count=needed;
+            if(lba==nextSequential)
+                while(count<maxTransfer && find(lba+count)==nullptr) count++;
+            stats.misses+=needed;
+            int res=fill(lba,count);
+            //Read-ahead may go past the end of the device, retry without it
+            if(res<0 && count>needed) res=fill(lba,count=needed);
+            if(res<0) return res;
+            stats.readAheads+=count-needed;
+            s=find(lba);
+        } else stats.hits++;
+        size_t len=min<size_t>(size-done,sectorSize-offset);
+        memcpy(dst+done,data(s)+offset,len);
+        touch(s);
+        done+=len;
+        nextSequential=lba+1;
+    }
+    return size;
+}
+
+ssize_t BlockCache::writeBlock(const void *buffer, size_t size, off_t where)
+{
+    if(where<0) return -EINVAL;
+    Lock<FastMutex> l(mutex);
+    auto src=reinterpret_cast<const unsigned char*>(buffer);
+    size_t done=0;
+    while(done<size)
+    {
+        unsigned int lba=(where+done)/sectorSize;
+        unsigned int offset=(where+done)%sectorSize;
+        unsigned int full=offset==0 ? (size-done)/sectorSize : 0;
+        if(full>maxTransfer)
+        {
+            //Large transfer, bypass the cache but keep cached copies coherent
+            ssize_t len=full*sectorSize;
+            stats.deviceWrites++;
+            ssize_t res=dev->writeBlock(src+done,len,
+                                        static_cast<off_t>(lba)*sectorSize);
+            if(res!=len) return res<0 ? res : -EIO;
+            for(unsigned int i=0;i<cacheSize;i++)
+            {
+                Sector *s=&sectors[i];
+                if(s->valid==false || s->lba<lba || s->lba>=lba+full) continue;
+                memcpy(data(s),src+done+(s->lba-lba)*sectorSize,sectorSize);
+                s->dirty=false;
+            }
+            done+=len;
+            continue;
+        }
+        size_t len=min<size_t>(size-done,sectorSize-offset);
+        Sector *s=find(lba);
+        if(s==nullptr)
+        {
+            if(len==sectorSize)
+            {
+                //Sector entirely overwritten, no need to read it
+                s=allocate(lba);
+                if(s==nullptr) return -EIO;
+            } else {
+                stats.misses++;
+                int res=fill(lba,1);
+                if(res<0) return res;
+                s=find(lba);
+            }
+        } else stats.hits++;
+        memcpy(data(s)+offset,src+done,len);
+        s->dirty=true;
+        touch(s);
+        done+=len;
+    }
+    return size;
+}
+
+int BlockCache::ioctl(int cmd, void *arg)
+{
+    switch(cmd)
+    {
+        case IOCTL_SYNC:
+        {
+            Lock<FastMutex> l(mutex);
+            int res=flush();
+            if(res<0) return res;
+            return dev->ioctl(cmd,arg);
+        }
+        case IOCTL_BLOCK_CACHE_STATS:
+            if(arg==nullptr) return -EFAULT;
+            *reinterpret_cast<BlockCacheStats*>(arg)=getStats();
+            return 0;
+        default:
+            return dev->ioctl(cmd,arg);
+    }
+}
+
+BlockCacheStats BlockCache::getStats()
+{
+    Lock<FastMutex> l(mutex);
+    return stats;
+}
+
+BlockCache::~BlockCache()
+{
+    flush();
+    delete[] staging;
+    delete[] cacheData;
+    delete[] sectors;
+}
+
+BlockCache::Sector *BlockCache::find(unsigned int lba)
+{
+    for(unsigned int i=0;i<cacheSize;i++)
+        if(sectors[i].valid && sectors[i].lba==lba) return &sectors[i];
+    return nullptr;
+}
+
+BlockCache::Sector *BlockCache::allocate(unsigned int lba)
+{
+    Sector *victim=&sectors[0];
+    for(unsigned int i=0;i<cacheSize;i++)
+    {
+        if(sectors[i].valid==false) { victim=&sectors[i]; break; }
+        if(sectors[i].lastUse<victim->lastUse) victim=&sectors[i];
+    }
+    if(victim->valid && victim->dirty && writeBack(victim)<0) return nullptr;
+    victim->lba=lba;
+    victim->valid=true;
+    victim->dirty=false;
+    touch(victim);
+    return victim;
+}
+
+int BlockCache::fill(unsigned int lba, unsigned int count)
+{
+    //Allocate first, as evictions may use the staging buffer to write back.
+    //Freshly allocated slots are the most recently used, and count<=cacheSize, so
+    //allocating a slot never evicts another one of this batch
+    for(unsigned int i=0;i<count;i++)
+    {
+        if(allocate(lba+i)!=nullptr) continue;
+        while(i>0) find(lba+--i)->valid=false;
+        return -EIO;
+    }
+    ssize_t len=count*sectorSize;
+    stats.deviceReads++;
+    ssize_t res=dev->readBlock(staging,len,static_cast<off_t>(lba)*sectorSize);
+    for(unsigned int i=0;i<count;i++)
+    {
+        Sector *s=find(lba+i);
+        if(res==len) memcpy(data(s),staging+i*sectorSize,sectorSize);
+        else s->valid=false;
+    }
+    if(res!=len) return res<0 ? res : -EIO;
+    return 0;
+}
+
+int BlockCache::writeBack(Sector *s)
+{
+    //Extend the run of dirty sectors backwards, then forward
+    unsigned int first=s->lba;
+    unsigned int count=1;
+    while(count<maxTransfer && first>0)
+    {
+        Sector *prev=find(first-1);
+        if(prev==nullptr || prev->dirty==false) break;
+        first--;
+        count++;
+    }
+    while(count<maxTransfer)
+    {
+        Sector *next=find(first+count);
+        if(next==nullptr || next->dirty==false) break;
+        count++;
+    }
+    for(unsigned int i=0;i<count;i++)
+        memcpy(staging+i*sectorSize,data(find(first+i)),sectorSize);
+    ssize_t len=count*sectorSize;
+    stats.deviceWrites++;
+    ssize_t res=dev->writeBlock(staging,len,static_cast<off_t>(first)*sectorSize);
+    if(res!=len) return res<0 ? res : -EIO;
+    for(unsigned int i=0;i<count;i++) find(first+i)->dirty=false;
+    stats.writeBacks+=count;
+    return 0;
+}
+
+int BlockCache::flush()
+{
+    //Write back in ascending sector order, so that runs of adjacent dirty
+    //sectors are written starting from their first sector
+    for(;;)
+    {
+        Sector *lowest=nullptr;
+        for(unsigned int i=0;i<cacheSize;i++)
+        {
+            Sector *s=&sectors[i];
+            if(s->valid==false || s->dirty==false) continue;
+            if(lowest==nullptr || s->lba<lowest->lba) lowest=s;
+        }
+        if(lowest==nullptr) return 0;
+        int res=writeBack(lowest);
+        if(res<0) return res;
+    }
+}
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
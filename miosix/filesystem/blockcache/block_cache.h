@@ -0,0 +1,186 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "filesystem/devfs/devfs.h"
+#include "filesystem/ioctl.h"
+#include "kernel/sync.h"
+#include "config/miosix_settings.h"
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+/**
+ * A write-back cache of 512 byte sectors that can wrap any block Device.
+ * The wrapper is itself a Device, so filesystems access it as they would
+ * access the wrapped device, through DevFs or directly.
+ *
+ * - Sectors are evicted in least recently used order.
+ * - When a read misses the sector that follows the previous read, up to
+ *   maxTransfer sectors are read with a single device access (read-ahead).
+ * - Writes are kept in the cache until IOCTL_SYNC or eviction. When a dirty
+ *   sector is written back, adjacent dirty sectors are written back with it in
+ *   a single multi-block write.
+ * - Requests spanning more than maxTransfer uncached sectors go straight to the
+ *   device, so that large sequential transfers don't flush the cache.
+ *
+ * Statistics can be retrieved with the IOCTL_BLOCK_CACHE_STATS ioctl.
+ */
+class BlockCache : public Device
+{
+public:
+    /**
+     * Constructor
+     * \param dev block device to wrap
+     * \param cacheSize number of sectors in the cache
+     * \param maxTransfer maximum number of sectors transferred by the cache
+     * in a single device access
+     */
+    BlockCache(intrusive_ref_ptr<Device> dev,
+               unsigned int cacheSize=BLOCK_CACHE_SIZE,
+               unsigned int maxTransfer=BLOCK_CACHE_MAX_TRANSFER);
+
+    /**
+     * Read a block of data
+     * \param buffer buffer where read data will be stored
+     * \param size buffer size
+     * \param where where to read from
+     * \return number of bytes read or a negative number on failure
+     */
+    virtual ssize_t readBlock(void *buffer, size_t size, off_t where);
+
+    /**
+     * Write a block of data
+     * \param buffer buffer where take data to write
+     * \param size buffer size
+     * \param where where to write to
+     * \return number of bytes written or a negative number on failure
+     */
+    virtual ssize_t writeBlock(const void *buffer, size_t size, off_t where);
+
+    /**
+     * Performs device-specific operations. IOCTL_SYNC writes back all dirty
+     * sectors before being forwarded to the wrapped device,
+     * IOCTL_BLOCK_CACHE_STATS is handled by the cache, other operations are
+     * forwarded to the wrapped device
+     * \param cmd specifies the operation to perform
+     * \param arg optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     */
+    virtual int ioctl(int cmd, void *arg);
+
+    /**
+     * \return the cache statistics
+     */
+    BlockCacheStats getStats();
+
+    /**
+     * Destructor, writes back dirty sectors
+     */
+    ~BlockCache();
+
+    BlockCache(const BlockCache&)=delete;
+    BlockCache& operator=(const BlockCache&)=delete;
+
+private:
+    /**
+     * Per-sector cache metadata
+     */
+    struct Sector
+    {
+        unsigned int lba;     ///< Sector number on the device
+        unsigned int lastUse; ///< For LRU eviction
+        bool valid;           ///< Sector holds data
+        bool dirty;           ///< Sector was modified since last written back
+    };
+
+    /**
+     * \param lba sector number
+     * \return the cached sector, or nullptr if not cached
+     */
+    Sector *find(unsigned int lba);
+
+    /**
+     * Assign a cache slot to a sector, evicting the least recently used one.
+     * The content of the returned slot is undefined
+     * \param lba sector number, must not be already cached
+     * \return the slot or nullptr if writing back the evicted sector failed
+     */
+    Sector *allocate(unsigned int lba);
+
+    /**
+     * Read consecutive sectors from the device into the cache, none of which
+     * must be already cached
+     * \param lba first sector number
+     * \param count number of sectors, not greater than maxTransfer
+     * \return 0 on success, or a negative number on failure
+     */
+    int fill(unsigned int lba, unsigned int count);
+
+    /**
+     * Write back a dirty sector, together with adjacent dirty sectors
+     * \param s dirty sector
+     * \return 0 on success, or a negative number on failure
+     */
+    int writeBack(Sector *s);
+
+    /**
+     * Write back all dirty sectors
+     * \return 0 on success, or a negative number on failure
+     */
+    int flush();
+
+    /**
+     * \param s a cache slot
+     * \return the slot data
+     */
+    unsigned char *data(Sector *s) { return cacheData+(s-sectors)*sectorSize; }
+
+    /**
+     * Mark a sector as the most recently used one
+     */
+    void touch(Sector *s) { s->lastUse=++useCounter; }
+
+    static const unsigned int sectorSize=512;
+
+    FastMutex mutex;
+    intrusive_ref_ptr<Device> dev; ///< Wrapped device
+    const unsigned int cacheSize;  ///< Number of cache slots
+    const unsigned int maxTransfer;///< Maximum sectors per device access
+    Sector *sectors;               ///< Cache slots metadata
+    unsigned char *cacheData;      ///< Cache slots data
+    unsigned char *staging;        ///< Buffer for multi-sector transfers
+    unsigned int useCounter=0;     ///< Incremented at every access
+    unsigned int nextSequential=0; ///< Sector following the last one read
+    BlockCacheStats stats;
+};
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
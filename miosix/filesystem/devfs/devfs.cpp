@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include "filesystem/stringpart.h"
+#include "kernel/trace.h"
 
 using namespace std;
 
@@ -123,6 +124,28 @@ public:
      */
     virtual int ioctl(int cmd, void *arg);
 
+    /**
+     * Read data from the device at the given offset, without changing the
+     * seek point
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param offset where to read from
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t offset);
+
+    /**
+     * Write data to the device at the given offset, without changing the
+     * seek point
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param offset where to write to
+     * \return the number of written characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t offset);
+
 private:
     intrusive_ref_ptr<Device> dev; ///< Device file
     off_t seekPoint;               ///< Seek point (note that off_t is 64bit)
@@ -186,6 +209,22 @@ int DevFsFile::ioctl(int cmd, void *arg)
     return dev->ioctl(cmd,arg);
 }
 
+ssize_t DevFsFile::pread(void *data, size_t len, off_t offset)
+{
+    if((flags & _FREAD)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(offset<0) return -EINVAL;
+    return dev->readBlock(data,len,offset);
+}
+
+ssize_t DevFsFile::pwrite(const void *data, size_t len, off_t offset)
+{
+    if((flags & _FWRITE)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(offset<0) return -EINVAL;
+    return dev->writeBlock(data,len,offset);
+}
+
 //
 // class Device
 //
@@ -325,6 +364,9 @@ DevFs::DevFs() : mutex(FastMutex::RECURSIVE), inodeCount(rootDirInode+1)
 {
     addDevice("null",intrusive_ref_ptr<Device>(new Device(Device::STREAM)));
     addDevice("zero",intrusive_ref_ptr<Device>(new Device(Device::STREAM)));
+    #ifdef WITH_KERNEL_TRACE
+    addDevice("trace",KernelTrace::makeDevice());
+    #endif //WITH_KERNEL_TRACE
 }
 
 bool DevFs::addDevice(const char *name, intrusive_ref_ptr<Device> dev)
@@ -5,12 +5,20 @@
 
 #include "diskio.h"
 #include "filesystem/ioctl.h"
+#include "kernel/sync.h"
 #include "config/miosix_settings.h"
+#include <errno.h>
 
 #ifdef WITH_FILESYSTEM
 
 using namespace miosix;
 
+/// Files of a Fat32Fs read data sectors concurrently, without holding the
+/// filesystem mutex. Drives that don't support positional access, such as
+/// files in loop mounted images, have a shared seek point, so this mutex makes
+/// the lseek and read/write pair atomic
+static FastMutex diskMutex;
+
 // #ifdef __cplusplus
 // extern "C" {
 // #endif
@@ -49,9 +57,15 @@ DRESULT disk_read (
     intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
 	BYTE *buff,		/* Data buffer to store read data */
 	DWORD sector,           /* Sector address (LBA) */
-	UINT count		/* Number of sectors to read (1..255) */
+	UINT count		/* Number of sectors to read */
 )
 {
+    //Whole multi-sector transfers go to the device in a single call, reading
+    //directly into the caller's buffer
+    ssize_t size=static_cast<ssize_t>(count)*512;
+    ssize_t result=pdrv->pread(buff,size,static_cast<off_t>(sector)*512);
+    if(result!=-ESPIPE) return result==size ? RES_OK : RES_ERROR;
+    Lock<FastMutex> l(diskMutex);
     if(pdrv->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
     if(pdrv->read(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
     return RES_OK;
@@ -65,9 +79,13 @@ DRESULT disk_write (
     intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
 	const BYTE *buff,	/* Data to be written */
 	DWORD sector,		/* Sector address (LBA) */
-	UINT count		/* Number of sectors to write (1..255) */
+	UINT count		/* Number of sectors to write */
 )
 {
+    ssize_t size=static_cast<ssize_t>(count)*512;
+    ssize_t result=pdrv->pwrite(buff,size,static_cast<off_t>(sector)*512);
+    if(result!=-ESPIPE) return result==size ? RES_OK : RES_ERROR;
+    Lock<FastMutex> l(diskMutex);
     if(pdrv->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
     if(pdrv->write(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
     return RES_OK;
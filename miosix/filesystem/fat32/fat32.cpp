@@ -189,6 +189,8 @@ public:
      * Constructor
      * \param parent the filesystem to which this file belongs
      * \param flags file open flags
+     * \param mutex mutex to lock when accessing the FAT, directories, or
+     * allocating clusters
      */
     Fat32File(intrusive_ref_ptr<FilesystemBase> parent, int flags, FastMutex& mutex);
     
@@ -235,7 +237,11 @@ public:
     virtual int fstat(struct stat *pstat) const;
     
     /**
-     * Perform various operations on a file descriptor
+     * Perform various operations on a file descriptor. Besides IOCTL_SYNC,
+     * IOCTL_FASTSEEK builds the fast seek table without waiting for a long
+     * seek, so that the first random access is also fast,
+     * IOCTL_PREALLOCATE reserves contiguous space for an empty file and
+     * IOCTL_FILE_LAYOUT reports the clusters allocated to the file
      * \param cmd specifies the operation to perform
      * \param arg optional argument that some operation require
      * \return the exact return value depends on CMD, -1 is returned on error
@@ -258,12 +264,76 @@ public:
     ~Fat32File();
     
 private:
+    /**
+     * Build the table of the file fragments used by FatFs to seek without
+     * following the cluster chain. Must be called with both mutexes locked
+     * \return 0 on success, or a negative number on failure
+     */
+    int buildFastSeekTable();
+
+    /**
+     * Stop using the fast seek table, as the file cluster chain is about to
+     * change. Must be called with fileMutex locked
+     */
+    void invalidateFastSeekTable();
+
+    /**
+     * \param offset seek destination
+     * \return true if seeking to offset requires following many clusters
+     */
+    bool isLongSeek(off_t offset);
+
+    /**
+     * Allocate a contiguous run of clusters to an empty file, without changing
+     * its size. Writes up to the reserved size then need no cluster allocation
+     * and, through the fast seek table, no FAT access. Unused clusters are
+     * released when the file is closed. Must be called with both mutexes locked
+     * \param size number of bytes to reserve
+     * \return 0 on success, or a negative number on failure
+     */
+    int preallocate(off_t size);
+
+    /**
+     * Walk the cluster chain of the file. Must be called with both mutexes
+     * locked
+     * \param layout the clusters allocated to the file are stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    int getLayout(FileLayout *layout);
+
+    /**
+     * \return the cluster size in bytes
+     */
+    off_t clusterSize() const
+    {
+        return static_cast<off_t>(file.fs->csize)*_MAX_SS;
+    }
+
+    /**
+     * \param len number of bytes to read
+     * \return true if reading len bytes from the current position requires
+     * following the cluster chain in the FAT
+     */
+    bool readFollowsChain(size_t len);
+
     FIL file;
+    /// Filesystem mutex, protects the FAT, directories and the FatFs window
     FastMutex& mutex;
+    /// Protects the FIL, so that operations on different files that only
+    /// access data clusters can proceed concurrently
+    FastMutex fileMutex;
     int inode=0;
     /// Used to map FatFs behavior into POSIX. Variable is 0 as long as we seek
     /// within, contains by how many bytes we seeked past the end otherwise
     off_t seekPastEnd=0;
+    /// Fast seek table, allocated on the first long seek
+    unique_ptr<DWORD[]> fastSeekTable;
+    /// Bytes of file data in the clusters listed in the fast seek table
+    off_t fastSeekCoverage=0;
+    /// True if the file has too many fragments to fit in the fast seek table
+    bool tooFragmented=false;
+    /// True if clusters past the end of file may have been preallocated
+    bool preallocated=false;
 };
 
 //
@@ -271,12 +341,19 @@ private:
 //
 
 Fat32File::Fat32File(intrusive_ref_ptr<FilesystemBase> parent, int flags, FastMutex& mutex)
-        : FileBase(parent,flags), mutex(mutex) {}
+        : FileBase(parent,flags), mutex(mutex), fileMutex(FastMutex::RECURSIVE) {}
 
 ssize_t Fat32File::write(const void *data, size_t len)
 {
-    Lock<FastMutex> l(mutex);
+    //Writes may allocate clusters and update the directory entry
+    Lock<FastMutex> l(fileMutex);
+    Lock<FastMutex> l2(mutex);
     unsigned int bytesWritten;
+    //Writing past the clusters in the fast seek table needs new clusters,
+    //and appending may change how fragmented the file is
+    off_t end=static_cast<off_t>(f_tell(&file))+seekPastEnd+len;
+    if(file.cltbl ? end>fastSeekCoverage : end>static_cast<off_t>(f_size(&file)))
+        invalidateFastSeekTable();
     //NOTE: if we lseek'd past the end, we f_lseek'd to the end and seekPastEnd
     //is >0. We need to handle this special case by filling the gap with zeros
     //Note that in this case write should not return the number of bytes written
@@ -308,18 +385,29 @@ ssize_t Fat32File::write(const void *data, size_t len)
 
 ssize_t Fat32File::read(void *data, size_t len)
 {
-    Lock<FastMutex> l(mutex);
+    Lock<FastMutex> l(fileMutex);
     unsigned int bytesRead;
     //NOTE: if we lseek'd past the end, we f_lseek'd to the end and seekPastEnd
     //is >0. Either reading at the end or past the end shall return 0 (eof), so
     //there's no need to handle the read past the end case specially
-    if(int res=translateError(f_read(&file,data,len,&bytesRead))) return res;
+    FRESULT res;
+    //Reading data sectors only touches the FIL, so the filesystem mutex is
+    //needed only to look up the next cluster in the FAT
+    if(readFollowsChain(len))
+    {
+        Lock<FastMutex> l2(mutex);
+        //The cluster chain of files not opened for writing can't change, so
+        //after building the fast seek table reads no longer need the mutex
+        if((file.flag & FA_WRITE)==0) buildFastSeekTable();
+        res=f_read(&file,data,len,&bytesRead);
+    } else res=f_read(&file,data,len,&bytesRead);
+    if(int result=translateError(res)) return result;
     return static_cast<int>(bytesRead);
 }
 
 off_t Fat32File::lseek(off_t pos, int whence)
 {
-    Lock<FastMutex> l(mutex);
+    Lock<FastMutex> l(fileMutex);
     off_t offset, fileSize=static_cast<off_t>(f_size(&file));
     switch(whence)
     {
@@ -349,19 +437,33 @@ off_t Fat32File::lseek(off_t pos, int whence)
         seekPastEnd=offset-fileSize;
         offset=fileSize;
     } else seekPastEnd=0;
-    if(int result=translateError(
-        f_lseek(&file,static_cast<unsigned long>(offset)))) return result;
+    if(isLongSeek(offset))
+    {
+        //Failing to build the table is not an error, we just seek the slow way
+        Lock<FastMutex> l2(mutex);
+        buildFastSeekTable();
+    }
+    FRESULT res;
+    //With the fast seek table FatFs doesn't need to follow the cluster chain
+    if(file.cltbl) res=f_lseek(&file,static_cast<unsigned long>(offset));
+    else {
+        Lock<FastMutex> l2(mutex);
+        res=f_lseek(&file,static_cast<unsigned long>(offset));
+    }
+    if(int result=translateError(res)) return result;
     return offset+seekPastEnd;
 }
 
 int Fat32File::ftruncate(off_t size)
 {
-    Lock<FastMutex> l(mutex);
+    Lock<FastMutex> l(fileMutex);
+    Lock<FastMutex> l2(mutex);
     off_t fileSize=static_cast<off_t>(f_size(&file));
     if(size==fileSize) return 0; //Nothing to do
     off_t curPos=static_cast<off_t>(f_tell(&file))+seekPastEnd;
 
     int result=0;
+    invalidateFastSeekTable();
     if(size<fileSize)
     {
         //Shrinking, FatFs f_truncate truncates to the current file position
@@ -369,7 +471,10 @@ int Fat32File::ftruncate(off_t size)
         if(r) return r;
         result=translateError(f_truncate(&file));
     } else {
-        //Enlarging, can't use f_truncate so seek past the end an write
+        //Enlarging, can't use f_truncate so seek past the end an write. If the
+        //file is empty, allocate it contiguously first. This is just an
+        //optimization, so errors are ignored
+        if(fileSize==0) preallocate(size);
         off_t r=lseek(size,SEEK_SET);
         if(r<0) return r;
         result=write(nullptr,0);
@@ -395,15 +500,153 @@ int Fat32File::fstat(struct stat *pstat) const
 
 int Fat32File::ioctl(int cmd, void *arg)
 {
-    if(cmd!=IOCTL_SYNC) return -ENOTTY;
-    Lock<FastMutex> l(mutex);
-    return translateError(f_sync(&file));
+    Lock<FastMutex> l(fileMutex);
+    Lock<FastMutex> l2(mutex);
+    switch(cmd)
+    {
+        case IOCTL_SYNC:
+            return translateError(f_sync(&file));
+        case IOCTL_FASTSEEK:
+            return buildFastSeekTable();
+        case IOCTL_PREALLOCATE:
+            if(arg==nullptr) return -EFAULT;
+            return preallocate(*reinterpret_cast<off_t*>(arg));
+        case IOCTL_FILE_LAYOUT:
+            if(arg==nullptr) return -EFAULT;
+            return getLayout(reinterpret_cast<FileLayout*>(arg));
+        default:
+            return -ENOTTY;
+    }
 }
 
 Fat32File::~Fat32File()
 {
-    Lock<FastMutex> l(mutex);
-    if(inode) f_close(&file); //TODO: what to do with error code?
+    Lock<FastMutex> l(fileMutex);
+    Lock<FastMutex> l2(mutex);
+    if(inode==0) return;
+    if(preallocated)
+    {
+        invalidateFastSeekTable();
+        f_trim(&file);
+    }
+    f_close(&file); //TODO: what to do with error code?
+}
+
+int Fat32File::buildFastSeekTable()
+{
+    if(file.cltbl) return 0; //Already built
+    if(FATFS_FASTSEEK_TABLE_SIZE==0 || tooFragmented) return -ENOMEM;
+    if(!fastSeekTable)
+    {
+        fastSeekTable.reset(new (nothrow) DWORD[FATFS_FASTSEEK_TABLE_SIZE]);
+        if(!fastSeekTable) return -ENOMEM;
+    }
+    fastSeekTable[0]=FATFS_FASTSEEK_TABLE_SIZE;
+    file.cltbl=fastSeekTable.get();
+    FRESULT res=f_lseek(&file,CREATE_LINKMAP);
+    if(res==FR_OK)
+    {
+        //Table layout: used size, then fragment length and first cluster pairs
+        off_t clusters=0;
+        for(DWORD *t=&fastSeekTable[1];*t;t+=2) clusters+=*t;
+        fastSeekCoverage=clusters*clusterSize();
+        return 0;
+    }
+    file.cltbl=nullptr;
+    fastSeekTable.reset();
+    if(res!=FR_NOT_ENOUGH_CORE) return translateError(res);
+    //Don't retry at every seek, fragmentation only changes on append/truncate
+    tooFragmented=true;
+    return -ENOMEM;
+}
+
+void Fat32File::invalidateFastSeekTable()
+{
+    //FatFs keeps track of the current cluster also in fast seek mode, so
+    //switching back to following the chain needs no other bookkeeping
+    file.cltbl=nullptr;
+    fastSeekCoverage=0;
+    tooFragmented=false;
+}
+
+int Fat32File::preallocate(off_t size)
+{
+    if(size<=0) return -EINVAL;
+    if(size>0xffffffff) return -EFBIG;
+    if((file.flag & FA_WRITE)==0) return -EBADF;
+    //Only empty files, as the reserved clusters must start the cluster chain
+    if(f_size(&file)!=0 || file.sclust!=0) return -EBUSY;
+    FRESULT res=f_expand(&file,static_cast<DWORD>(size));
+    if(res==FR_DENIED) return -ENOSPC; //No contiguous run of free clusters
+    if(res!=FR_OK) return translateError(res);
+    preallocated=true;
+    //A contiguous file fits in a one fragment table
+    buildFastSeekTable();
+    return 0;
+}
+
+int Fat32File::getLayout(FileLayout *layout)
+{
+    //Let FatFs walk the chain as when building a fast seek table, with a
+    //temporary table so as not to disturb the one in use
+    DWORD *cltbl=file.cltbl;
+    DWORD small[4]={4};
+    unique_ptr<DWORD[]> large;
+    file.cltbl=small;
+    FRESULT res=f_lseek(&file,CREATE_LINKMAP);
+    if(res==FR_NOT_ENOUGH_CORE)
+    {
+        //Table layout: used size, fragment length and first cluster pairs,
+        //then a terminating zero
+        DWORD required=small[0];
+        large.reset(new (nothrow) DWORD[required]);
+        if(!large)
+        {
+            file.cltbl=cltbl;
+            return -ENOMEM;
+        }
+        large[0]=required;
+        file.cltbl=large.get();
+        res=f_lseek(&file,CREATE_LINKMAP);
+    }
+    file.cltbl=cltbl;
+    if(res!=FR_OK) return translateError(res);
+    DWORD *table=large ? large.get() : small;
+    layout->clusterSize=clusterSize();
+    layout->clusters=0;
+    layout->fragments=0;
+    for(DWORD *t=&table[1];*t;t+=2)
+    {
+        layout->clusters+=*t;
+        layout->fragments++;
+    }
+    DWORD freeClusters;
+    res=f_getfree(file.fs,&freeClusters);
+    if(res!=FR_OK) return translateError(res);
+    layout->freeClusters=freeClusters;
+    return 0;
+}
+
+bool Fat32File::isLongSeek(off_t offset)
+{
+    if(file.cltbl || FATFS_FASTSEEK_TABLE_SIZE==0) return false;
+    off_t target=offset/clusterSize();
+    off_t current=static_cast<off_t>(f_tell(&file))/clusterSize();
+    //Seeking backwards FatFs follows the chain from the start of the file
+    off_t links=target>=current ? target-current : target;
+    return links>FATFS_FASTSEEK_MIN_CLUSTERS;
+}
+
+bool Fat32File::readFollowsChain(size_t len)
+{
+    if(file.cltbl) return false; //Clusters are looked up in the table
+    unsigned long fptr=f_tell(&file);
+    unsigned long n=min<unsigned long>(len,f_size(&file)-fptr);
+    //FatFs looks up the next cluster when reading from a cluster boundary,
+    //except at the start of the file, whose first cluster is in the FIL
+    unsigned long cs=clusterSize();
+    unsigned long boundary=max(1ul,(fptr+cs-1)/cs)*cs;
+    return boundary<fptr+n;
 }
 
 //
@@ -1128,6 +1128,43 @@ DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Extend a multi-sector transfer over the following contiguous clusters */
+/*-----------------------------------------------------------------------*/
+/* Not in FatFs R0.10, where direct transfers stop at cluster boundaries */
+
+static
+UINT contiguous_sectors (	/* Number of sectors to transfer */
+	FIL* fp,		/* Pointer to the file object, fp->clust is updated to the last cluster */
+	UINT csect,		/* Sector offset in the current cluster */
+	UINT cc			/* Number of sectors requested */
+)
+{
+	DWORD ncl, ofs, bcs;
+	UINT n;
+
+
+	n = fp->fs->csize - csect;		/* Sectors left in the current cluster */
+	bcs = (DWORD)fp->fs->csize * SS(fp->fs);
+	ofs = fp->fptr - csect * SS(fp->fs);	/* Offset of the current cluster */
+	while (n < cc && ofs <= 0xFFFFFFFF - bcs) {
+		ofs += bcs;					/* Offset of the next cluster */
+#if _USE_FASTSEEK
+		if (fp->cltbl)
+			ncl = clmt_clust(fp, ofs);	/* Get cluster# from the CLMT */
+		else
+#endif
+			ncl = get_fat(fp->fs, fp->clust);	/* Follow cluster chain on the FAT */
+		if (ncl != fp->clust + 1) break;	/* Not contiguous, errors are caught by the caller */
+		fp->clust = ncl;
+		n += fp->fs->csize;
+	}
+	return n < cc ? n : cc;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Set directory index                              */
 /*-----------------------------------------------------------------------*/
@@ -2601,8 +2638,8 @@ FRESULT f_read (
 			sect += csect;
 			cc = btr / SS(fp->fs);				/* When remaining bytes >= sector size, */
 			if (cc) {							/* Read maximum contiguous sectors directly */
-				if (csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
-					cc = fp->fs->csize - csect;
+				if (csect + cc > fp->fs->csize)	/* Clip at the end of contiguous clusters */
+					cc = contiguous_sectors(fp, csect, cc);
 				if (disk_read(fp->fs->drv, rbuff, sect, cc))
 					ABORT(fp->fs, FR_DISK_ERR);
 #if !_FS_READONLY && _FS_MINIMIZE <= 2			/* Replace one of the read sectors with cached data if it contains a dirty sector */
@@ -2715,8 +2752,8 @@ FRESULT f_write (
 			sect += csect;
 			cc = btw / SS(fp->fs);			/* When remaining bytes >= sector size, */
 			if (cc) {						/* Write maximum contiguous sectors directly */
-				if (csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
-					cc = fp->fs->csize - csect;
+				if (csect + cc > fp->fs->csize)	/* Clip at the end of contiguous clusters */
+					cc = contiguous_sectors(fp, csect, cc);
 				if (disk_write(fp->fs->drv, wbuff, sect, cc))
 					ABORT(fp->fs, FR_DISK_ERR);
 #if _FS_MINIMIZE <= 2
@@ -3449,6 +3486,134 @@ FRESULT f_truncate (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Allocate a Contiguous Cluster Chain to an Empty File                  */
+/*-----------------------------------------------------------------------*/
+/* Backported from FatFs R0.12 f_expand(), but the file size is not     */
+/* changed, so writes follow the preallocated chain without touching the */
+/* FAT. Call f_trim() before closing to release the unused clusters      */
+
+FRESULT f_expand (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD fsz		/* Number of bytes to allocate */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD n, clst, stcl, scl, ncl, tcl;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res == FR_OK && fp->err) res = (FRESULT)fp->err;
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fsz == 0 || fp->sclust != 0 || !(fp->flag & FA_WRITE))
+		LEAVE_FF(fp->fs, FR_DENIED);
+
+	fs = fp->fs;
+	n = (DWORD)fs->csize * SS(fs);			/* Cluster size */
+	tcl = fsz / n + ((fsz % n) ? 1 : 0);	/* Number of clusters required */
+	stcl = fs->last_clust;					/* Start search from the last allocation */
+	if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
+	scl = clst = stcl; ncl = 0;
+	for (;;) {								/* Find a contiguous run of free clusters */
+		n = get_fat(fs, clst);
+		if (n == 1) { res = FR_INT_ERR; break; }
+		if (n == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+		if (n == 0) {						/* Free cluster, extend the run */
+			if (++ncl == tcl) break;
+		} else {
+			ncl = 0;
+		}
+		if (++clst >= fs->n_fatent) {		/* Wrap around, a run can't span it */
+			clst = 2; ncl = 0;
+		}
+		if (ncl == 0) scl = clst;
+		if (clst == stcl) { res = FR_DENIED; break; }	/* No contiguous run */
+	}
+	if (res == FR_OK) {						/* Create the cluster chain */
+		for (clst = scl, n = tcl; n; clst++, n--) {
+			res = put_fat(fs, clst, (n == 1) ? 0x0FFFFFFF : clst + 1);
+			if (res != FR_OK) break;
+		}
+	}
+	if (res == FR_OK) {
+		fs->last_clust = scl + tcl - 1;		/* Update FSINFO */
+		if (fs->free_clust != 0xFFFFFFFF) {
+			fs->free_clust -= tcl;
+			fs->fsi_flag |= 1;
+		}
+		fp->sclust = scl;					/* Store the chain in the directory entry on sync */
+		fp->flag |= FA__WRITTEN;
+	} else if (res != FR_DENIED) {
+		fp->err = (FRESULT)res;
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Release the Clusters Allocated Past the End of File                   */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_trim (
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	FRESULT res;
+	DWORD n, clst, ncl;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res == FR_OK) {
+		if (fp->err) {						/* Check error */
+			res = (FRESULT)fp->err;
+		} else {
+			if (!(fp->flag & FA_WRITE))		/* Check access mode */
+				res = FR_DENIED;
+		}
+	}
+	if (res == FR_OK && fp->sclust) {
+		if (fp->fsize == 0) {				/* Nothing written, remove entire cluster chain */
+			res = remove_chain(fp->fs, fp->sclust);
+			fp->sclust = 0;
+			fp->flag |= FA__WRITTEN;
+		} else {
+#if _USE_FASTSEEK
+			if (fp->cltbl) {
+				clst = clmt_clust(fp, fp->fsize - 1);	/* Last cluster in use from the CLMT */
+				if (clst < 2) res = FR_INT_ERR;
+			} else
+#endif
+			{
+				n = (fp->fsize - 1) / ((DWORD)fp->fs->csize * SS(fp->fs));
+				for (clst = fp->sclust; n; n--) {	/* Follow the chain to the last cluster in use */
+					clst = get_fat(fp->fs, clst);
+					if (clst == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+					if (clst < 2 || clst >= fp->fs->n_fatent) { res = FR_INT_ERR; break; }
+				}
+			}
+			if (res == FR_OK) {
+				ncl = get_fat(fp->fs, clst);
+				if (ncl == 0xFFFFFFFF) res = FR_DISK_ERR;
+				if (ncl == 1) res = FR_INT_ERR;
+				if (res == FR_OK && ncl < fp->fs->n_fatent) {	/* Clusters past the end? */
+					res = put_fat(fp->fs, clst, 0x0FFFFFFF);
+					if (res == FR_OK) res = remove_chain(fp->fs, ncl);
+				}
+			}
+		}
+		if (res != FR_OK) fp->err = (FRESULT)res;
+	}
+
+	LEAVE_FF(fp->fs, res);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
 /*-----------------------------------------------------------------------*/
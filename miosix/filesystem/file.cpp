@@ -77,6 +77,16 @@ int FileBase::ioctl(int cmd, void *arg)
     return -ENOTTY; //Means the operation does not apply to this descriptor
 }
 
+ssize_t FileBase::pread(void *data, size_t len, off_t offset)
+{
+    return -ESPIPE;
+}
+
+ssize_t FileBase::pwrite(const void *data, size_t len, off_t offset)
+{
+    return -ESPIPE;
+}
+
 int FileBase::getdents(void *dp, int len)
 {
     return -EBADF;
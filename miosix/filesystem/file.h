@@ -162,6 +162,30 @@ public:
      * \return the exact return value depends on CMD, -1 is returned on error
      */
     virtual int ioctl(int cmd, void *arg);
+
+    /**
+     * Read data from the file at the given offset, without using nor changing
+     * the file position, so concurrent callers need no locking. Only some
+     * files, such as block devices, support this
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param offset where to read from
+     * \return the number of read characters, or a negative number in case
+     * of errors. -ESPIPE if the file does not support this operation
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t offset);
+
+    /**
+     * Write data to the file at the given offset, without using nor changing
+     * the file position, so concurrent callers need no locking. Only some
+     * files, such as block devices, support this
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param offset where to write to
+     * \return the number of written characters, or a negative number in case
+     * of errors. -ESPIPE if the file does not support this operation
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t offset);
     
     /**
      * Also directories can be opened as files. In this case, this system call
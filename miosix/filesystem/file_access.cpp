@@ -34,6 +34,7 @@
 #include "filesystem/romfs/romfs.h"
 #include "fat32/fat32.h"
 #include "littlefs/lfs_miosix.h"
+#include "blockcache/block_cache.h"
 #include "pipe/pipe.h"
 #include "kernel/logging.h"
 #ifdef WITH_PROCESSES
@@ -884,6 +885,9 @@ basicFilesystemSetup(intrusive_ref_ptr<Device> dev)
 
     if(dev)
     {
+        #ifdef WITH_BLOCK_CACHE
+        dev=intrusive_ref_ptr<Device>(new BlockCache(dev));
+        #endif //WITH_BLOCK_CACHE
         #ifdef WITH_DEVFS
         #define TRY_MOUNT(x) if (tryMount<x>(#x, dev, rootFs, devfs)) return devfs
         #else
@@ -36,7 +36,37 @@ enum Ioctl
     IOCTL_TCSETATTR_NOW=102,
     IOCTL_TCSETATTR_FLUSH=103,
     IOCTL_TCSETATTR_DRAIN=104,
-    IOCTL_FLUSH=105
+    IOCTL_FLUSH=105,
+    IOCTL_BLOCK_CACHE_STATS=106, ///< Arg is a BlockCacheStats*
+    IOCTL_FASTSEEK=107, ///< Build the fast seek table of a file immediately
+    IOCTL_PREALLOCATE=108, ///< Arg is an off_t*, reserve contiguous space
+    IOCTL_FILE_LAYOUT=109  ///< Arg is a FileLayout*
+};
+
+/**
+ * Statistics returned by the IOCTL_BLOCK_CACHE_STATS ioctl on block devices
+ * wrapped in a BlockCache
+ */
+struct BlockCacheStats
+{
+    unsigned int hits;       ///< Sectors found in the cache
+    unsigned int misses;     ///< Sectors read from the device
+    unsigned int readAheads; ///< Sectors read in advance of being requested
+    unsigned int writeBacks; ///< Sectors written back to the device
+    unsigned int deviceReads;  ///< Number of read accesses to the device
+    unsigned int deviceWrites; ///< Number of write accesses to the device
+};
+
+
+/**
+ * Storage allocated to a file, returned by the IOCTL_FILE_LAYOUT ioctl
+ */
+struct FileLayout
+{
+    unsigned int clusterSize;  ///< Allocation unit in bytes
+    unsigned int clusters;     ///< Clusters allocated to the file
+    unsigned int fragments;    ///< Runs of contiguous clusters in the chain
+    unsigned int freeClusters; ///< Free clusters in the filesystem
 };
 
 }
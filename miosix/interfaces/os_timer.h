@@ -29,6 +29,7 @@
 
 #include "config/miosix_settings.h"
 #include "kernel/timeconversion.h"
+#include "kernel/time_page.h"
 #include "kernel/scheduler/timer_interrupt.h"
 
 /**
@@ -157,6 +158,10 @@ unsigned int osTimerGetFrequency();
  *     static void IRQinit() {}
  * };
  * \endcode
+ *
+ * If processes can be allowed to read the timer counter and overflow flag, the
+ * derived class can also hide IRQgetUserspaceRegisters() to let processes read
+ * the time without a syscall.
  * 
  * \tparam D the derived class (see curiously recurring template pattern)
  * \tparam bits the bits of the underlying hardware timer, up to 32 bit.
@@ -257,6 +262,9 @@ public:
         if(tick>oldTick)
         {
             upperTimeTick = tick & upperMask;
+            #ifdef WITH_PROCESSES
+            IRQupdateTimePage(upperTimeTick);
+            #endif //WITH_PROCESSES
             D::IRQsetTimerCounter(static_cast<unsigned int>(tick & lowerMask));
             D::IRQclearOverflowFlag();
             //Adjust also when the next interrupt will be fired
@@ -335,6 +343,9 @@ public:
         {
             D::IRQclearOverflowFlag();
             upperTimeTick += upperIncr;
+            #ifdef WITH_PROCESSES
+            IRQupdateTimePage(upperTimeTick);
+            #endif //WITH_PROCESSES
         }
     }
     
@@ -345,9 +356,37 @@ public:
     {
         D::IRQinitTimer();
         tc=TimeConversion(D::IRQTimerFrequency());
+        #ifdef WITH_PROCESSES
+        const volatile unsigned int *counter, *status;
+        unsigned int overflowMask;
+        if(D::IRQgetUserspaceRegisters(counter,status,overflowMask))
+            IRQinitTimePage(counter,status,overflowMask,
+                            static_cast<unsigned int>(lowerMask),
+                            tc.getTick2nsConversion());
+        #endif //WITH_PROCESSES
         D::IRQstartTimer();
     }
 
+    #ifdef WITH_PROCESSES
+    /**
+     * Derived classes hide this function if processes can read the time
+     * directly from the timer registers. The registers are mapped read-only
+     * in all processes, so they must be in a memory area where reads have no
+     * side effects.
+     * \param counter the address of the counter register is stored here
+     * \param status the address of the register containing the overflow flag
+     * is stored here
+     * \param overflowMask the overflow flag bit is stored here
+     * \return true if processes can read the timer, the default implementation
+     * returns false so processes read the time with a syscall
+     */
+    static bool IRQgetUserspaceRegisters(const volatile unsigned int *& counter,
+            const volatile unsigned int *& status, unsigned int& overflowMask)
+    {
+        return false;
+    }
+    #endif //WITH_PROCESSES
+
     //From here, member functions only useful for specific type of drivers
 
     /**
@@ -359,6 +398,9 @@ public:
     void IRQquirkIncrementUpperCounter()
     {
         upperTimeTick += upperIncr;
+        #ifdef WITH_PROCESSES
+        IRQupdateTimePage(upperTimeTick);
+        #endif //WITH_PROCESSES
     }
 
     /**
@@ -29,6 +29,9 @@
 
 #include "kernel.h"
 #include "cpu_time_counter_types.h"
+#ifdef SCHED_TYPE_EDF
+#include "kernel/scheduler/edf/edf_scheduler.h"
+#endif //SCHED_TYPE_EDF
 
 #ifdef WITH_CPU_TIME_COUNTER
 
@@ -86,6 +89,10 @@ public:
         Thread *thread;
         /// Cumulative amount of CPU time scheduled to the thread in ns
         long long usedCpuTime = 0; 
+        #ifdef SCHED_TYPE_EDF
+        /// Number of jobs that the thread completed after their deadline
+        unsigned int deadlineMisses = 0;
+        #endif // SCHED_TYPE_EDF
     };
 
     /**
@@ -110,6 +117,9 @@ public:
             Data res;
             res.thread = cur;
             res.usedCpuTime = cur->timeCounterData.usedCpuTime;
+            #ifdef SCHED_TYPE_EDF
+            res.deadlineMisses = EDFScheduler::getDeadlineMisses(cur);
+            #endif // SCHED_TYPE_EDF
             return res;
         }
         inline bool operator==(const iterator& rhs) { return cur==rhs.cur; }
@@ -47,67 +47,10 @@ namespace miosix {
 ///By convention, in an elf file for Miosix, the data segment starts @ this addr
 static const unsigned int DATA_BASE=0x40000000;
 
-/**
- * Cache of programs loaded in RAM, to allow sharing memory for the code part
- * of loaded programs
- */
-class ProgramCache
-{
-public:
-    /**
-     * Load a program
-     * \param name file name
-     * \param elf, if the load was successful, the pointer to the memory region
-     * where the program is loaded is stored here
-     * \param size, if the loa was successful, the memory region size in bytes
-     * (despite the pointer is to unsigned in) is stored here
-     * \param needUnload if true, the requested program is in a non-XIP capable
-     * filesystem, so it was needed to load it in RAM and a call to unload is
-     * required to unload the program when no longer needed. If false, the
-     * requested program is in a XIP capable filesystem, so the pointer returned
-     * is to a memory area that does not need unloading, and calling unload is
-     * not required.
-     * \return 0 on success, an error code on error
-     */
-    static int load(const char *name, const unsigned int *& elf,
-             unsigned int& size, bool& needUnload);
-
-    /**
-     * Unload a program that was loaded in RAM
-     * \param elf pointer to the program to unload
-     */
-    static void unload(const unsigned int *elf);
-
-private:
-    /**
-     * An entry into the cache of programs loaded in RAM
-     */
-    class Entry
-    {
-    public:
-        /**
-         * Constructor
-         * \param inode inode of file on disk, used as key
-         * \param device filesystem id, used as key
-         * \param elf pointer to the program RAM allocated memory region
-         * \param size memory region size
-         */
-        Entry(ino_t inode, dev_t device, unsigned int *elf, unsigned int size)
-            : inode(inode), device(device), elf(elf), size(size), useCount(1) {}
-        ino_t inode;
-        dev_t device;
-        unsigned int *elf;
-        unsigned int size;
-        int useCount; ///< Used for reference counting the cache entry
-    };
-
-    static FastMutex m; ///< Protect programs against concurrent accesses
-    static list<Entry> programs; ///< Cache entries
-};
-
 //
 // class ProgramCache
 //
+
 int ProgramCache::load(const char *name, const unsigned int *& elf,
                        unsigned int& size, bool& needUnload)
 {
@@ -130,31 +73,40 @@ int ProgramCache::load(const char *name, const unsigned int *& elf,
         return 0;
     }
     //Search program in cache
-    //NOTE: if the program is modified on disk in a way that the inode does not
-    //change and at least one instance of the program is running, subsequent
-    //attempts to run the same program will hit the cache and return the old
-    //version, i.e. the one that was overwritten on disk. We would need some
-    //kind of inotify framework to invalidate the cache...
+    //NOTE: the modification time and size of the file are used to detect if
+    //the program was modified on disk. Processes already running the old
+    //version keep using it, while new ones will load the new version
     struct stat s;
     if(file->fstat(&s)) return -EFAULT;
     Lock<FastMutex> l(m);
-    //I know, lookup is O(n), but we need to index the cache by <inode,dev>
-    //when loading, and index it by pointer when unloading, while also caring
-    //about code size. On top of that, we don't expect many loaded programs
-    //and spawning a process is already a heavy operation so this won't be
-    //the bottleneck anyway
-    for(auto& p : programs)
+    FileKey key={s.st_ino,s.st_dev};
+    auto found=byFile.find(key);
+    if(found!=byFile.end())
     {
-        if(p.inode!=s.st_ino || p.device!=s.st_dev) continue;
-        //Found, increment use count and return
-        p.useCount++;
-        elf=p.elf;
-        size=p.size;
-        needUnload=true;
-        DBG("ProgramCache::load(%s): found %p in cache use count %d\n",
-            name,elf,p.useCount);
-        return 0;
+        auto it=found->second;
+        if(it->mtime==s.st_mtime && it->fileSize==s.st_size)
+        {
+            //Found, increment use count and return
+            if(it->useCount++==0)
+            {
+                retainedBytes-=it->size;
+                used.splice(used.begin(),retained,it);
+            }
+            hits++;
+            elf=it->elf;
+            size=it->size;
+            needUnload=true;
+            DBG("ProgramCache::load(%s): found %p in cache use count %d\n",
+                name,elf,it->useCount);
+            return 0;
+        }
+        //Stale, if in use it will be deallocated by the last unload
+        DBG("ProgramCache::load(%s): %p is stale\n",name,it->elf);
+        byFile.erase(found);
+        it->indexed=false;
+        if(it->useCount==0) evict(it);
     }
+    misses++;
     //Not found, load program in cache
     //Seek to the end to get file size, then seek back to the start
     off_t fileSize=file->lseek(0,SEEK_END);
@@ -165,7 +117,7 @@ int ProgramCache::load(const char *name, const unsigned int *& elf,
     //Allocate a RAM block in the process pool
     unsigned int *ramPointer;
     unsigned int ramSize;
-    tie(ramPointer,ramSize)=ProcessPool::instance().allocate(fileSize);
+    tie(ramPointer,ramSize)=allocateUnlocked(fileSize);
     //Protect agains exceptions being thrown from here on
     auto finalize=[](unsigned int *p){ ProcessPool::instance().deallocate(p); };
     unique_ptr<unsigned int,decltype(finalize)> finalizer(ramPointer,finalize);
@@ -175,7 +127,9 @@ int ProgramCache::load(const char *name, const unsigned int *& elf,
     //Zero the eventual slack size
     memset(reinterpret_cast<unsigned char*>(ramPointer)+fileSize,0,ramSize-fileSize);
     //Success
-    programs.push_front(Entry(s.st_ino,s.st_dev,ramPointer,ramSize));
+    used.push_front(Entry(key,s.st_mtime,fileSize,ramPointer,ramSize));
+    byElf[ramPointer]=used.begin();
+    byFile[key]=used.begin();
     elf=ramPointer;
     size=ramSize;
     needUnload=true;
@@ -187,23 +141,110 @@ int ProgramCache::load(const char *name, const unsigned int *& elf,
 void ProgramCache::unload(const unsigned int *elf)
 {
     Lock<FastMutex> l(m);
-    for(auto it=begin(programs);it!=end(programs);++it)
+    auto found=byElf.find(elf);
+    if(found==byElf.end())
     {
-        if(it->elf!=elf) continue;
-        DBG("ProgramCache::unload(%p): use count %d\n",elf,it->useCount);
-        if(--it->useCount<=0)
-        {
-            DBG("ProgramCache::unload(%p): deallocate\n",elf);
-            ProcessPool::instance().deallocate(it->elf);
-            programs.erase(it);
-        }
+        DBG("ProgramCache::unload(%p): bug: not in cache\n",elf);
         return;
     }
-    DBG("ProgramCache::unload(%p): bug: not in cache\n",elf);
+    auto it=found->second;
+    DBG("ProgramCache::unload(%p): use count %d\n",elf,it->useCount);
+    if(--it->useCount>0) return;
+    if(it->indexed && it->size<=PROGRAM_CACHE_RETAIN_BYTES)
+    {
+        DBG("ProgramCache::unload(%p): retain\n",elf);
+        retained.splice(retained.begin(),used,it);
+        retainedBytes+=it->size;
+        while(retainedBytes>PROGRAM_CACHE_RETAIN_BYTES)
+            evict(prev(retained.end()));
+    } else {
+        DBG("ProgramCache::unload(%p): deallocate\n",elf);
+        if(it->indexed) byFile.erase(it->key);
+        byElf.erase(found);
+        ProcessPool::instance().deallocate(it->elf);
+        used.erase(it);
+    }
+}
+
+pair<unsigned int*, unsigned int> ProgramCache::allocate(unsigned int size)
+{
+    Lock<FastMutex> l(m);
+    return allocateUnlocked(size);
+}
+
+intrusive_ref_ptr<DataSegmentTemplate> ProgramCache::getDataTemplate(
+        const ElfProgram& program)
+{
+    //Only programs in the cache keep a template, others are relocated
+    //directly into the process image
+    if(program.isCopiedInRam()==false)
+        return intrusive_ref_ptr<DataSegmentTemplate>();
+    auto elf=reinterpret_cast<const unsigned int*>(program.getElfBase());
+    Lock<FastMutex> l(m);
+    auto found=byElf.find(elf);
+    if(found==byElf.end())
+    {
+        DBG("ProgramCache::getDataTemplate(%p): bug: not in cache\n",elf);
+        return intrusive_ref_ptr<DataSegmentTemplate>();
+    }
+    auto& t=found->second->dataTemplate;
+    if(!t)
+    {
+        DBG("ProgramCache::getDataTemplate(%p): created\n",elf);
+        t=intrusive_ref_ptr<DataSegmentTemplate>(
+            new DataSegmentTemplate(program));
+    }
+    return t;
+}
+
+ProgramCache::Stats ProgramCache::getStats()
+{
+    Lock<FastMutex> l(m);
+    Stats result;
+    result.hits=hits;
+    result.misses=misses;
+    result.evictions=evictions;
+    result.retainedBytes=retainedBytes;
+    return result;
+}
+
+pair<unsigned int*, unsigned int> ProgramCache::allocateUnlocked(
+        unsigned int size)
+{
+    for(;;)
+    {
+        try {
+            return ProcessPool::instance().allocate(size);
+        } catch(bad_alloc&) {
+            //Retained programs are the first to go when memory is needed
+            if(retained.empty()) throw;
+            evict(prev(retained.end()));
+        }
+    }
+}
+
+void ProgramCache::evict(list<Entry>::iterator it)
+{
+    DBG("ProgramCache::evict(%p)\n",it->elf);
+    if(it->indexed) byFile.erase(it->key);
+    byElf.erase(it->elf);
+    ProcessPool::instance().deallocate(it->elf);
+    retainedBytes-=it->size;
+    evictions++;
+    retained.erase(it);
 }
 
 FastMutex ProgramCache::m;
-list<ProgramCache::Entry> ProgramCache::programs;
+list<ProgramCache::Entry> ProgramCache::used;
+list<ProgramCache::Entry> ProgramCache::retained;
+unordered_map<ProgramCache::FileKey,list<ProgramCache::Entry>::iterator,
+    ProgramCache::FileKeyHash> ProgramCache::byFile;
+unordered_map<const unsigned int*,list<ProgramCache::Entry>::iterator>
+    ProgramCache::byElf;
+unsigned int ProgramCache::retainedBytes=0;
+unsigned int ProgramCache::hits=0;
+unsigned int ProgramCache::misses=0;
+unsigned int ProgramCache::evictions=0;
 
 //
 // class ElfProgram
@@ -493,16 +534,28 @@ ElfProgram::~ElfProgram()
     if(copiedInRam) ProgramCache::unload(elf);
 }
 
-//
-// class ProcessImage
-//
+/**
+ * The parts of an elf program needed to create the image of a process
+ */
+struct DataSegmentInfo
+{
+    const Elf32_Phdr *dataSegment; ///< Data segment program header
+    const Elf32_Rel *rel;       ///< Relocations, or nullptr if none
+    int relSize;                ///< Number of relocations
+    unsigned int ramSize;       ///< Size of the process image
+    unsigned int mainStackSize; ///< Size of the main stack
+};
 
-void ProcessImage::load(const ElfProgram& program)
+/**
+ * Parse the program headers and the dynamic segment of a program
+ * \param program a valid elf program
+ * \return the data segment and its relocations
+ */
+static DataSegmentInfo parseDataSegment(const ElfProgram& program)
 {
-    if(image) ProcessPool::instance().deallocate(image);
     const unsigned int base=program.getElfBase();
     const Elf32_Phdr *phdr=program.getProgramHeaderTable();
-    const Elf32_Phdr *dataSegment=nullptr;
+    DataSegmentInfo info={nullptr,nullptr,0,0,0};
     Elf32_Addr dtRel=0;
     Elf32_Word dtRelsz=0;
     bool hasRelocs=false;
@@ -512,7 +565,7 @@ void ProcessImage::load(const ElfProgram& program)
         {
             case PT_LOAD:
                 if((phdr->p_flags & PF_W) && !(phdr->p_flags & PF_X))
-                    dataSegment=phdr;
+                    info.dataSegment=phdr;
                 break;
             case PT_DYNAMIC:
             {
@@ -532,10 +585,10 @@ void ProcessImage::load(const ElfProgram& program)
                             dtRelsz=dyn->d_un.d_val;
                             break;
                         case DT_MX_RAMSIZE:
-                            tie(image,size)=ProcessPool::instance()
-                                    .allocate(dyn->d_un.d_val);
+                            info.ramSize=dyn->d_un.d_val;
+                            break;
                         case DT_MX_STACKSIZE:
-                            mainStackSize=dyn->d_un.d_val;
+                            info.mainStackSize=dyn->d_un.d_val;
                             break;
                         default:
                             break;
@@ -548,11 +601,81 @@ void ProcessImage::load(const ElfProgram& program)
                 break;
         }
     }
-    const char *dataSegmentInFile=
-        reinterpret_cast<const char*>(base+dataSegment->p_offset);
-    char *dataSegmentInMem=reinterpret_cast<char*>(image);
-    memcpy(dataSegmentInMem,dataSegmentInFile,dataSegment->p_filesz);
-    dataSegmentInMem+=dataSegment->p_filesz;
+    if(hasRelocs)
+    {
+        info.rel=reinterpret_cast<const Elf32_Rel*>(base+dtRel);
+        info.relSize=dtRelsz/sizeof(Elf32_Rel);
+    }
+    return info;
+}
+
+//
+// class DataSegmentTemplate
+//
+
+DataSegmentTemplate::DataSegmentTemplate(const ElfProgram& program)
+{
+    const unsigned int base=program.getElfBase();
+    DataSegmentInfo info=parseDataSegment(program);
+    ramSize=info.ramSize;
+    mainStackSize=info.mainStackSize;
+    dataSize=info.dataSegment->p_filesz;
+    dataBssSize=info.dataSegment->p_memsz;
+    data.resize((dataSize+3)/4);
+    memcpy(data.data(),
+           reinterpret_cast<const char*>(base+info.dataSegment->p_offset),
+           dataSize);
+    const Elf32_Rel *rel=info.rel;
+    //DBG("Relocations -- start (code base @0x%x)\n",base);
+    for(int i=0;i<info.relSize;i++,rel++)
+    {
+        unsigned int offset=(rel->r_offset-DATA_BASE)/4;
+        switch(ELF32_R_TYPE(rel->r_info))
+        {
+            case R_ARM_RELATIVE:
+                //Relocations in .bss apply to zero-initialized words
+                if(offset>=data.size())
+                {
+                    data.resize(offset+1,0);
+                    dataSize=data.size()*4;
+                }
+                if(data[offset]>=DATA_BASE)
+                {
+                    //DBG("R_ARM_RELATIVE offset 0x%x rebased\n",offset*4);
+                    rebase.push_back(offset);
+                } else {
+                    //DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
+                    //    offset*4,data[offset],data[offset]+base);
+                    data[offset]+=base;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    //DBG("Relocations -- end\n");
+    rebase.shrink_to_fit();
+}
+
+//
+// class ProcessImage
+//
+
+void ProcessImage::load(const ElfProgram& program)
+{
+    if(image) ProcessPool::instance().deallocate(image);
+    image=nullptr;
+    auto t=ProgramCache::getDataTemplate(program);
+    if(t) loadFromTemplate(*t);
+    else loadFromElf(program);
+}
+
+void ProcessImage::loadFromTemplate(const DataSegmentTemplate& t)
+{
+    tie(image,size)=ProgramCache::allocate(t.ramSize);
+    mainStackSize=t.mainStackSize;
+    dataBssSize=t.dataBssSize;
+    memcpy(image,t.data.data(),t.dataSize);
     //Zero only .bss section (faster but processes leak data to other processes)
     //memset(dataSegmentInMem,0,dataSegment->p_memsz-dataSegment->p_filesz);
     //Zero the entire process image to prevent data leakage, exclude .data as
@@ -560,37 +683,64 @@ void ProcessImage::load(const ElfProgram& program)
     //NOTE: as the args block size isn't known here, we can't account for that.
     //This is not an issue though, we may just unnecessary fill with zeros up to
     //MAX_PROCESS_ARGS_BLOCK_SIZE bytes into the stack
-    memset(dataSegmentInMem,0,size-dataSegment->p_filesz-mainStackSize-WATERMARK_LEN);
-    dataBssSize=dataSegment->p_memsz;
-    if(hasRelocs)
+    memset(reinterpret_cast<char*>(image)+t.dataSize,0,
+           size-t.dataSize-mainStackSize-WATERMARK_LEN);
+    //Relocations to code were applied when creating the template, only
+    //pointers to .data/.bss depend on where the process image is
+    const unsigned int ramBase=reinterpret_cast<unsigned int>(image);
+    for(unsigned int offset : t.rebase) image[offset]+=ramBase-DATA_BASE;
+}
+
+void ProcessImage::loadFromElf(const ElfProgram& program)
+{
+    const unsigned int base=program.getElfBase();
+    DataSegmentInfo info=parseDataSegment(program);
+    tie(image,size)=ProgramCache::allocate(info.ramSize);
+    mainStackSize=info.mainStackSize;
+    dataBssSize=info.dataSegment->p_memsz;
+    const unsigned int dataSize=info.dataSegment->p_filesz;
+    memcpy(image,reinterpret_cast<const char*>(base+info.dataSegment->p_offset),
+           dataSize);
+    //Zero the entire process image to prevent data leakage, see above
+    memset(reinterpret_cast<char*>(image)+dataSize,0,
+           size-dataSize-mainStackSize-WATERMARK_LEN);
+    const Elf32_Rel *rel=info.rel;
+    const unsigned int ramBase=reinterpret_cast<unsigned int>(image);
+    //DBG("Relocations -- start (code base @0x%x, data base @ 0x%x)\n",base,ramBase);
+    for(int i=0;i<info.relSize;i++,rel++)
     {
-        const Elf32_Rel *rel=reinterpret_cast<const Elf32_Rel*>(base+dtRel);
-        const int relSize=dtRelsz/sizeof(Elf32_Rel);
-        const unsigned int ramBase=reinterpret_cast<unsigned int>(image);
-        //DBG("Relocations -- start (code base @0x%x, data base @ 0x%x)\n",base,ramBase);
-        for(int i=0;i<relSize;i++,rel++)
+        unsigned int offset=(rel->r_offset-DATA_BASE)/4;
+        switch(ELF32_R_TYPE(rel->r_info))
         {
-            unsigned int offset=(rel->r_offset-DATA_BASE)/4;
-            switch(ELF32_R_TYPE(rel->r_info))
-            {
-                case R_ARM_RELATIVE:
-                    if(image[offset]>=DATA_BASE)
-                    {
-                        //DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
-                        //    offset*4,image[offset],image[offset]+ramBase-DATA_BASE);
-                        image[offset]+=ramBase-DATA_BASE;
-                    } else {
-                        //DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
-                        //    offset*4,image[offset],image[offset]+base);
-                        image[offset]+=base;
-                    }
-                    break;
-                default:
-                    break;
-            }
+            case R_ARM_RELATIVE:
+                if(image[offset]>=DATA_BASE)
+                {
+                    //DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
+                    //    offset*4,image[offset],image[offset]+ramBase-DATA_BASE);
+                    image[offset]+=ramBase-DATA_BASE;
+                } else {
+                    //DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
+                    //    offset*4,image[offset],image[offset]+base);
+                    image[offset]+=base;
+                }
+                break;
+            default:
+                break;
         }
-        //DBG("Relocations -- end\n");
     }
+    //DBG("Relocations -- end\n");
+}
+
+bool ProcessImage::extend(unsigned int newSize)
+{
+    if(image==nullptr || newSize>MAX_PROCESS_IMAGE_SIZE) return false;
+    if(newSize<=size) return true;
+    unsigned int result=ProcessPool::instance().extend(image,newSize);
+    if(result==0) return false;
+    //Prevent data leakage from the previous user of the memory
+    memset(reinterpret_cast<char*>(image)+size,0,result-size);
+    size=result;
+    return true;
 }
 
 ProcessImage::~ProcessImage()
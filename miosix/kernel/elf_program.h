@@ -29,8 +29,14 @@
 
 #include <utility>
 #include <cerrno>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <sys/types.h>
 #include "elf_types.h"
 #include "config/miosix_settings.h"
+#include "sync.h"
+#include "intrusive.h"
 
 #ifdef WITH_PROCESSES
 
@@ -192,6 +198,8 @@ private:
     bool copiedInRam;   ///< If true, elf is allocated in RAM and *this owns it
 };
 
+class DataSegmentTemplate;
+
 /**
  * This class represent the RAM image of a process.
  */
@@ -211,10 +219,23 @@ public:
     /**
      * Starting from the content of the elf program, create an image in RAM of
      * the process, including copying .data, zeroing .bss and performing
-     * relocations
+     * relocations. For programs in the program cache the data segment is
+     * copied from the program's DataSegmentTemplate, which is created the
+     * first time a program is spawned
      */
     void load(const ElfProgram& program);
     
+    /**
+     * Grow the process image in place, merging it with the free memory that
+     * follows it in the process pool. The memory added is at the end of the
+     * image, after the main stack and arguments, and is zeroed.
+     * \param newSize requested size in bytes, can't exceed
+     * MAX_PROCESS_IMAGE_SIZE
+     * \return true on success, in which case the image size is at least
+     * newSize
+     */
+    bool extend(unsigned int newSize);
+
     /**
      * \return a pointer to the base of the program image
      */
@@ -244,6 +265,18 @@ public:
     ProcessImage(const ProcessImage&) = delete;
     ProcessImage& operator= (const ProcessImage&) = delete;
 private:
+    /**
+     * Load the process image copying it from a data segment template
+     * \param t data segment template of the program
+     */
+    void loadFromTemplate(const DataSegmentTemplate& t);
+
+    /**
+     * Load the process image copying .data from the elf program and
+     * performing all relocations
+     * \param program elf program
+     */
+    void loadFromElf(const ElfProgram& program);
     
     unsigned int *image;        ///< Pointer to the process image in RAM
     unsigned int size;          ///< Size in bytes of the process image
@@ -251,6 +284,181 @@ private:
     unsigned int dataBssSize;   ///< Combined size of .data and .bss
 };
 
+/**
+ * Image of the data segment of a program with the relocations already
+ * applied, except those that depend on where the process image is allocated.
+ * Spawning a process then only requires copying the image and adding the
+ * process base to the pointers listed in rebase.
+ */
+class DataSegmentTemplate : public IntrusiveRefCounted<DataSegmentTemplate>
+{
+public:
+    /**
+     * Constructor, parses the elf dynamic section and applies relocations
+     * \param program elf program, must stay at the same address for the whole
+     * lifetime of the template, as relocations to code are already applied
+     */
+    explicit DataSegmentTemplate(const ElfProgram& program);
+
+    std::vector<unsigned int> data;   ///< Initial content of .data
+    std::vector<unsigned int> rebase; ///< Offsets in words of data pointers
+    unsigned int dataSize;      ///< Bytes of data to copy
+    unsigned int ramSize;       ///< Size of the process image
+    unsigned int mainStackSize; ///< Size of the main stack
+    unsigned int dataBssSize;   ///< Combined size of .data and .bss
+};
+
+/**
+ * Cache of programs loaded in RAM, to allow sharing memory for the code part
+ * of loaded programs.
+ * Programs are indexed both by file and by the pointer to their copy in RAM.
+ * If PROGRAM_CACHE_RETAIN_BYTES is not zero, programs are kept in RAM after
+ * their last process has terminated, to speed up spawning them again, and are
+ * evicted in least recently used order when the budget is exceeded or when
+ * the process pool runs out of memory.
+ */
+class ProgramCache
+{
+public:
+    /**
+     * Struct used to return the program cache statistics
+     */
+    struct Stats
+    {
+        unsigned int hits;          ///< Programs found in the cache
+        unsigned int misses;        ///< Programs loaded from disk
+        unsigned int evictions;     ///< Retained programs deallocated
+        unsigned int retainedBytes; ///< Bytes used by retained programs
+    };
+
+    /**
+     * Load a program
+     * \param name file name
+     * \param elf, if the load was successful, the pointer to the memory region
+     * where the program is loaded is stored here
+     * \param size, if the loa was successful, the memory region size in bytes
+     * (despite the pointer is to unsigned in) is stored here
+     * \param needUnload if true, the requested program is in a non-XIP capable
+     * filesystem, so it was needed to load it in RAM and a call to unload is
+     * required to unload the program when no longer needed. If false, the
+     * requested program is in a XIP capable filesystem, so the pointer returned
+     * is to a memory area that does not need unloading, and calling unload is
+     * not required.
+     * \return 0 on success, an error code on error
+     */
+    static int load(const char *name, const unsigned int *& elf,
+             unsigned int& size, bool& needUnload);
+
+    /**
+     * Unload a program that was loaded in RAM
+     * \param elf pointer to the program to unload
+     */
+    static void unload(const unsigned int *elf);
+
+    /**
+     * Allocate memory in the process pool, evicting retained programs if
+     * there is not enough free memory.
+     * \param size size of the requested memory
+     * \return the same as ProcessPool::allocate()
+     * \throws bad_alloc if out of memory
+     */
+    static std::pair<unsigned int *, unsigned int> allocate(unsigned int size);
+
+    /**
+     * Get the data segment template of a program in the cache, creating it if
+     * this is the first time the program is spawned. The template is
+     * deallocated together with the program.
+     * \param program a valid elf program
+     * \return the data segment template, or nullptr if the program is not in
+     * the cache, such as programs in a XIP filesystem or passed as a pointer,
+     * in which case the process image should be relocated directly
+     */
+    static intrusive_ref_ptr<DataSegmentTemplate> getDataTemplate(
+            const ElfProgram& program);
+
+    /**
+     * \return the program cache statistics
+     */
+    static Stats getStats();
+
+private:
+    /**
+     * Identifies a file
+     */
+    struct FileKey
+    {
+        ino_t inode;
+        dev_t device;
+
+        bool operator==(const FileKey& other) const
+        {
+            return inode==other.inode && device==other.device;
+        }
+    };
+
+    struct FileKeyHash
+    {
+        size_t operator()(const FileKey& k) const
+        {
+            return static_cast<size_t>(k.inode)*31+static_cast<size_t>(k.device);
+        }
+    };
+
+    /**
+     * An entry into the cache of programs loaded in RAM
+     */
+    class Entry
+    {
+    public:
+        /**
+         * Constructor
+         * \param key file on disk, used as key
+         * \param mtime file modification time, used to detect changes
+         * \param fileSize file size, used to detect changes
+         * \param elf pointer to the program RAM allocated memory region
+         * \param size memory region size
+         */
+        Entry(FileKey key, time_t mtime, off_t fileSize, unsigned int *elf,
+              unsigned int size) : key(key), mtime(mtime), fileSize(fileSize),
+              elf(elf), size(size), useCount(1), indexed(true) {}
+        FileKey key;
+        time_t mtime;
+        off_t fileSize;
+        unsigned int *elf;
+        unsigned int size;
+        int useCount; ///< Used for reference counting the cache entry
+        bool indexed; ///< False if the file changed, entry not in byFile
+        /// Created the first time the program is spawned
+        intrusive_ref_ptr<DataSegmentTemplate> dataTemplate;
+    };
+
+    /**
+     * Same as allocate(), but must be called with the mutex locked
+     */
+    static std::pair<unsigned int *, unsigned int> allocateUnlocked(
+            unsigned int size);
+
+    /**
+     * Deallocate a retained program
+     * \param it iterator into retained
+     */
+    static void evict(std::list<Entry>::iterator it);
+
+    static FastMutex m; ///< Protect the cache against concurrent accesses
+    static std::list<Entry> used; ///< Entries in use by at least one process
+    static std::list<Entry> retained; ///< Unused entries, most recent first
+    /// Index by file, only of the entries whose file didn't change
+    static std::unordered_map<FileKey,std::list<Entry>::iterator,FileKeyHash>
+        byFile;
+    /// Index by pointer to the program in RAM
+    static std::unordered_map<const unsigned int*,std::list<Entry>::iterator>
+        byElf;
+    static unsigned int retainedBytes;
+    static unsigned int hits;
+    static unsigned int misses;
+    static unsigned int evictions;
+};
+
 } //namespace miosix
 
 #endif //WITH_PROCESSES
@@ -33,6 +33,9 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
+#include <vector>
+#include <set>
 
 // Unused stubs as the test code only tests IntrusiveList
 inline int atomicSwap(volatile int*, int) { return 0; }
@@ -172,9 +175,251 @@ void IntrusiveListBase::fail()
 }
 #endif //INTRUSIVE_LIST_ERROR_CHECK
 
+
+//
+// class IntrusivePriorityQueueBase
+//
+
+void IntrusivePriorityQueueBase::insert(IntrusivePriorityQueueItem *parent,
+        bool left, IntrusivePriorityQueueItem *item)
+{
+    #ifdef INTRUSIVE_LIST_ERROR_CHECK
+    if(item->left || item->right || item->parent) fail();
+    if((parent==nullptr) ^ (root==nullptr)) fail();
+    #endif //INTRUSIVE_LIST_ERROR_CHECK
+    item->parent=parent;
+    item->red=true;
+    if(parent==nullptr)
+    {
+        root=item;
+        first=item;
+    } else if(left) {
+        parent->left=item;
+        //The new item is the first one only if inserted left of the first one
+        if(parent==first) first=item;
+    } else parent->right=item;
+    insertFixup(item);
+}
+
+void IntrusivePriorityQueueBase::erase(IntrusivePriorityQueueItem *item)
+{
+    #ifdef INTRUSIVE_LIST_ERROR_CHECK
+    if(root==nullptr || contains(item)==false) fail();
+    #endif //INTRUSIVE_LIST_ERROR_CHECK
+    if(item==first) first=next(item);
+    IntrusivePriorityQueueItem *child, *parent;
+    bool red;
+    if(item->left==nullptr || item->right==nullptr)
+    {
+        //Simple case, item has at most one child that takes its place
+        child=item->left!=nullptr ? item->left : item->right;
+        parent=item->parent;
+        red=item->red;
+        if(child) child->parent=parent;
+        if(parent==nullptr) root=child;
+        else if(parent->left==item) parent->left=child;
+        else parent->right=child;
+    } else {
+        //Item has two children, unlink its successor, which has no left
+        //child, and put it in place of item
+        IntrusivePriorityQueueItem *succ=item->right;
+        while(succ->left) succ=succ->left;
+        child=succ->right;
+        parent=succ->parent;
+        red=succ->red;
+        if(child) child->parent=parent;
+        if(parent->left==succ) parent->left=child;
+        else parent->right=child;
+        if(parent==item) parent=succ;
+        succ->left=item->left;
+        succ->right=item->right;
+        succ->parent=item->parent;
+        succ->red=item->red;
+        if(item->parent==nullptr) root=succ;
+        else if(item->parent->left==item) item->parent->left=succ;
+        else item->parent->right=succ;
+        succ->left->parent=succ;
+        if(succ->right) succ->right->parent=succ;
+    }
+    item->left=item->right=item->parent=nullptr;
+    item->red=false;
+    if(red==false) eraseFixup(child,parent);
+}
+
+IntrusivePriorityQueueItem *IntrusivePriorityQueueBase::next(
+        IntrusivePriorityQueueItem *item)
+{
+    if(item->right)
+    {
+        item=item->right;
+        while(item->left) item=item->left;
+        return item;
+    }
+    while(item->parent && item==item->parent->right) item=item->parent;
+    return item->parent;
+}
+
+void IntrusivePriorityQueueBase::rotateLeft(IntrusivePriorityQueueItem *x)
+{
+    IntrusivePriorityQueueItem *y=x->right;
+    x->right=y->left;
+    if(y->left) y->left->parent=x;
+    y->parent=x->parent;
+    if(x->parent==nullptr) root=y;
+    else if(x==x->parent->left) x->parent->left=y;
+    else x->parent->right=y;
+    y->left=x;
+    x->parent=y;
+}
+
+void IntrusivePriorityQueueBase::rotateRight(IntrusivePriorityQueueItem *x)
+{
+    IntrusivePriorityQueueItem *y=x->left;
+    x->left=y->right;
+    if(y->right) y->right->parent=x;
+    y->parent=x->parent;
+    if(x->parent==nullptr) root=y;
+    else if(x==x->parent->right) x->parent->right=y;
+    else x->parent->left=y;
+    y->right=x;
+    x->parent=y;
+}
+
+void IntrusivePriorityQueueBase::insertFixup(IntrusivePriorityQueueItem *x)
+{
+    IntrusivePriorityQueueItem *parent;
+    while((parent=x->parent) && parent->red)
+    {
+        //Parent is red so it is not the root, thus grandparent exists
+        IntrusivePriorityQueueItem *grandparent=parent->parent;
+        if(parent==grandparent->left)
+        {
+            IntrusivePriorityQueueItem *uncle=grandparent->right;
+            if(uncle && uncle->red)
+            {
+                uncle->red=false;
+                parent->red=false;
+                grandparent->red=true;
+                x=grandparent;
+                continue;
+            }
+            if(x==parent->right)
+            {
+                rotateLeft(parent);
+                std::swap(x,parent);
+            }
+            parent->red=false;
+            grandparent->red=true;
+            rotateRight(grandparent);
+        } else {
+            IntrusivePriorityQueueItem *uncle=grandparent->left;
+            if(uncle && uncle->red)
+            {
+                uncle->red=false;
+                parent->red=false;
+                grandparent->red=true;
+                x=grandparent;
+                continue;
+            }
+            if(x==parent->left)
+            {
+                rotateRight(parent);
+                std::swap(x,parent);
+            }
+            parent->red=false;
+            grandparent->red=true;
+            rotateLeft(grandparent);
+        }
+    }
+    root->red=false;
+}
+
+void IntrusivePriorityQueueBase::eraseFixup(IntrusivePriorityQueueItem *x,
+        IntrusivePriorityQueueItem *parent)
+{
+    //x carries an extra black, and may be nullptr, that's why parent is needed
+    while((x==nullptr || x->red==false) && x!=root)
+    {
+        if(parent->left==x)
+        {
+            IntrusivePriorityQueueItem *sibling=parent->right;
+            if(sibling->red)
+            {
+                sibling->red=false;
+                parent->red=true;
+                rotateLeft(parent);
+                sibling=parent->right;
+            }
+            if((sibling->left==nullptr || sibling->left->red==false) &&
+               (sibling->right==nullptr || sibling->right->red==false))
+            {
+                sibling->red=true;
+                x=parent;
+                parent=x->parent;
+            } else {
+                if(sibling->right==nullptr || sibling->right->red==false)
+                {
+                    sibling->left->red=false;
+                    sibling->red=true;
+                    rotateRight(sibling);
+                    sibling=parent->right;
+                }
+                sibling->red=parent->red;
+                parent->red=false;
+                if(sibling->right) sibling->right->red=false;
+                rotateLeft(parent);
+                x=root;
+                break;
+            }
+        } else {
+            IntrusivePriorityQueueItem *sibling=parent->left;
+            if(sibling->red)
+            {
+                sibling->red=false;
+                parent->red=true;
+                rotateRight(parent);
+                sibling=parent->left;
+            }
+            if((sibling->left==nullptr || sibling->left->red==false) &&
+               (sibling->right==nullptr || sibling->right->red==false))
+            {
+                sibling->red=true;
+                x=parent;
+                parent=x->parent;
+            } else {
+                if(sibling->left==nullptr || sibling->left->red==false)
+                {
+                    sibling->right->red=false;
+                    sibling->red=true;
+                    rotateLeft(sibling);
+                    sibling=parent->left;
+                }
+                sibling->red=parent->red;
+                parent->red=false;
+                if(sibling->left) sibling->left->red=false;
+                rotateRight(parent);
+                x=root;
+                break;
+            }
+        }
+    }
+    if(x) x->red=false;
+}
+
+#ifdef INTRUSIVE_LIST_ERROR_CHECK
+void IntrusivePriorityQueueBase::fail()
+{
+    #ifndef TEST_ALGORITHM
+    errorHandler(UNEXPECTED);
+    #else //TEST_ALGORITHM
+    assert(false);
+    #endif //TEST_ALGORITHM
+}
+#endif //INTRUSIVE_LIST_ERROR_CHECK
+
 } //namespace miosix
 
-//Testsuite for IntrusiveList. Compile with:
+//Testsuite for IntrusiveList and IntrusivePriorityQueue. Compile with:
 //g++ -DTEST_ALGORITHM -DINTRUSIVE_LIST_ERROR_CHECK -fsanitize=address -m32
 //    -std=c++14 -Wall -O2 -o test intrusive.cpp; ./test
 #ifdef TEST_ALGORITHM
@@ -299,6 +544,103 @@ void threeItemCheck(IntrusiveList<IntrusiveListItem>& list, IntrusiveListItem& a
     assert(c.next==nullptr);
 }
 
+struct PqItem : public IntrusivePriorityQueueItem
+{
+    int key;
+};
+
+bool operator<(const PqItem& a, const PqItem& b) { return a.key<b.key; }
+
+/**
+ * Check red-black tree invariants
+ * \return the black height of the subtree
+ */
+int rbCheck(IntrusivePriorityQueueItem *x)
+{
+    if(x==nullptr) return 1;
+    if(x->left) assert(x->left->parent==x);
+    if(x->right) assert(x->right->parent==x);
+    if(x->red)
+    {
+        assert(x->left==nullptr || x->left->red==false);
+        assert(x->right==nullptr || x->right->red==false);
+    }
+    int l=rbCheck(x->left);
+    int r=rbCheck(x->right);
+    assert(l==r);
+    return l+(x->red ? 0 : 1);
+}
+
+void pqCheck(IntrusivePriorityQueue<PqItem>& pq, std::multiset<int>& ref)
+{
+    assert(pq.empty()==ref.empty());
+    if(pq.empty()) { assert(pq.root==nullptr && pq.first==nullptr); return; }
+    assert(pq.root->parent==nullptr);
+    assert(pq.root->red==false);
+    rbCheck(pq.root);
+    //In order walk must match the reference
+    auto it=ref.begin();
+    for(PqItem *x=pq.front();x!=nullptr;x=pq.next(x),++it)
+    {
+        assert(it!=ref.end());
+        assert(x->key==*it);
+    }
+    assert(it==ref.end());
+}
+
+void testPriorityQueue()
+{
+    IntrusivePriorityQueue<PqItem> pq;
+    std::multiset<int> ref;
+    pqCheck(pq,ref);
+
+    //Equal items are kept in insertion order
+    PqItem a,b,c;
+    a.key=b.key=c.key=0;
+    pq.push(&a); pq.push(&b); pq.push(&c);
+    assert(pq.front()==&a); pq.pop_front();
+    assert(pq.front()==&b); pq.pop_front();
+    assert(pq.front()==&c); pq.pop_front();
+    assert(pq.empty());
+    assert(pq.removeFast(&a)==false);
+
+    //Randomized test against std::multiset
+    const int numItems=512;
+    std::vector<PqItem> items(numItems);
+    std::vector<bool> present(numItems,false);
+    srand(0);
+    for(int i=0;i<200000;i++)
+    {
+        int j=rand()%numItems;
+        switch(rand()%3)
+        {
+            case 0:
+                if(present[j]) break;
+                items[j].key=rand()%1000;
+                pq.push(&items[j]);
+                ref.insert(items[j].key);
+                present[j]=true;
+                break;
+            case 1:
+                assert(pq.removeFast(&items[j])==present[j]);
+                if(present[j]) ref.erase(ref.find(items[j].key));
+                present[j]=false;
+                break;
+            case 2:
+                if(pq.empty()) break;
+                PqItem *x=pq.front();
+                assert(x->key==*ref.begin());
+                pq.pop_front();
+                ref.erase(ref.begin());
+                present[x-&items[0]]=false;
+                assert(x->left==nullptr && x->right==nullptr && x->parent==nullptr);
+                break;
+        }
+        if(i%64==0) pqCheck(pq,ref);
+    }
+    while(!pq.empty()) pq.pop_front();
+}
+
 int main()
 {
     IntrusiveListItem a,b,c;
@@ -405,6 +747,8 @@ int main()
     emptyCheck(list);
     emptyCheck(a);
 
+    testPriorityQueue();
+
     cout<<"Test passed"<<endl;
     return 0;
 }
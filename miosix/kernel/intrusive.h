@@ -31,6 +31,7 @@
 #include <cstddef>
 #include <cassert>
 #include <type_traits>
+#include <functional>
 #ifndef TEST_ALGORITHM
 #include "interfaces/atomic_ops.h"
 #include "error.h"
@@ -865,4 +866,187 @@ public:
     bool empty() const { return IntrusiveListBase::empty(); }
 };
 
+//Forward declarations
+class IntrusivePriorityQueueBase;
+template<typename T, typename Compare>
+class IntrusivePriorityQueue;
+
+/**
+ * Base class from which all items to be put in an IntrusivePriorityQueue must
+ * derive, contains the pointers that create the tree
+ */
+class IntrusivePriorityQueueItem
+{
+private:
+    IntrusivePriorityQueueItem *left=nullptr;
+    IntrusivePriorityQueueItem *right=nullptr;
+    IntrusivePriorityQueueItem *parent=nullptr;
+    bool red=false;
+
+    friend class IntrusivePriorityQueueBase;
+    template<typename T, typename Compare>
+    friend class IntrusivePriorityQueue;
+};
+
+/**
+ * \internal
+ * Base class of IntrusivePriorityQueue with the non-template-dependent part to
+ * improve code size when instantiationg multiple IntrusivePriorityQueues
+ */
+class IntrusivePriorityQueueBase
+{
+protected:
+    IntrusivePriorityQueueBase() : root(nullptr), first(nullptr) {}
+
+    /**
+     * Link an item in the tree and rebalance it
+     * \param parent the item that becomes the parent of the new item, or
+     * nullptr if the tree is empty
+     * \param left true if item becomes the left child of parent
+     * \param item item to insert
+     */
+    void insert(IntrusivePriorityQueueItem *parent, bool left,
+                IntrusivePriorityQueueItem *item);
+
+    /**
+     * Remove an item from the tree and rebalance it
+     * \param item item to remove, must be in the tree
+     */
+    void erase(IntrusivePriorityQueueItem *item);
+
+    /**
+     * \param item an item in the tree
+     * \return the item that follows the given one in the sort order, or
+     * nullptr if it is the last one
+     */
+    static IntrusivePriorityQueueItem *next(IntrusivePriorityQueueItem *item);
+
+    IntrusivePriorityQueueItem *front() { return first; }
+
+    bool empty() const { return root==nullptr; }
+
+    /**
+     * \return true if the item is in this tree. Only valid for items that
+     * are either not in any tree or in this tree
+     */
+    bool contains(IntrusivePriorityQueueItem *item) const
+    {
+        return item->parent!=nullptr || root==item;
+    }
+
+    #ifdef INTRUSIVE_LIST_ERROR_CHECK
+    static void fail();
+    #endif //INTRUSIVE_LIST_ERROR_CHECK
+
+    IntrusivePriorityQueueItem *root;  ///< Root of the red-black tree
+    IntrusivePriorityQueueItem *first; ///< Cached leftmost item
+
+private:
+    void rotateLeft(IntrusivePriorityQueueItem *x);
+    void rotateRight(IntrusivePriorityQueueItem *x);
+    void insertFixup(IntrusivePriorityQueueItem *x);
+    void eraseFixup(IntrusivePriorityQueueItem *x,
+                    IntrusivePriorityQueueItem *parent);
+};
+
+/**
+ * A priority queue that only accepts objects that derive from
+ * IntrusivePriorityQueueItem.
+ *
+ * Like IntrusiveList, this is a non-owning container that never allocates
+ * memory, so it can be used with interrupts disabled. It is implemented as a
+ * red-black tree with a cached pointer to the first item, so insertion and
+ * removal of any item are O(log(n)) in the worst case, while accessing the
+ * first item is O(1). Items that compare equal are kept in insertion order.
+ * \tparam T type of the items, must derive from IntrusivePriorityQueueItem
+ * \tparam Compare comparison functor, front() returns the item that compares
+ * less than all the others
+ */
+template<typename T, typename Compare=std::less<T>>
+class IntrusivePriorityQueue : private IntrusivePriorityQueueBase
+{
+public:
+    /**
+     * Constructor, produces an empty queue
+     */
+    IntrusivePriorityQueue() {}
+
+    /**
+     * Disabled copy constructor and operator=
+     */
+    IntrusivePriorityQueue(const IntrusivePriorityQueue&)=delete;
+    IntrusivePriorityQueue& operator=(const IntrusivePriorityQueue&)=delete;
+
+    /**
+     * Adds an item to the queue, O(log(n))
+     * \param item item to add
+     */
+    void push(T *item)
+    {
+        #ifdef INTRUSIVE_LIST_ERROR_CHECK
+        if(contains(item)) fail();
+        #endif //INTRUSIVE_LIST_ERROR_CHECK
+        IntrusivePriorityQueueItem *parent=nullptr;
+        IntrusivePriorityQueueItem *walk=root;
+        bool left=false;
+        Compare cmp;
+        while(walk!=nullptr)
+        {
+            parent=walk;
+            left=cmp(*item,*static_cast<T*>(walk));
+            walk=left ? walk->left : walk->right;
+        }
+        IntrusivePriorityQueueBase::insert(parent,left,item);
+    }
+
+    /**
+     * Removes the first item of the queue. The queue must not be empty
+     */
+    void pop_front() { IntrusivePriorityQueueBase::erase(first); }
+
+    /**
+     * Nonportable version of std::list::remove that is O(log(n)) since it
+     * relies on the queue being intrusive
+     * NOTE: can ONLY be called if you are sure the item to remove is either not
+     * in any queue (in this case, nothing is done) or is in the queue it is
+     * being removed from. Trying to remove an item that is present in another
+     * queue produces undefined bahavior.
+     * \param item item to remove, must not be nullptr
+     * \return true if the item was removed, false if the item was not present
+     * in the queue
+     */
+    bool removeFast(T *item)
+    {
+        if(contains(item)==false) return false;
+        IntrusivePriorityQueueBase::erase(item);
+        return true;
+    }
+
+    /**
+     * \return a pointer to the first item. Queue must not be empty
+     */
+    T* front()
+    {
+        #ifdef INTRUSIVE_LIST_ERROR_CHECK
+        if(first==nullptr) fail();
+        #endif //INTRUSIVE_LIST_ERROR_CHECK
+        return static_cast<T*>(first);
+    }
+
+    /**
+     * \param item an item in the queue
+     * \return the item that follows item in the queue order, or nullptr if
+     * item is the last one. Walking the whole queue is O(n)
+     */
+    static T* next(T *item)
+    {
+        return static_cast<T*>(IntrusivePriorityQueueBase::next(item));
+    }
+
+    /**
+     * \return true if the queue is empty
+     */
+    bool empty() const { return IntrusivePriorityQueueBase::empty(); }
+};
+
 } //namespace miosix
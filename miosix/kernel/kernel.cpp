@@ -32,6 +32,7 @@
 #include "logging.h"
 #include "sync.h"
 #include "stage_2_boot.h"
+#include "thread_pool.h"
 #include "process.h"
 #include "kernel/scheduler/scheduler.h"
 #include "stdlib_integration/libc_integration.h"
@@ -65,7 +66,7 @@ volatile Thread *runningThread=nullptr;///<\internal Thread currently running
 ///\internal True if there are threads in the DELETED status. Used by idle thread
 static volatile bool existDeleted=false;
 
-IntrusiveList<SleepData> sleepingList;///list of sleeping threads
+IntrusivePriorityQueue<SleepData> sleepingList;///queue of sleeping threads
 
 ///\internal !=0 after pauseKernel(), ==0 after restartKernel()
 volatile int kernelRunning=0;
@@ -272,20 +273,13 @@ bool isKernelRunning()
 /**
  * \internal
  * Used by Thread::sleep() and pthread_cond_timedwait() to add a thread to
- * sleeping list. The list is sorted by the wakeupTime field to reduce time
- * required to wake threads during context switch.
+ * sleeping list. The list is a priority queue sorted by the wakeupTime field,
+ * so insertion is O(log(n)) and finding the first thread to wake is O(1).
  * Interrupts must be disabled prior to calling this function.
  */
 static void IRQaddToSleepingList(SleepData *x)
 {
-    if(sleepingList.empty() || sleepingList.front()->wakeupTime>=x->wakeupTime)
-    {
-        sleepingList.push_front(x);
-    } else {
-        auto it=sleepingList.begin();
-        while(it!=sleepingList.end() && (*it)->wakeupTime<x->wakeupTime) ++it;
-        sleepingList.insert(it,x);
-    }
+    sleepingList.push(x);
 }
 
 /**
@@ -302,14 +296,15 @@ bool IRQwakeThreads(long long currentTime)
     bool result=false;
     //Since list is sorted, if we don't need to wake the first element
     //we don't need to wake the other too
-    for(auto it=sleepingList.begin();it!=sleepingList.end();)
+    while(sleepingList.empty()==false)
     {
-        if(currentTime<(*it)->wakeupTime) break;
+        SleepData *first=sleepingList.front();
+        if(currentTime<first->wakeupTime) break;
         //Wake both threads doing absoluteSleep() and timedWait()
-        (*it)->thread->flags.IRQclearSleepAndWait();
-        if(const_cast<Thread*>(runningThread)->IRQgetPriority()<(*it)->thread->IRQgetPriority())
+        first->thread->flags.IRQclearSleepAndWait();
+        if(const_cast<Thread*>(runningThread)->IRQgetPriority()<first->thread->IRQgetPriority())
             result=true;
-        it=sleepingList.erase(it);
+        sleepingList.pop_front();
     }
     return result;
 }
@@ -507,6 +502,13 @@ void Thread::setPriority(Priority pr)
     PauseKernelLock lock;
 
     Thread *running=PKgetCurrentThread();
+    #ifdef SCHED_TYPE_EDF
+    //A new deadline marks the end of the current job. Check it against the
+    //thread's own deadline, not the one it may have inherited through a mutex
+    Priority ownDeadline=running->mutexLocked!=nullptr ?
+        running->savedPriority : running->PKgetPriority();
+    if(ownDeadline!=pr) EDFScheduler::PKendOfJob(running,ownDeadline);
+    #endif //SCHED_TYPE_EDF
     //If thread is locking at least one mutex
     if(running->mutexLocked!=nullptr)
     {   
@@ -520,7 +522,7 @@ void Thread::setPriority(Priority pr)
         while(walk!=nullptr)
         {
             if(walk->waiting.empty()==false)
-                pr=std::max(pr,walk->waiting.front()->PKgetPriority());
+                pr=std::max(pr,walk->waiting.front()->thread->PKgetPriority());
             walk=walk->next;
         }
     }
@@ -541,6 +543,11 @@ void Thread::terminate()
     if(this->flags.isDeleting()) return; //Prevent sleep interruption abuse
     this->flags.IRQsetDeleting();
     this->flags.IRQclearSleepAndWait(); //Interruptibility
+    #ifdef WITH_PROCESSES
+    //The thread is not running since we are, so clearing the flag is enough to
+    //make the scheduler resume it from where it switched to userspace
+    if(this!=runningThread) this->flags.IRQsetUserspace(false);
+    #endif //WITH_PROCESSES
 }
 
 bool Thread::testTerminate()
@@ -689,9 +696,10 @@ miosix_private::SyscallParameters Thread::switchToUserspace()
     return result;
 }
 
-Thread *Thread::createUserspace(void *(*startfunc)(void *), Process *proc)
+Thread *Thread::createUserspace(void *(*startfunc)(void *), void *argv,
+        Process *proc)
 {
-    Thread *thread=doCreate(startfunc,SYSTEM_MODE_PROCESS_STACK_SIZE,nullptr,
+    Thread *thread=doCreate(startfunc,SYSTEM_MODE_PROCESS_STACK_SIZE,argv,
             Thread::DEFAULT,false);
     if(thread==nullptr) return nullptr;
 
@@ -735,9 +743,9 @@ void Thread::setupUserspaceContext(unsigned int entry, int argc, void *argvSp,
     //Initialize registers
     void *(*startfunc)(void*)=reinterpret_cast<void *(*)(void*)>(entry);
     //NOTE: for the main thread in a process userWatermark is also the end of
-    //the heap, used by _sbrk_r. When we'll implement threads in processes that
-    //pointer will just point to the watermark end of the thread, but userspace
-    //threads can just ignore that value so we'll pass it unconditionally
+    //the heap, used by _sbrk_r. For the other threads of a process it just
+    //points to the watermark of the thread, but userspace threads can just
+    //ignore that value so we pass it unconditionally
     miosix_private::initCtxsave(runningThread->userCtxsave,startfunc,
         argc,argvSp,envp,gotBase,runningThread->userWatermark);
 }
@@ -776,6 +784,9 @@ Thread::~Thread()
 Thread *Thread::doCreate(void*(*startfunc)(void*) , unsigned int stacksize,
                       void* argv, unsigned short options, bool defaultReent)
 {
+    #ifdef WITH_THREAD_POOL
+    stacksize=ThreadPool::roundStackSize(stacksize);
+    #endif //WITH_THREAD_POOL
     unsigned int fullStackSize=WATERMARK_LEN+CTXSAVE_ON_STACK+stacksize;
 
     //Align fullStackSize to the platform required stack alignment
@@ -784,8 +795,13 @@ Thread *Thread::doCreate(void*(*startfunc)(void*) , unsigned int stacksize,
     fullStackSize*=CTXSAVE_STACK_ALIGNMENT;
 
     //Allocate memory for the thread, return if fail
+    #ifdef WITH_THREAD_POOL
+    unsigned int *base=static_cast<unsigned int*>(ThreadPool::allocate(
+            stacksize,sizeof(Thread)+fullStackSize));
+    #else //WITH_THREAD_POOL
     unsigned int *base=static_cast<unsigned int*>(malloc(sizeof(Thread)+
             fullStackSize));
+    #endif //WITH_THREAD_POOL
     if(base==nullptr) return nullptr;
 
     //At the top of thread memory allocate the Thread class with placement new
@@ -794,8 +810,7 @@ Thread *Thread::doCreate(void*(*startfunc)(void*) , unsigned int stacksize,
 
     if(thread->cReentrancyData==nullptr)
     {
-         thread->~Thread();
-         free(base); //Delete ALL thread memory
+         destroy(thread);
          return nullptr;
     }
 
@@ -813,6 +828,23 @@ Thread *Thread::doCreate(void*(*startfunc)(void*) , unsigned int stacksize,
     return thread;
 }
 
+void Thread::destroy(Thread *thread)
+{
+    void *base=thread->watermark;
+    #ifdef WITH_THREAD_POOL
+    unsigned int stacksize=thread->stacksize;
+    unsigned int size=reinterpret_cast<char*>(thread+1)-
+                      reinterpret_cast<char*>(base);
+    #endif //WITH_THREAD_POOL
+    //Call destructor manually because of placement new
+    thread->~Thread();
+    #ifdef WITH_THREAD_POOL
+    ThreadPool::deallocate(base,stacksize,size);
+    #else //WITH_THREAD_POOL
+    free(base); //Delete ALL thread memory
+    #endif //WITH_THREAD_POOL
+}
+
 void Thread::threadLauncher(void *(*threadfunc)(void*), void *argv)
 {
     void *result=nullptr;
@@ -439,6 +439,7 @@ class SleepData;
 class MemoryProfiling;
 class Mutex;
 class ConditionVariable;
+class MutexWaitToken;
 #ifdef WITH_PROCESSES
 class ProcessBase;
 #endif //WITH_PROCESSES
@@ -834,7 +835,9 @@ public:
      * time to a thread to deallocate resources, close files... before
      * terminating.<br>The first call to terminate on a thread will make it
      * return prematurely form wait(), sleep() and timedWait() call, but only
-     * once.<br>Can be called when the kernel is paused.
+     * once.<br>If the thread belongs to a process and is running userspace
+     * code, it is moved back to kernelspace so that it can terminate even if it
+     * never performs a syscall.<br>Can be called when the kernel is paused.
      */
     void terminate();
 
@@ -1100,9 +1103,11 @@ private:
      * Create a thread to be used inside a process. The thread is created in
      * WAIT status, a wakeup() on it is required to actually start it.
      * \param startfunc entry point
+     * \param argv parameter to be passed to the entry point
      * \param proc process to which this thread belongs
      */
-    static Thread *createUserspace(void *(*startfunc)(void *), Process *proc);
+    static Thread *createUserspace(void *(*startfunc)(void *), void *argv,
+                                   Process *proc);
     
     /**
      * Setup the userspace context of the thread, so that it can be later
@@ -1149,6 +1154,13 @@ private:
     static Thread *doCreate(void *(*startfunc)(void *), unsigned int stacksize,
                             void *argv, unsigned short options, bool defaultReent);
 
+    /**
+     * Deallocate a thread, including its stack. Used by the scheduler to
+     * deallocate deleted threads.
+     * \param thread thread to deallocate, it must not be used afterwards
+     */
+    static void destroy(Thread *thread);
+
     /**
      * Thread launcher, all threads start from this member function, which calls
      * the user specified entry point. When the entry point function returns,
@@ -1200,8 +1212,9 @@ private:
     Priority savedPriority;
     ///List of mutextes locked by this thread
     Mutex *mutexLocked;
-    ///If the thread is waiting on a Mutex, mutexWaiting points to that Mutex
-    Mutex *mutexWaiting;
+    ///If the thread is waiting on a Mutex, mutexWaiting points to the token
+    ///that holds its place in the Mutex waiting queue
+    MutexWaitToken *mutexWaiting;
     unsigned int *watermark;///< pointer to watermark area
     unsigned int ctxsave[CTXSAVE_SIZE];///< Holds cpu registers during ctxswitch
     unsigned int stacksize;///< Contains stack size
@@ -1261,10 +1274,11 @@ private:
 
 /**
  * \internal
- * This class is used to make a list of sleeping threads.
+ * This class is used to make a queue of sleeping threads, sorted by wakeup
+ * time.
  * It is used by the kernel, and should not be used by end users.
  */
-class SleepData : public IntrusiveListItem
+class SleepData : public IntrusivePriorityQueueItem
 {
 public:
     SleepData(Thread *thread, long long wakeupTime)
@@ -1278,6 +1292,15 @@ public:
     long long wakeupTime;
 };
 
+/**
+ * \internal
+ * Sort sleeping threads by wakeup time
+ */
+inline bool operator<(const SleepData& a, const SleepData& b)
+{
+    return a.wakeupTime<b.wakeupTime;
+}
+
 /**
  * \}
  */
@@ -41,6 +41,8 @@
 #include "sync.h"
 #include "process_pool.h"
 #include "process.h"
+#include "time_page.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -72,7 +74,7 @@ static bool aligned(void *x) { return (reinterpret_cast<unsigned>(x) & 0b11)==0;
  * \param a string array
  * \return the number of strings or -1 on failure
  */
-static int validateStringArray(MPUConfiguration& mpu, char* const* a)
+static int validateStringArray(const MPUConfiguration& mpu, char* const* a)
 {
     for(int i=0;;i++)
     {
@@ -85,6 +87,18 @@ static int validateStringArray(MPUConfiguration& mpu, char* const* a)
     }
 }
 
+/**
+ * Parameters passed to Process::startThread()
+ */
+struct ThreadStart
+{
+    unsigned int entry;     ///< Userspace entry point
+    void *arg;              ///< Parameter passed to the entry point
+    char *stackTop;         ///< Initial stack pointer
+    unsigned int stackSize; ///< Stack size, excluding the watermark
+    int tid;                ///< Thread id
+};
+
 /**
  * This class contains information on all the processes in the system
  */
@@ -140,7 +154,7 @@ pid_t Process::create(ElfProgram&& program, ArgsBlock&& args)
         parent->childs.push_back(proc.get());
         p.processes[proc->pid]=proc.get();
     }
-    auto thr=Thread::createUserspace(Process::start,proc.get());
+    auto thr=Thread::createUserspace(Process::start,nullptr,proc.get());
     if(thr==nullptr)
     {
         Lock<Mutex> l(p.procMutex);
@@ -148,11 +162,11 @@ pid_t Process::create(ElfProgram&& program, ArgsBlock&& args)
         parent->childs.remove(proc.get());
         throw runtime_error("Thread creation failed");
     }
-    //Cannot throw bad_alloc due to the reserve in Process's constructor.
-    //This ensures we will never be in the uncomfortable situation where a
-    //thread has already been created but there's no memory to list it
+    //Cannot throw bad_alloc as the main thread is already listed by Process's
+    //constructor. This ensures we will never be in the uncomfortable situation
+    //where a thread has already been created but there's no memory to list it
     //among the threads of a process
-    proc->threads.push_back(thr);
+    proc->threads.front().thread=thr;
     thr->wakeup(); //Actually start the thread, now that everything is set up
     pid_t result=proc->pid;
     proc.release(); //Do not delete the pointer
@@ -241,17 +255,20 @@ pid_t Process::waitpid(pid_t pid, int* exit, int options)
 Process::~Process() {}
 
 Process::Process(const FileDescriptorTable& fdt, ElfProgram&& program,
-        ArgsBlock&& args) : ProcessBase(fdt), waitCount(0), zombie(false)
+        ArgsBlock&& args) : ProcessBase(fdt), tidCounter(1), exiting(false),
+        waitCount(0), zombie(false)
 {
     //This is required so that bad_alloc can never be thrown when the first
-    //thread of the process will be stored in this vector
-    threads.reserve(1);
+    //thread of the process will be stored in this list
+    threads.emplace_back(tidCounter++);
     load(std::move(program),std::move(args));
 }
 
 void Process::load(ElfProgram&& program, ArgsBlock&& args)
 {
     this->program=std::move(program);
+    //Like mmap, shared segments are detached by execve
+    shm.reset();
     //Done here so if not enough memory the new process is not even created
     image.load(this->program);
     //Do the final size check that could not be done when validating the elf
@@ -274,56 +291,76 @@ void Process::load(ElfProgram&& program, ArgsBlock&& args)
     argc=args.getNumberOfArguments();
     argvSp=ptr; //Argument array is at the start of the args block
     envp=ptr+args.getEnvIndex();
-    auto elfBase=reinterpret_cast<const unsigned int*>(this->program.getElfBase());
-    unsigned int elfSize=this->program.getElfSize();
+    configureMpu();
+}
+
+void Process::configureMpu()
+{
+    MPUConfiguration newMpu=mpuConfiguration(shm.get());
+    //The MPU configuration is read by the context switch code
+    FastInterruptDisableLock dLock;
+    mpu=newMpu;
+}
+
+MPUConfiguration Process::mpuConfiguration(const SharedSegment *segment)
+{
+    auto elfBase=reinterpret_cast<const unsigned int*>(program.getElfBase());
+    unsigned int elfSize=program.getElfSize();
     //XIP filesystems may store elf programs without the required alignment to
     //support MPU operation, thus round up the elf region so it fits the minimum
     //MPU-capable region. This makes it possible for a process in a XIP
     //filesystem to access more than the elf itself, but since the access is
     //read-only, memory protection is preserved. TODO: use ARM MPU sub-region
     //disable feature to further limit region size
-    if(this->program.isCopiedInRam()==false)
+    if(program.isCopiedInRam()==false)
         tie(elfBase,elfSize)=MPUConfiguration::roundRegionForMPU(elfBase,elfSize);
-    mpu=MPUConfiguration(elfBase,elfSize,
+    MPUConfiguration newMpu(elfBase,elfSize,
             image.getProcessBasePointer(),image.getProcessImageSize());
+    if(segment) newMpu.setSharedRegion(segment->getBase(),segment->getSize());
+    return newMpu;
+}
+
+bool Process::setSharedSegment(intrusive_ref_ptr<SharedSegment>& segment)
+{
+    MPUConfiguration newMpu=mpuConfiguration(segment.get());
+    //Syscalls copy shm and mpu with interrupts disabled, so they must change
+    //together. The pointers are swapped, not assigned, as dropping the last
+    //reference to a segment deallocates it, which can't be done here
+    FastInterruptDisableLock dLock;
+    if(segment && shm) return false;
+    shm.swap(segment);
+    mpu=newMpu;
+    return true;
 }
 
 void *Process::start(void *)
 {
     //This function is never called with a kernel thread, so the cast is safe
     Process *proc=static_cast<Process*>(Thread::getCurrentThread()->proc);
-    bool running=true;
-    do {
+    SvcResult svcResult;
+    for(;;)
+    {
         unsigned int entry=proc->program.getEntryPoint();
         Thread::setupUserspaceContext(entry,proc->argc,proc->argvSp,proc->envp,
             proc->image.getProcessBasePointer(),proc->image.getMainStackSize());
-        SvcResult svcResult=Resume;
-        do {
-            miosix_private::SyscallParameters sp=Thread::switchToUserspace();
-
-            bool fault=proc->fault.faultHappened();
-            //Handle svc only if no fault occurred
-            if(fault==false) svcResult=proc->handleSvc(sp);
-
-            if(Thread::testTerminate() || svcResult==Exit) running=false;
-            if(fault || svcResult==Segfault)
-            {
-                running=false;
-                proc->exitCode=SIGSEGV; //Segfault
-                #ifdef WITH_ERRLOG
-                iprintf("Process %d terminated due to a fault\n"
-                        "* Code base address was 0x%x\n"
-                        "* Data base address was %p\n",proc->pid,
-                        proc->program.getElfBase(),
-                        proc->image.getProcessBasePointer());
-                proc->mpu.dumpConfiguration();
-                if(fault) proc->fault.print();
-                #endif //WITH_ERRLOG
-            }
-        } while(running && svcResult!=Execve);
-        if(svcResult==Execve) proc->fileTable.cloexec();
-    } while(running);
+        svcResult=proc->serveSyscalls();
+        if(svcResult!=Execve) break;
+        proc->fileTable.cloexec();
+    }
+    if(svcResult==ThreadExit)
+    {
+        //The main thread exited, the process terminates with its last thread
+        {
+            Lock<FastMutex> l(proc->threadMutex);
+            proc->threads.front().thread=nullptr;
+            proc->threadExited.broadcast();
+        }
+        proc->waitThreads();
+        proc->terminateThreads(0);
+    }
+    proc->waitThreads();
     proc->fileTable.closeAll();
+    proc->shm.reset(); //Segment may outlive us, but we're no longer using it
     {
         Processes& p=Processes::instance();
         Lock<Mutex> l(p.procMutex);
@@ -347,7 +384,282 @@ void *Process::start(void *)
     return nullptr;
 }
 
-Process::SvcResult Process::handleSvc(miosix_private::SyscallParameters sp)
+void *Process::startThread(void *argv)
+{
+    //This function is never called with a kernel thread, so the cast is safe
+    Thread *self=Thread::getCurrentThread();
+    Process *proc=static_cast<Process*>(self->proc);
+    {
+        unique_ptr<ThreadStart> ts(static_cast<ThreadStart*>(argv));
+        Thread::setupUserspaceContext(ts->entry,reinterpret_cast<int>(ts->arg),
+            ts->stackTop,reinterpret_cast<void*>(ts->tid),
+            proc->image.getProcessBasePointer(),ts->stackSize);
+    }
+    proc->serveSyscalls();
+    Lock<FastMutex> l(proc->threadMutex);
+    for(auto& t : proc->threads)
+    {
+        if(t.thread!=self) continue;
+        t.thread=nullptr;
+        break;
+    }
+    proc->threadExited.broadcast();
+    return nullptr;
+}
+
+Process::SvcResult Process::serveSyscalls()
+{
+    for(;;)
+    {
+        miosix_private::SyscallParameters sp=Thread::switchToUserspace();
+        //If the thread was moved back to kernelspace by terminate(), sp does
+        //not contain a syscall
+        if(Thread::testTerminate()) return Exit;
+        bool faultHappened=fault.faultHappened();
+        SvcResult svcResult=Segfault;
+        //Handle svc only if no fault occurred
+        if(faultHappened==false)
+        {
+            #ifdef WITH_KERNEL_TRACE
+            unsigned int id=sp.getSyscallId();
+            KernelTrace::record(TraceEvent::SyscallEntry,id);
+            #endif //WITH_KERNEL_TRACE
+            //Another thread may detach the shared segment while this one
+            //is blocked in the syscall using a buffer in it. Pointers are
+            //checked against the memory regions when the syscall started,
+            //and the segment is kept allocated until it completes
+            intrusive_ref_ptr<SharedSegment> syscallShm;
+            MPUConfiguration syscallMpu;
+            {
+                FastInterruptDisableLock dLock;
+                syscallShm=shm;
+                syscallMpu=mpu;
+            }
+            svcResult=handleSvc(sp,syscallMpu);
+            #ifdef WITH_KERNEL_TRACE
+            KernelTrace::record(TraceEvent::SyscallExit,id);
+            #endif //WITH_KERNEL_TRACE
+        }
+        //Another thread may have terminated us during the syscall
+        if(svcResult==Resume && Thread::testTerminate()) return Exit;
+        if(svcResult==Resume) continue;
+        if(svcResult==Segfault)
+        {
+            //Only the first thread to fail reports the fault
+            if(terminateThreads(SIGSEGV)==false) return Segfault;
+            #ifdef WITH_ERRLOG
+            iprintf("Process %d terminated due to a fault\n"
+                    "* Code base address was 0x%x\n"
+                    "* Data base address was %p\n",pid,
+                    program.getElfBase(),image.getProcessBasePointer());
+            mpu.dumpConfiguration();
+            if(faultHappened) fault.print();
+            #endif //WITH_ERRLOG
+        }
+        return svcResult;
+    }
+}
+
+bool Process::terminateThreads(int code)
+{
+    Lock<FastMutex> l(threadMutex);
+    if(exiting) return false;
+    exiting=true;
+    exitCode=code;
+    Thread *self=Thread::getCurrentThread();
+    for(auto& t : threads) if(t.thread && t.thread!=self) t.thread->terminate();
+    return true;
+}
+
+int Process::execveKillThreads()
+{
+    Thread *self=Thread::getCurrentThread();
+    {
+        Lock<FastMutex> l(threadMutex);
+        if(threads.front().thread!=self) return -ENOTSUP;
+    }
+    //Setting exiting also prevents creating new threads in the meantime
+    if(terminateThreads(0)==false) return -EINTR;
+    waitThreads();
+    Lock<FastMutex> l(threadMutex);
+    threads.erase(++threads.begin(),threads.end());
+    exiting=false;
+    return 0;
+}
+
+void Process::waitThreads()
+{
+    Lock<FastMutex> l(threadMutex);
+    Thread *self=Thread::getCurrentThread();
+    for(;;)
+    {
+        bool running=false;
+        for(auto& t : threads) if(t.thread && t.thread!=self) running=true;
+        if(running==false) return;
+        threadExited.wait(l);
+    }
+}
+
+int Process::createThread(unsigned int entry, void *arg, char *stack,
+        unsigned int stackSize)
+{
+    //The ARM ABI requires the stack pointer to be aligned to 8 bytes
+    auto top=(reinterpret_cast<unsigned int>(stack)+stackSize) & ~7;
+    auto size=top-reinterpret_cast<unsigned int>(stack);
+    if(size<WATERMARK_LEN+MIN_PROCESS_STACK_SIZE) return -EINVAL;
+    unique_ptr<ThreadStart> ts(new ThreadStart);
+    ts->entry=entry;
+    ts->arg=arg;
+    ts->stackTop=reinterpret_cast<char*>(top);
+    ts->stackSize=size-WATERMARK_LEN;
+    Lock<FastMutex> l(threadMutex);
+    if(exiting) return -EAGAIN;
+    ts->tid=tidCounter;
+    threads.emplace_back(tidCounter);
+    Thread *thr=Thread::createUserspace(Process::startThread,ts.get(),this);
+    if(thr==nullptr)
+    {
+        threads.pop_back();
+        return -EAGAIN;
+    }
+    ts.release(); //Deleted by the thread
+    threads.back().thread=thr;
+    thr->wakeup(); //Actually start the thread, now that everything is set up
+    return tidCounter++;
+}
+
+int Process::joinThread(int tid, void **result, int options)
+{
+    Lock<FastMutex> l(threadMutex);
+    auto it=find_if(threads.begin(),threads.end(),
+                    [tid](const ProcessThread& t){ return t.tid==tid; });
+    if(it==threads.end()) return -ESRCH;
+    if(it->thread==Thread::getCurrentThread()) return -EDEADLK;
+    if(it->joining) return -EINVAL;
+    if(it->thread && (options & WNOHANG)) return -EBUSY;
+    it->joining=true;
+    while(it->thread)
+    {
+        if(Thread::testTerminate())
+        {
+            it->joining=false;
+            return -EINTR;
+        }
+        threadExited.wait(l);
+    }
+    *result=it->result;
+    threads.erase(it);
+    return 0;
+}
+
+int Process::futexWait(const int *addr, int expected, long long timeout)
+{
+    unsigned int key=futexKey(addr);
+    auto& bucket=futexTable[futexBucket(key)];
+    FutexWaiter waiter(key,Thread::getCurrentThread());
+    PauseKernelLock dLock;
+    //With the kernel paused no other thread of the process can change *addr
+    //between the check and the wait, so wakeups can't be lost
+    if(*addr!=expected) return -EAGAIN;
+    if(Thread::testTerminate()) return -EINTR;
+    bucket.push_back(&waiter);
+    bool timedOut=false;
+    if(timeout<0) Thread::PKrestartKernelAndWait(dLock);
+    else timedOut=Thread::PKrestartKernelAndTimedWait(dLock,timeout)
+                  ==TimedWaitResult::Timeout;
+    //Still in the list in case of timeout or spurious wakeup
+    if(bucket.removeFast(&waiter)==false) timedOut=false;
+    if(Thread::testTerminate()) return -EINTR;
+    return timedOut ? -ETIMEDOUT : 0;
+}
+
+int Process::futexWake(const int *addr, int count)
+{
+    unsigned int key=futexKey(addr);
+    auto& bucket=futexTable[futexBucket(key)];
+    int result=0;
+    bool hppw=false;
+    {
+        PauseKernelLock dLock;
+        for(auto it=bucket.begin();it!=bucket.end() && result<count;)
+        {
+            if((*it)->key!=key)
+            {
+                ++it;
+                continue;
+            }
+            Thread *t=(*it)->thread;
+            it=bucket.erase(it);
+            t->PKwakeup();
+            if(t->PKgetPriority()>Thread::PKgetCurrentThread()->PKgetPriority())
+                hppw=true;
+            result++;
+        }
+    }
+    //If the woken thread has higher priority than our priority, yield
+    if(hppw) Thread::yield();
+    return result;
+}
+
+int Process::submitRing(SyscallRingHeader *ring, const MPUConfiguration& mpu)
+{
+    if(!mpu.withinForWriting(ring,sizeof(SyscallRingHeader)) || !aligned(ring))
+        return -EFAULT;
+    unsigned int mask=ring->mask;
+    if(mask & (mask+1)) return -EINVAL; //Size must be a power of two
+    //Prevent the ring size computation below from overflowing
+    if(mask>=0xffffffffu/sizeof(SyscallRingEntry)) return -EINVAL;
+    auto entries=reinterpret_cast<SyscallRingEntry*>(ring+1);
+    if(!mpu.withinForWriting(entries,(mask+1)*sizeof(SyscallRingEntry)))
+        return -EFAULT;
+    unsigned int head=ring->head;
+    unsigned int tail=ring->tail;
+    if(tail-head>mask+1) return -EINVAL;
+    int result=0;
+    for(;head!=tail;head++,result++)
+    {
+        //Stop early if another thread is terminating the process
+        if(Thread::testTerminate()) break;
+        //Work on a copy, the process can modify the ring concurrently
+        SyscallRingEntry *entry=entries+(head & mask);
+        SyscallRingEntry e=*entry;
+        long long entryResult=executeRingEntry(e,mpu);
+        //Check again the entry is within the process before writing to it
+        if(!mpu.withinForWriting(entry,sizeof(SyscallRingEntry))) break;
+        entry->result=entryResult;
+        ring->head=head+1;
+    }
+    return result;
+}
+
+long long Process::executeRingEntry(const SyscallRingEntry& e,
+                                    const MPUConfiguration& mpu)
+{
+    void *ptr=reinterpret_cast<void*>(e.ptr);
+    switch(static_cast<Syscall>(e.op))
+    {
+        case Syscall::READ:
+            if(!mpu.withinForWriting(ptr,e.arg)) return -EFAULT;
+            return fileTable.read(e.fd,ptr,e.arg);
+        case Syscall::WRITE:
+            if(!mpu.withinForReading(ptr,e.arg)) return -EFAULT;
+            return fileTable.write(e.fd,ptr,e.arg);
+        case Syscall::LSEEK:
+            return fileTable.lseek(e.fd,e.offset,e.arg);
+        case Syscall::FSTAT:
+        {
+            auto pstat=reinterpret_cast<struct stat*>(ptr);
+            if(!mpu.withinForWriting(pstat,sizeof(struct stat)) ||
+               !aligned(pstat)) return -EFAULT;
+            return fileTable.fstat(e.fd,pstat);
+        }
+        default:
+            return -ENOSYS;
+    }
+}
+
+Process::SvcResult Process::handleSvc(miosix_private::SyscallParameters sp,
+                                      const MPUConfiguration& mpu)
 {
     try {
         switch(static_cast<Syscall>(sp.getSyscallId()))
@@ -732,7 +1044,7 @@ Process::SvcResult Process::handleSvc(miosix_private::SyscallParameters sp)
 
             case Syscall::EXIT:
             {
-                exitCode=(sp.getParameter(0) & 0xff)<<8;
+                terminateThreads((sp.getParameter(0) & 0xff)<<8);
                 return Exit;
             }
 
@@ -751,9 +1063,13 @@ Process::SvcResult Process::handleSvc(miosix_private::SyscallParameters sp)
                         ElfProgram program(path);
                         if(program.errorCode()==0)
                         {
+                            int result=execveKillThreads();
+                            if(result!=0)
+                            {
+                                sp.setParameter(0,result);
+                                break;
+                            }
                             try {
-                                //TODO: when threads within processes are
-                                //implemented, kill all other threads
                                 load(std::move(program),std::move(args));
                             } catch(exception& e) {
                                 //TODO currently load causes the old process
@@ -879,8 +1195,145 @@ Process::SvcResult Process::handleSvc(miosix_private::SyscallParameters sp)
                 break;
             }
 
+            case Syscall::SBRK:
+            {
+                unsigned int incr=sp.getParameter(0);
+                auto start=reinterpret_cast<char**>(sp.getParameter(1));
+                if(mpu.withinForWriting(start,sizeof(char*)) && aligned(start))
+                {
+                    unsigned int oldSize=image.getProcessImageSize();
+                    if(incr<=MAX_PROCESS_IMAGE_SIZE &&
+                       image.extend(oldSize+incr))
+                    {
+                        configureMpu();
+                        *start=reinterpret_cast<char*>(
+                            image.getProcessBasePointer())+oldSize;
+                        sp.setParameter(0,image.getProcessImageSize()-oldSize);
+                    } else sp.setParameter(0,-ENOMEM);
+                } else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
+            case Syscall::SHMATTACH:
+            {
+                auto name=reinterpret_cast<const char*>(sp.getParameter(0));
+                unsigned int size=sp.getParameter(1);
+                int flags=sp.getParameter(2);
+                auto addr=reinterpret_cast<void**>(sp.getParameter(3));
+                if(mpu.withinForReading(name) &&
+                   mpu.withinForWriting(addr,sizeof(void*)) && aligned(addr))
+                {
+                    if(!shm)
+                    {
+                        intrusive_ref_ptr<SharedSegment> segment;
+                        int result=SharedSegment::open(name,size,flags,segment);
+                        if(result==0)
+                        {
+                            void *base=segment->getBase();
+                            unsigned int segmentSize=segment->getSize();
+                            //Another thread may have attached a segment
+                            if(setSharedSegment(segment))
+                            {
+                                *addr=base;
+                                sp.setParameter(0,segmentSize);
+                            } else sp.setParameter(0,-EBUSY);
+                        } else sp.setParameter(0,result);
+                    } else sp.setParameter(0,-EBUSY);
+                } else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
+            case Syscall::SHMDETACH:
+            {
+                if(shm)
+                {
+                    //The segment is deallocated when the last syscall
+                    //using it completes, if this was the last reference
+                    intrusive_ref_ptr<SharedSegment> detached;
+                    setSharedSegment(detached);
+                    sp.setParameter(0,0);
+                } else sp.setParameter(0,-EINVAL);
+                break;
+            }
+
+            case Syscall::SHMUNLINK:
+            {
+                auto name=reinterpret_cast<const char*>(sp.getParameter(0));
+                if(mpu.withinForReading(name))
+                    sp.setParameter(0,SharedSegment::unlink(name));
+                else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
+            case Syscall::THREAD_CREATE:
+            {
+                unsigned int entry=sp.getParameter(0);
+                auto arg=reinterpret_cast<void*>(sp.getParameter(1));
+                auto stack=reinterpret_cast<char*>(sp.getParameter(2));
+                unsigned int stackSize=sp.getParameter(3);
+                if(mpu.withinForWriting(stack,stackSize) && aligned(stack))
+                    sp.setParameter(0,createThread(entry,arg,stack,stackSize));
+                else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
+            case Syscall::THREAD_EXIT:
+            {
+                Lock<FastMutex> l(threadMutex);
+                Thread *self=Thread::getCurrentThread();
+                for(auto& t : threads)
+                {
+                    if(t.thread!=self) continue;
+                    t.result=reinterpret_cast<void*>(sp.getParameter(0));
+                    break;
+                }
+                return ThreadExit;
+            }
+
+            case Syscall::THREAD_JOIN:
+            {
+                int tid=sp.getParameter(0);
+                auto result=reinterpret_cast<void**>(sp.getParameter(1));
+                int options=sp.getParameter(2);
+                if(mpu.withinForWriting(result,sizeof(void*)) && aligned(result))
+                    sp.setParameter(0,joinThread(tid,result,options));
+                else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
+            case Syscall::FUTEX_WAIT:
+            {
+                auto addr=reinterpret_cast<int*>(sp.getParameter(0));
+                int expected=sp.getParameter(1);
+                long long timeout=sp.getParameter(2);
+                timeout|=static_cast<long long>(sp.getParameter(3))<<32;
+                if(mpu.withinForReading(addr,sizeof(int)) && aligned(addr))
+                    sp.setParameter(0,futexWait(addr,expected,timeout));
+                else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
+            case Syscall::FUTEX_WAKE:
+            {
+                auto addr=reinterpret_cast<int*>(sp.getParameter(0));
+                int count=sp.getParameter(1);
+                sp.setParameter(0,futexWake(addr,count));
+                break;
+            }
+
+            case Syscall::TIMEPAGE:
+                sp.setParameter(0,reinterpret_cast<unsigned int>(getTimePage()));
+                break;
+
+            case Syscall::RING_SUBMIT:
+            {
+                auto ring=reinterpret_cast<SyscallRingHeader*>(sp.getParameter(0));
+                sp.setParameter(0,submitRing(ring,mpu));
+                break;
+            }
+
             default:
-                exitCode=SIGSYS; //Bad syscall
+                terminateThreads(SIGSYS); //Bad syscall
                 #ifdef WITH_ERRLOG
                 iprintf("Unexpected syscall number %d\n",sp.getSyscallId());
                 #endif //WITH_ERRLOG
@@ -35,6 +35,7 @@
 #include "kernel.h"
 #include "sync.h"
 #include "elf_program.h"
+#include "shared_memory.h"
 #include "config/miosix_settings.h"
 #include "filesystem/file_access.h"
 
@@ -46,6 +47,35 @@ namespace miosix {
 class Process;
 class ArgsBlock;
 
+/**
+ * An operation queued by a process in its syscall ring. The result is written
+ * back in the same entry when the operation is executed.
+ * NOTE: the layout must match the one in libsyscalls/syscall_ring.h
+ */
+struct SyscallRingEntry
+{
+    unsigned int op;  ///< Syscall::READ, WRITE, LSEEK or FSTAT
+    int fd;           ///< File descriptor
+    unsigned int ptr; ///< Buffer for READ/WRITE, struct stat for FSTAT
+    unsigned int arg; ///< Buffer size for READ/WRITE, whence for LSEEK
+    long long offset; ///< Offset for LSEEK
+    long long result; ///< Result, or a negative error code
+};
+
+/**
+ * Header of the syscall ring, a circular buffer of SyscallRingEntry in process
+ * memory, immediately following the header. The process queues operations
+ * advancing tail, the kernel executes them in order advancing head.
+ * NOTE: the layout must match the one in libsyscalls/syscall_ring.h
+ */
+struct SyscallRingHeader
+{
+    unsigned int mask;          ///< Number of entries minus one
+    volatile unsigned int head; ///< Index of the next entry to execute
+    volatile unsigned int tail; ///< Index past the last queued entry
+    unsigned int reserved;
+};
+
 /**
  * This class contains the fields that are in common between the kernel and
  * processes
@@ -185,6 +215,28 @@ private:
      * \param args program arguments and environment variables
      */
     void load(ElfProgram&& program, ArgsBlock&& args);
+
+    /**
+     * Configure the memory protection regions from the program, process
+     * image and attached shared segment
+     */
+    void configureMpu();
+
+    /**
+     * \param segment shared segment to map, or nullptr
+     * \return the memory protection regions of the process
+     */
+    MPUConfiguration mpuConfiguration(const SharedSegment *segment);
+
+    /**
+     * Attach or detach the shared segment, updating the memory protection
+     * regions
+     * \param segment segment to attach, or nullptr to detach the current one.
+     * When detaching, the reference to the detached segment is dropped by the
+     * caller, so the segment memory is deallocated outside this function
+     * \return false if attaching and another segment is already attached
+     */
+    bool setSharedSegment(intrusive_ref_ptr<SharedSegment>& segment);
     
     /**
      * Contains the process' main loop. 
@@ -193,21 +245,148 @@ private:
      */
     static void *start(void *argv);
 
+    /**
+     * Contains the loop of the threads of a process other than the main one
+     * \param argv a ThreadStart describing the thread to start
+     * \return null
+     */
+    static void *startThread(void *argv);
+
     enum SvcResult
     {
         Resume=0,   ///< Process can switch to userspace and resume operation
         Exit=1,     ///< Process exited
         Execve=2,   ///< Process can resume, but the program has been switched
-        Segfault=3  ///< Unrecoverable error occurred
+        Segfault=3, ///< Unrecoverable error occurred
+        ThreadExit=4 ///< The calling thread exited, but not the process
     };
+
+    /**
+     * Switch the calling thread to userspace and serve its syscalls until
+     * the thread has to stop running userspace code
+     * \return the reason why the thread stopped, never Resume. If the thread
+     * was terminated by another thread of the process, Exit is returned
+     */
+    SvcResult serveSyscalls();
+
+    /**
+     * Start terminating the process, by terminating all its threads except the
+     * calling one
+     * \param code process exit code
+     * \return true if this is the first call, false if the process was already
+     * terminating, in which case the exit code is not changed
+     */
+    bool terminateThreads(int code);
+
+    /**
+     * Terminate all threads except the calling one and wait for them, as
+     * required by execve
+     * \return 0 on success, -ENOTSUP if the calling thread is not the main
+     * thread or -EINTR if the process is already terminating
+     */
+    int execveKillThreads();
+
+    /**
+     * Wait until all the threads of the process except the calling one have
+     * terminated
+     */
+    void waitThreads();
+
+    /**
+     * Create a new thread in the process
+     * \param entry userspace entry point
+     * \param arg parameter passed to the entry point
+     * \param stack base address of the memory area to be used as the thread
+     * stack, which must be within the process image
+     * \param stackSize stack size
+     * \return the thread id, or a negative error code
+     */
+    int createThread(unsigned int entry, void *arg, char *stack,
+                     unsigned int stackSize);
+
+    /**
+     * Wait for a thread of the process to terminate
+     * \param tid thread id
+     * \param result value passed by the thread to thread exit
+     * \param options 0 or WNOHANG to return immediately if the thread has
+     * not terminated
+     * \return 0 on success, or a negative error code
+     */
+    int joinThread(int tid, void **result, int options);
+
+    /**
+     * Block the calling thread until woken by futexWake(), if the value at the
+     * given address is the expected one
+     * \param addr address, must be within the process
+     * \param expected the thread blocks only if *addr==expected
+     * \param timeout absolute time in nanoseconds after which the wait times
+     * out, or a negative value to wait forever
+     * \return 0 if woken, -EAGAIN if *addr!=expected, -ETIMEDOUT if the wait
+     * timed out or -EINTR if the thread is being terminated
+     */
+    int futexWait(const int *addr, int expected, long long timeout);
+
+    /**
+     * Wake threads blocked in futexWait() on an address
+     * \param addr address
+     * \param count maximum number of threads to wake
+     * \return the number of threads woken
+     */
+    int futexWake(const int *addr, int count);
+
+    /**
+     * Execute the operations queued in a syscall ring, in order
+     * \param ring ring header in process memory
+     * \param mpu memory regions of the process when the syscall started
+     * \return the number of operations executed, or a negative error code if
+     * the ring is invalid
+     */
+    int submitRing(SyscallRingHeader *ring, const MPUConfiguration& mpu);
+
+    /**
+     * Execute a single operation from a syscall ring
+     * \param e a copy of the ring entry
+     * \param mpu memory regions of the process when the syscall started
+     * \return the operation result, or a negative error code
+     */
+    long long executeRingEntry(const SyscallRingEntry& e,
+                               const MPUConfiguration& mpu);
+
+    /**
+     * \param addr an address within the process
+     * \return the key identifying the address in the futex wait table. Keys are
+     * relative to the process image, so that they do not depend on where the
+     * process has been loaded
+     */
+    unsigned int futexKey(const int *addr) const
+    {
+        return reinterpret_cast<unsigned int>(addr)
+             - reinterpret_cast<unsigned int>(image.getProcessBasePointer());
+    }
+
+    /**
+     * \param key a futex key
+     * \return the futex wait table bucket for the key
+     */
+    static unsigned int futexBucket(unsigned int key)
+    {
+        //Futexes are aligned words, discard the low bits and mix the others
+        //so that nearby words fall into different buckets
+        return ((key>>2)*2654435761u>>16) & (PROCESS_FUTEX_BUCKETS-1);
+    }
     
     /**
      * Handle a supervisor call
      * \param sp syscall parameters
+     * \param mpu memory regions of the process when the syscall started.
+     * Pointers passed by the process are checked against these regions, whose
+     * shared segment, if any, is kept allocated by the caller until the
+     * syscall completes, even if another thread detaches it
      * \return true if the process can continue running, false if it has
      * terminated
      */
-    SvcResult handleSvc(miosix_private::SyscallParameters sp);
+    SvcResult handleSvc(miosix_private::SyscallParameters sp,
+                        const MPUConfiguration& mpu);
     
     /**
      * \return an unique pid that is not zero and is not already in use in the
@@ -219,11 +398,46 @@ private:
     ProcessImage image; ///<The RAM image of a process
     miosix_private::FaultData fault; ///< Contains information about faults
     MPUConfiguration mpu; ///<Memory protection data
+    intrusive_ref_ptr<SharedSegment> shm; ///<Attached shared segment, if any
     int argc;   ///< Process argument count
     void *argvSp; ///< Ptr to argument array within ProcessImage and initial sp
     void *envp; ///< Pointer to the environment array within the ProcessImage
     
-    std::vector<Thread *> threads; ///<Threads that belong to the process
+    /**
+     * A thread that belongs to the process
+     */
+    struct ProcessThread
+    {
+        ProcessThread(int tid) : thread(nullptr), result(nullptr), tid(tid),
+            joining(false) {}
+        Thread *thread; ///< Kernel thread, nullptr once terminated
+        void *result;   ///< Value passed to thread exit
+        int tid;        ///< Thread id, unique within the process
+        bool joining;   ///< True if another thread is joining this one
+    };
+
+    /**
+     * A thread blocked in futexWait()
+     */
+    class FutexWaiter : public IntrusiveListItem
+    {
+    public:
+        FutexWaiter(unsigned int key, Thread *thread)
+            : key(key), thread(thread) {}
+        unsigned int key; ///< Key of the address the thread is waiting on
+        Thread *thread;   ///< Waiting thread
+    };
+
+    ///Threads that belong to the process, the first one is the main thread.
+    ///Terminated threads are kept until joined
+    std::list<ProcessThread> threads;
+    int tidCounter; ///< Used to assign thread ids
+    bool exiting;   ///< True if the process is terminating its threads
+    FastMutex threadMutex; ///< Protects threads, tidCounter, exiting
+    ConditionVariable threadExited; ///< Signaled when a thread terminates
+    ///Threads blocked in futexWait(), hashed by futex key and accessed with
+    ///the kernel paused
+    IntrusiveList<FutexWaiter> futexTable[PROCESS_FUTEX_BUCKETS];
     
     ///Contains the count of active wait calls which specifically requested
     ///to wait on this process
@@ -396,6 +610,61 @@ enum class Syscall
     MOUNT     = 56,
     UMOUNT    = 57,
     MKFS      = 58, //Moving filesystem creation code to kernel
+
+    // Memory syscalls
+    // Grow the process image in place to make room for the heap. Parameters
+    // are the number of bytes requested and a pointer where the start of the
+    // new memory area is stored. Since the main stack and arguments are at the
+    // end of the process image, the new area is not contiguous with the heap.
+    // Returns the size of the new area, or a negative error code
+    SBRK      = 59,
+    // Map a shared segment in the spare memory protection region. Parameters
+    // are the segment name, its size, O_CREAT/O_EXCL flags and a pointer where
+    // the segment address is stored. Only one segment can be attached at a
+    // time. Returns the segment size, or a negative error code
+    SHMATTACH = 60,
+    // Unmap the attached shared segment. No parameters. Syscalls of other
+    // threads already in progress can keep using the segment until they end
+    SHMDETACH = 61,
+    // Remove a shared segment name, the segment memory is deallocated when
+    // the last process detaches. Parameter is the segment name
+    SHMUNLINK = 62,
+
+    // Thread syscalls
+    // Create a thread. Parameters are the userspace entry point, the parameter
+    // passed to it, and the base and size of the memory area to use as stack,
+    // which is allocated by the caller within the process image. The entry
+    // point receives the parameter in r0, the initial stack pointer in r1 and
+    // the thread id in r2. Returns the thread id, or a negative error code
+    THREAD_CREATE = 63,
+    // Terminate the calling thread. Parameter is the value returned to the
+    // thread that joins it. Does not return
+    THREAD_EXIT   = 64,
+    // Wait for a thread to terminate. Parameters are the thread id, a pointer
+    // where the value passed to thread exit is stored, and either 0 or WNOHANG.
+    // Returns 0, or a negative error code, -EBUSY if WNOHANG is passed and the
+    // thread has not yet terminated
+    THREAD_JOIN   = 65,
+    // Block the calling thread if the word at the given address contains the
+    // given value. Parameters are the address, the value and a 64 bit absolute
+    // timeout in nanoseconds, negative to wait forever. Returns 0 when woken,
+    // or a negative error code, -EAGAIN if the value did not match and
+    // -ETIMEDOUT if the timeout expired
+    FUTEX_WAIT    = 66,
+    // Wake threads blocked on an address. Parameters are the address and the
+    // maximum number of threads to wake. Returns the number of woken threads
+    FUTEX_WAKE    = 67,
+
+    // Time page syscalls
+    // Return the address of the time page, which processes can use to read
+    // the time without a syscall, or 0 if the os timer does not support it
+    TIMEPAGE      = 68,
+
+    // Syscall ring
+    // Execute in order the operations queued in a syscall ring. The parameter
+    // is the ring header. Returns the number of executed operations, or a
+    // negative error code
+    RING_SUBMIT   = 69,
 };
 
 } //namespace miosix
@@ -56,7 +56,9 @@ ProcessPool& ProcessPool::instance()
         reinterpret_cast<unsigned int>(&_process_pool_start));
     return pool;
     #else //TEST_ALLOC
-    static ProcessPool pool(reinterpret_cast<unsigned int*>(0x20008000),96*1024);
+    //Like a pool at 0x20008000, not aligned to its size
+    alignas(64*1024) static unsigned int memory[128*1024/sizeof(unsigned int)];
+    static ProcessPool pool(memory+32*1024/sizeof(unsigned int),96*1024);
     return pool;
     #endif //TEST_ALLOC
 }
@@ -73,29 +75,61 @@ pair<unsigned int *, unsigned int> ProcessPool::allocate(unsigned int size)
     #endif //TEST_ALLOC
     if(size>poolSize) throw bad_alloc();
     
-    unsigned int offset=0;
-    if(reinterpret_cast<unsigned int>(poolBase) % size)
-        offset=size-(reinterpret_cast<unsigned int>(poolBase) % size);
-    unsigned int startBit=offset/blockSize;
-    unsigned int sizeBit=size/blockSize;
+    //Find the smallest free block that is large enough
+    unsigned int order=__builtin_ctz(size)-blockBits;
+    unsigned int i=order;
+    while(i<numOrders && freeLists[i]==nullptr) i++;
+    if(i>=numOrders) throw bad_alloc();
+    FreeBlock *block=freeLists[i];
+    removeFree(block,i);
 
-    for(unsigned int i=startBit;i<=poolSize/blockSize;i+=sizeBit)
+    //Split it, returning the upper halves to the free lists
+    while(i>order)
     {
-        bool notEmpty=false;
-        for(unsigned int j=0;j<sizeBit;j++)
-        {
-            if(testBit(i+j)==0) continue;
-            notEmpty=true;
-            break;
-        }
-        if(notEmpty) continue;
-        
-        for(unsigned int j=0;j<sizeBit;j++) setBit(i+j);
-        unsigned int *result=poolBase+i*blockSize/sizeof(unsigned int);
-        allocatedBlocks[result]=size;
-        return make_pair(result,size);
+        i--;
+        insertFree(reinterpret_cast<FreeBlock*>(
+            reinterpret_cast<char*>(block)+(blockSize<<i)),i);
     }
-    throw bad_alloc();
+    blockInfo[blockIndex(block)]=order+1;
+    freeBytes-=size;
+    return make_pair(reinterpret_cast<unsigned int*>(block),size);
+}
+
+unsigned int ProcessPool::extend(unsigned int *ptr, unsigned int size)
+{
+    #ifndef TEST_ALLOC
+    miosix::Lock<miosix::FastMutex> l(mutex);
+    size=MPUConfiguration::roundSizeForMPU(max(size,blockSize));
+    #else //TEST_ALLOC
+    if((size & (size - 1)) || size<blockSize)
+            throw runtime_error("ProcessPool::extend unsupported size");
+    #endif //TEST_ALLOC
+    unsigned int order=allocatedOrder(ptr);
+    if(size<=blockSize<<order) return blockSize<<order;
+    if(size>poolSize) return 0;
+    unsigned int newOrder=__builtin_ctz(size)-blockBits;
+    size_t base=reinterpret_cast<size_t>(poolBase);
+    size_t addr=reinterpret_cast<size_t>(ptr);
+    if(addr & (size-1)) return 0;
+    //As the block is aligned to the new size, the blocks to merge are the
+    //upper buddies at each order. Check them all before modifying anything
+    for(unsigned int i=order;i<newOrder;i++)
+    {
+        size_t buddy=addr+(static_cast<size_t>(blockSize)<<i);
+        if(buddy-base>=poolSize) return 0;
+        if(blockInfo[blockIndex(reinterpret_cast<void*>(buddy))]!=((i+1) | freeFlag))
+            return 0;
+    }
+    for(unsigned int i=order;i<newOrder;i++)
+    {
+        FreeBlock *buddy=reinterpret_cast<FreeBlock*>(
+            addr+(static_cast<size_t>(blockSize)<<i));
+        removeFree(buddy,i);
+        blockInfo[blockIndex(buddy)]=0;
+    }
+    blockInfo[blockIndex(ptr)]=newOrder+1;
+    freeBytes-=size-(blockSize<<order);
+    return size;
 }
 
 void ProcessPool::deallocate(unsigned int *ptr)
@@ -103,75 +137,249 @@ void ProcessPool::deallocate(unsigned int *ptr)
     #ifndef TEST_ALLOC
     miosix::Lock<miosix::FastMutex> l(mutex);
     #endif //TEST_ALLOC
-    map<unsigned int*, unsigned int>::iterator it= allocatedBlocks.find(ptr);
-    if(it==allocatedBlocks.end())
+    size_t base=reinterpret_cast<size_t>(poolBase);
+    size_t addr=reinterpret_cast<size_t>(ptr);
+    unsigned int order=allocatedOrder(ptr);
+    blockInfo[blockIndex(ptr)]=0;
+    freeBytes+=blockSize<<order;
+
+    //Merge with the buddy as long as it is free and of the same order
+    while(order+1<numOrders)
+    {
+        size_t buddy=addr ^ (static_cast<size_t>(blockSize)<<order);
+        if(buddy<base || buddy-base>=poolSize) break;
+        FreeBlock *buddyBlock=reinterpret_cast<FreeBlock*>(buddy);
+        if(blockInfo[blockIndex(buddyBlock)]!=((order+1) | freeFlag)) break;
+        removeFree(buddyBlock,order);
+        blockInfo[blockIndex(buddyBlock)]=0;
+        addr=min(addr,buddy);
+        order++;
+    }
+    insertFree(reinterpret_cast<FreeBlock*>(addr),order);
+}
+
+ProcessPool::Stats ProcessPool::getStats()
+{
     #ifndef TEST_ALLOC
-        errorHandler(UNEXPECTED);
-    #else //TEST_ALLOC
-        throw runtime_error("ProcessPool::deallocate corrupted pointer");
+    miosix::Lock<miosix::FastMutex> l(mutex);
     #endif //TEST_ALLOC
-    unsigned int size =(it->second)/blockSize;
-    unsigned int firstBit=(reinterpret_cast<unsigned int>(ptr)-
-                           reinterpret_cast<unsigned int>(poolBase))/blockSize;
-    for(unsigned int i=firstBit;i<firstBit+size;i++) clearBit(i);
-    allocatedBlocks.erase(it);
+    Stats result;
+    result.size=poolSize;
+    result.freeBytes=freeBytes;
+    result.largestFreeBlock=0;
+    for(int i=numOrders-1;i>=0;i--)
+    {
+        if(freeLists[i]==nullptr) continue;
+        result.largestFreeBlock=blockSize<<i;
+        break;
+    }
+    return result;
 }
 
 ProcessPool::ProcessPool(unsigned int *poolBase, unsigned int poolSize)
-    : poolBase(poolBase), poolSize(poolSize)
+    : poolBase(poolBase), poolSize(poolSize/blockSize*blockSize), freeBytes(0)
 {
-    int numBytes=poolSize/blockSize/8;
-    bitmap=new unsigned int[numBytes/sizeof(unsigned int)];
-    memset(bitmap,0,numBytes);
+    unsigned int numBlocks=this->poolSize/blockSize;
+    blockInfo=new unsigned char[numBlocks];
+    memset(blockInfo,0,numBlocks);
+    for(unsigned int i=0;i<numOrders;i++) freeLists[i]=nullptr;
+
+    //The pool needs not be aligned to its size, so split it in the largest
+    //blocks that are aligned to their size
+    size_t addr=reinterpret_cast<size_t>(poolBase);
+    size_t end=addr+this->poolSize;
+    while(addr<end)
+    {
+        unsigned int order=numOrders-1;
+        for(;;)
+        {
+            size_t size=static_cast<size_t>(blockSize)<<order;
+            if((addr & (size-1))==0 && addr+size<=end) break;
+            order--;
+        }
+        insertFree(reinterpret_cast<FreeBlock*>(addr),order);
+        freeBytes+=blockSize<<order;
+        addr+=static_cast<size_t>(blockSize)<<order;
+    }
 }
 
 ProcessPool::~ProcessPool()
 {
-    delete[] bitmap;
+    delete[] blockInfo;
+}
+
+unsigned int ProcessPool::blockIndex(void *block)
+{
+    return (reinterpret_cast<char*>(block)-
+            reinterpret_cast<char*>(poolBase))>>blockBits;
+}
+
+unsigned int ProcessPool::allocatedOrder(unsigned int *ptr)
+{
+    size_t base=reinterpret_cast<size_t>(poolBase);
+    size_t addr=reinterpret_cast<size_t>(ptr);
+    unsigned int info=0;
+    if(addr>=base && addr-base<poolSize && (addr & (blockSize-1))==0)
+        info=blockInfo[blockIndex(ptr)];
+    if(info==0 || (info & freeFlag))
+    #ifndef TEST_ALLOC
+        errorHandler(UNEXPECTED);
+    #else //TEST_ALLOC
+        throw runtime_error("ProcessPool corrupted pointer");
+    #endif //TEST_ALLOC
+    return info-1;
+}
+
+void ProcessPool::insertFree(FreeBlock *block, unsigned int order)
+{
+    block->prev=nullptr;
+    block->next=freeLists[order];
+    if(block->next) block->next->prev=block;
+    freeLists[order]=block;
+    blockInfo[blockIndex(block)]=(order+1) | freeFlag;
+}
+
+void ProcessPool::removeFree(FreeBlock *block, unsigned int order)
+{
+    if(block->prev) block->prev->next=block->next;
+    else freeLists[order]=block->next;
+    if(block->next) block->next->prev=block->prev;
 }
 
 } //namespace miosix
 
 #ifdef TEST_ALLOC
-//g++ -m32 -o pp -DTEST_ALLOC -DWITH_PROCESSES process_pool.cpp && ./pp
-int main()
+//g++ -O2 -o pp -DTEST_ALLOC -DWITH_PROCESSES process_pool.cpp && ./pp
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+/**
+ * Randomized test, allocates and deallocates blocks of random size checking
+ * that allocations are aligned, inside the pool and do not overlap
+ */
+static bool randomizedTest(miosix::ProcessPool& pool)
 {
     using namespace miosix;
-    ProcessPool& pool=ProcessPool::instance();
-    while(1)
+    const unsigned int size=pool.getStats().size;
+    vector<pair<unsigned int*,unsigned int>> allocs;
+    srand(42);
+    for(int i=0;i<100000;i++)
     {
-        cout<<"a<size(exponent)>|d<addr>"<<endl;
-        unsigned int param;
-        char op;
-        string line;
-        getline(cin,line);
-        stringstream ss(line);
-        ss>>op;
-        switch(op)
+        if(rand()%8==0 && allocs.empty()==false)
+        {
+            auto& a=allocs[rand()%allocs.size()];
+            unsigned int request=a.second<<(1+rand()%2);
+            unsigned int result=pool.extend(a.first,request);
+            if(result==0) continue;
+            size_t addr=reinterpret_cast<size_t>(a.first);
+            if(result!=request || addr % request)
+            {
+                cout<<"Bad extended size or alignment"<<endl;
+                return false;
+            }
+            for(auto& b : allocs)
+            {
+                size_t other=reinterpret_cast<size_t>(b.first);
+                if(b.first==a.first) continue;
+                if(addr+result<=other || other+b.second<=addr) continue;
+                cout<<"Extended allocation overlaps"<<endl;
+                return false;
+            }
+            a.second=result;
+        } else if(rand()%2 || allocs.empty()) {
+            unsigned int request=blockSize<<(rand()%7);
+            pair<unsigned int*,unsigned int> a;
+            try {
+                a=pool.allocate(request);
+            } catch(bad_alloc&) {
+                continue;
+            }
+            size_t addr=reinterpret_cast<size_t>(a.first);
+            if(a.second!=request || addr % request)
+            {
+                cout<<"Bad size or alignment"<<endl;
+                return false;
+            }
+            for(auto& b : allocs)
+            {
+                size_t other=reinterpret_cast<size_t>(b.first);
+                if(addr+a.second<=other || other+b.second<=addr) continue;
+                cout<<"Overlapping allocations"<<endl;
+                return false;
+            }
+            allocs.push_back(a);
+        } else {
+            int index=rand()%allocs.size();
+            auto a=allocs[index];
+            pool.deallocate(a.first);
+            allocs.erase(allocs.begin()+index);
+        }
+        unsigned int used=0;
+        for(auto& a : allocs) used+=a.second;
+        auto stats=pool.getStats();
+        if(stats.freeBytes!=size-used || stats.largestFreeBlock>stats.freeBytes)
         {
-            case 'a':
-                ss>>dec>>param;
-                try {
-                    pool.allocate(1<<param);
-                } catch(exception& e) {
-                    cout<<typeid(e).name();
-                }
-                pool.printAllocatedBlocks();
-                break;
-            case 'd':
-                ss>>hex>>param;
-                try {
-                    pool.deallocate(reinterpret_cast<unsigned int*>(param));
-                } catch(exception& e) {
-                    cout<<typeid(e).name();
-                }
-                pool.printAllocatedBlocks();
-                break;
-            default:
-                cout<<"Incorrect option"<<endl;
-                break;
+            cout<<"Inconsistent statistics"<<endl;
+            return false;
         }
     }
+    for(auto& a : allocs) pool.deallocate(a.first);
+    unsigned int *p=pool.allocate(blockSize).first;
+    for(unsigned int *bad : {p+1,p+blockSize/sizeof(unsigned int)})
+    {
+        try {
+            pool.deallocate(bad);
+            cout<<"Bad pointer not detected"<<endl;
+            return false;
+        } catch(runtime_error&) {}
+    }
+    pool.deallocate(p);
+    //The test pool is made of a 32K and a 64K block
+    auto stats=pool.getStats();
+    if(stats.freeBytes!=size || stats.largestFreeBlock!=size*2/3)
+    {
+        cout<<"Free blocks not merged"<<endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Measure the time of allocate/deallocate pairs with a fragmented pool
+ */
+static void benchmark(miosix::ProcessPool& pool)
+{
+    using namespace miosix;
+    using namespace std::chrono;
+    //Fragment the pool leaving every other minimum size block allocated
+    vector<unsigned int*> all, kept;
+    try {
+        for(;;) all.push_back(pool.allocate(blockSize).first);
+    } catch(bad_alloc&) {}
+    for(unsigned int i=0;i<all.size();i++)
+    {
+        if(i % 2) pool.deallocate(all[i]);
+        else kept.push_back(all[i]);
+    }
+    const int iterations=1000000;
+    auto start=steady_clock::now();
+    for(int i=0;i<iterations;i++) pool.deallocate(pool.allocate(blockSize).first);
+    auto end=steady_clock::now();
+    cout<<"allocate+deallocate: "
+        <<duration_cast<nanoseconds>(end-start).count()/iterations<<"ns"<<endl;
+    for(auto p : kept) pool.deallocate(p);
+}
+
+int main()
+{
+    using namespace miosix;
+    ProcessPool& pool=ProcessPool::instance();
+    if(randomizedTest(pool)==false) return 1;
+    cout<<"Test passed"<<endl;
+    benchmark(pool);
+    return 0;
 }
 #endif //TEST_ALLOC
 
@@ -27,15 +27,10 @@
 
 #pragma once
 
-#include <map>
 #include <utility>
 
 #ifndef TEST_ALLOC
 #include <miosix.h>
-#else //TEST_ALLOC
-#include <iostream>
-#include <typeinfo>
-#include <sstream>
 #endif //TEST_ALLOC
 
 #ifdef WITH_PROCESSES
@@ -45,10 +40,27 @@ namespace miosix {
 /**
  * This class allows to handle a memory area reserved for the allocation of
  * processes' images. This memory area is called process pool.
+ *
+ * The pool is managed as a buddy allocator, since the memory protection unit
+ * requires blocks whose size is a power of two and that are aligned to their
+ * size. Free blocks are kept in one list per size, and the size of allocated
+ * blocks is stored in a flat array with one entry for every minimum size
+ * block, so that allocate and deallocate take O(log n) time and do not
+ * allocate memory.
  */
 class ProcessPool
 {
 public:
+    /**
+     * Struct used to return the process pool statistics
+     */
+    struct Stats
+    {
+        unsigned int size;             ///< Size of the pool in bytes
+        unsigned int freeBytes;        ///< Bytes not allocated
+        unsigned int largestFreeBlock; ///< Largest block that can be allocated
+    };
+
     /**
      * \return an instance of the process pool (singleton)
      */
@@ -68,44 +80,30 @@ public:
      */
     std::pair<unsigned int *, unsigned int> allocate(unsigned int size);
     
+    /**
+     * Grow a memory block in place, by merging it with the following blocks
+     * if they are free. This is possible only if the block is aligned to the
+     * new size.
+     * \param ptr pointer to a block previously allocated
+     * \param size requested size in bytes
+     * \return the new size of the block, which could be greater or equal
+     * than the requested size, or 0 if the block could not be grown. If the
+     * block is already large enough, its size is returned
+     * \throws runtime_error if the pointer is invalid
+     */
+    unsigned int extend(unsigned int *ptr, unsigned int size);
+
     /**
      * Deallocate a memory block.
      * \param ptr pointer to deallocate.
      * \throws runtime_error if the pointer is invalid
      */
     void deallocate(unsigned int *ptr);
-    
-    #ifdef TEST_ALLOC
+
     /**
-     * Print the state of the allocator, used for debugging
+     * \return the process pool statistics
      */
-    void printAllocatedBlocks()
-    {
-        using namespace std;
-        map<unsigned int*, unsigned int>::iterator it;
-        cout<<endl;
-        for(it=allocatedBlocks.begin();it!=allocatedBlocks.end();it++)
-            cout <<"block of size " << it->second
-                 << " allocated @ " << it->first<<endl;
-        
-        cout<<"Bitmap:"<<endl;
-        const int SHIFT = 8 * sizeof(unsigned int);
-        const unsigned int MASK = 1 << (SHIFT-1);
-        int bitarray[32];
-        for(int i=0; i<(poolSize/blockSize)/(sizeof(unsigned int)*8);i++)
-        {   
-            int value=bitmap[i];
-            for ( int j = 0; j < SHIFT; j++ ) 
-            {
-                bitarray[31-j]= ( value & MASK ? 1 : 0 );
-                value <<= 1;
-            }
-            for(int j=0;j<32;j++)
-                cout<<bitarray[j];
-            cout << endl;
-        }  
-    }
-    #endif //TEST_ALLOC
+    Stats getStats();
     
 private:
     ProcessPool(const ProcessPool&);
@@ -122,40 +120,51 @@ private:
      * Destructor
      */
     ~ProcessPool();
-    
+
     /**
-     * \param bit bit to test, from 0 to poolSize/blockSize
-     * \return true if the bit is set
+     * Free blocks are linked through their first bytes
      */
-    bool testBit(unsigned int bit)
+    struct FreeBlock
     {
-        return (bitmap[bit/(sizeof(unsigned int)*8)] &
-            1<<(bit % (sizeof(unsigned int)*8))) ? true : false;
-    }
-    
+        FreeBlock *next;
+        FreeBlock *prev;
+    };
+
     /**
-     * \param bit bit to set, from 0 to poolSize/blockSize
+     * \param block a block
+     * \return the index of the block in blockInfo
      */
-    void setBit(unsigned int bit)
-    {
-        bitmap[(bit/(sizeof(unsigned int)*8))] |= 
-            1<<(bit % (sizeof(unsigned int)*8));
-    }
-    
+    unsigned int blockIndex(void *block);
+
     /**
-     * \param bit bit to clear, from 0 to poolSize/blockSize
+     * \param ptr pointer to an allocated block
+     * \return the order of the block
+     * \throws runtime_error if the pointer is invalid
      */
-    void clearBit(unsigned int bit)
-    {
-        bitmap[bit/(sizeof(unsigned int)*8)] &= 
-            ~(1<<(bit % (sizeof(unsigned int)*8)));
-    }
-    
-    unsigned int *bitmap;   ///< Pointer to the status of the allocator
+    unsigned int allocatedOrder(unsigned int *ptr);
+
+    /**
+     * Add a free block to the list of its order
+     */
+    void insertFree(FreeBlock *block, unsigned int order);
+
+    /**
+     * Remove a free block from the list of its order
+     */
+    void removeFree(FreeBlock *block, unsigned int order);
+
+    ///Number of block orders, enough for blocks up to 2GB
+    static const unsigned int numOrders=22;
+    ///Flag set in blockInfo for free blocks
+    static const unsigned char freeFlag=0x80;
+
+    ///One entry per minimum size block, zero if the block is part of a larger
+    ///block, or the block order plus one, or-ed with freeFlag if free
+    unsigned char *blockInfo;
+    FreeBlock *freeLists[numOrders]; ///< One list of free blocks per order
     unsigned int *poolBase; ///< Base address of the entire pool
     unsigned int poolSize;  ///< Size of the pool, in bytes
-    ///Lists all allocated blocks, allows to retrieve their sizes
-    std::map<unsigned int*,unsigned int> allocatedBlocks;
+    unsigned int freeBytes; ///< Bytes not allocated
     #ifndef TEST_ALLOC
     miosix::FastMutex mutex; ///< Mutex to guard concurrent access
     #endif //TEST_ALLOC
@@ -244,6 +244,7 @@ int pthread_mutex_destroy(pthread_mutex_t *mutex)
 
 int pthread_mutex_lock(pthread_mutex_t *mutex)
 {
+    if(fastMutexLock(mutex)) return 0;
     FastInterruptDisableLock dLock;
     IRQdoMutexLock(mutex,dLock);
     return 0;
@@ -251,6 +252,7 @@ int pthread_mutex_lock(pthread_mutex_t *mutex)
 
 int pthread_mutex_trylock(pthread_mutex_t *mutex)
 {
+    if(fastMutexLock(mutex)) return 0;
     FastInterruptDisableLock dLock;
     void *p=reinterpret_cast<void*>(Thread::IRQgetCurrentThread());
     if(mutex->owner==0)
@@ -268,6 +270,7 @@ int pthread_mutex_trylock(pthread_mutex_t *mutex)
 
 int pthread_mutex_unlock(pthread_mutex_t *mutex)
 {
+    if(fastMutexUnlock(mutex)) return 0;
     #ifndef SCHED_TYPE_EDF
     FastInterruptDisableLock dLock;
     IRQdoMutexUnlock(mutex);
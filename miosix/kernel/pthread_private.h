@@ -34,9 +34,69 @@
 #include "kernel.h"
 #include "intrusive.h"
 #include "sync.h"
+#include "interfaces/arch_registers.h"
+#include "trace.h"
 
 namespace miosix {
 
+//On architectures with LDREX/STREX, mutexes are locked and unlocked without
+//disabling interrupts if there is no contention. A context switch clears the
+//exclusive monitor, so any code between LDREX and STREX executes atomically
+//with respect to the IRQdoMutex* functions, that run with interrupts disabled.
+//Cortex-M0 does not have LDREX/STREX, so it always uses the slow path.
+#if defined(__CORTEX_M) && (__CORTEX_M!=0x00)
+
+/**
+ * \internal
+ * Lock a mutex if it is free, without disabling interrupts.
+ * \param mutex mutex to be locked
+ * \return true if the mutex was locked, false if it was already locked or
+ * the attempt was interrupted, so the caller needs to use IRQdoMutexLock()
+ */
+static inline bool fastMutexLock(pthread_mutex_t *mutex)
+{
+    volatile uint32_t *owner=reinterpret_cast<volatile uint32_t*>(&mutex->owner);
+    if(__LDREXW(owner)!=0)
+    {
+        __CLREX();
+        return false;
+    }
+    auto p=reinterpret_cast<uint32_t>(Thread::getCurrentThread());
+    if(__STREXW(p,owner)) return false;
+    asm volatile("":::"memory");
+    return true;
+}
+
+/**
+ * \internal
+ * Unlock a mutex without disabling interrupts, if it has no waiting threads
+ * and it is not locked recursively.
+ * \param mutex mutex to unlock
+ * \return true if the mutex was unlocked, false if the caller needs to use
+ * IRQdoMutexUnlock()
+ */
+static inline bool fastMutexUnlock(pthread_mutex_t *mutex)
+{
+    volatile uint32_t *owner=reinterpret_cast<volatile uint32_t*>(&mutex->owner);
+    __LDREXW(owner);
+    //Also prevents the compiler from moving the critical section past STREX
+    asm volatile("":::"memory");
+    if(mutex->first!=nullptr || mutex->recursive>0)
+    {
+        __CLREX();
+        return false;
+    }
+    return __STREXW(0,owner)==0;
+}
+
+#else //__CORTEX_M
+
+static inline bool fastMutexLock(pthread_mutex_t *mutex) { return false; }
+
+static inline bool fastMutexUnlock(pthread_mutex_t *mutex) { return false; }
+
+#endif //__CORTEX_M
+
 /**
  * \internal
  * Implementation code to lock a mutex. Must be called with interrupts disabled
@@ -78,7 +138,13 @@ static inline void IRQdoMutexLock(pthread_mutex_t *mutex,
     }
 
     //The while is necessary to protect against spurious wakeups
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::IRQrecord(TraceEvent::MutexBlock,mutex);
+    #endif //WITH_KERNEL_TRACE
     while(mutex->owner!=p) Thread::IRQenableIrqAndWait(d);
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::IRQrecord(TraceEvent::MutexUnblock,mutex);
+    #endif //WITH_KERNEL_TRACE
 }
 
 /**
@@ -128,7 +194,13 @@ static inline void IRQdoMutexLockToDepth(pthread_mutex_t *mutex,
     }
 
     //The while is necessary to protect against spurious wakeups
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::IRQrecord(TraceEvent::MutexBlock,mutex);
+    #endif //WITH_KERNEL_TRACE
     while(mutex->owner!=p) Thread::IRQenableIrqAndWait(d);
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::IRQrecord(TraceEvent::MutexUnblock,mutex);
+    #endif //WITH_KERNEL_TRACE
     if(mutex->recursive>=0) mutex->recursive=depth;
 }
 
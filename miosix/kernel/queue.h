@@ -29,6 +29,7 @@
 
 #include "kernel.h"
 #include "error.h"
+#include "trace.h"
 
 namespace miosix {
 
@@ -277,7 +278,13 @@ void QueueBase<T,BufferT>::put(const T& elem)
     while(IRQput(elem)==false)
     {
         waiting=Thread::IRQgetCurrentThread();
+        #ifdef WITH_KERNEL_TRACE
+        KernelTrace::IRQrecord(TraceEvent::QueueBlock,this);
+        #endif //WITH_KERNEL_TRACE
         Thread::IRQenableIrqAndWait(dLock);
+        #ifdef WITH_KERNEL_TRACE
+        KernelTrace::IRQrecord(TraceEvent::QueueUnblock,this);
+        #endif //WITH_KERNEL_TRACE
     }
 }
 
@@ -287,7 +294,13 @@ void QueueBase<T,BufferT>::IRQputBlocking(const T& elem, FastInterruptDisableLoc
     while(IRQput(elem)==false)
     {
         waiting=Thread::IRQgetCurrentThread();
+        #ifdef WITH_KERNEL_TRACE
+        KernelTrace::IRQrecord(TraceEvent::QueueBlock,this);
+        #endif //WITH_KERNEL_TRACE
         Thread::IRQenableIrqAndWait(dLock);
+        #ifdef WITH_KERNEL_TRACE
+        KernelTrace::IRQrecord(TraceEvent::QueueUnblock,this);
+        #endif //WITH_KERNEL_TRACE
     }
 }
 
@@ -298,7 +311,13 @@ void QueueBase<T,BufferT>::get(T& elem)
     while(IRQget(elem)==false)
     {
         waiting=Thread::IRQgetCurrentThread();
+        #ifdef WITH_KERNEL_TRACE
+        KernelTrace::IRQrecord(TraceEvent::QueueBlock,this);
+        #endif //WITH_KERNEL_TRACE
         Thread::IRQenableIrqAndWait(dLock);
+        #ifdef WITH_KERNEL_TRACE
+        KernelTrace::IRQrecord(TraceEvent::QueueUnblock,this);
+        #endif //WITH_KERNEL_TRACE
     }
 }
 
@@ -308,7 +327,13 @@ void QueueBase<T,BufferT>::IRQgetBlocking(T& elem, FastInterruptDisableLock& dLo
     while(IRQget(elem)==false)
     {
         waiting=Thread::IRQgetCurrentThread();
+        #ifdef WITH_KERNEL_TRACE
+        KernelTrace::IRQrecord(TraceEvent::QueueBlock,this);
+        #endif //WITH_KERNEL_TRACE
         Thread::IRQenableIrqAndWait(dLock);
+        #ifdef WITH_KERNEL_TRACE
+        KernelTrace::IRQrecord(TraceEvent::QueueUnblock,this);
+        #endif //WITH_KERNEL_TRACE
     }
 }
 
@@ -41,7 +41,7 @@ namespace miosix {
 extern volatile Thread *runningThread;
 extern volatile int kernelRunning;
 extern volatile bool pendingWakeup;
-extern IntrusiveList<SleepData> sleepingList;
+extern IntrusivePriorityQueue<SleepData> sleepingList;
 
 //Internal
 static long long burstStart=0;
@@ -125,9 +125,7 @@ void ControlScheduler::PKremoveDeadThreads()
             threadListSize--;
             SP_Tr-=bNominal; //One thread less, reduce round time
         }
-        void *base=toBeDeleted->watermark;
-        toBeDeleted->~Thread();
-        free(base); //Delete ALL thread memory
+        Thread::destroy(toBeDeleted);
     }
     if(threadList!=nullptr)
     {
@@ -142,9 +140,7 @@ void ControlScheduler::PKremoveDeadThreads()
                 threadListSize--;
                 SP_Tr-=bNominal; //One thread less, reduce round time
             }
-            void *base=toBeDeleted->watermark;
-            toBeDeleted->~Thread();
-            free(base); //Delete ALL thread memory
+            Thread::destroy(toBeDeleted);
         }
     }
     {
@@ -542,9 +538,7 @@ void ControlScheduler::PKremoveDeadThreads()
             threadListSize--;
             SP_Tr-=bNominal; //One thread less, reduce round time
         }
-        void *base=toBeDeleted->watermark;
-        toBeDeleted->~Thread();
-        free(base); //Delete ALL thread memory
+        Thread::destroy(toBeDeleted);
     }
     if(threadList!=nullptr)
     {
@@ -559,9 +553,7 @@ void ControlScheduler::PKremoveDeadThreads()
                 threadListSize--;
                 SP_Tr-=bNominal; //One thread less, reduce round time
             }
-            void *base=toBeDeleted->watermark;
-            toBeDeleted->~Thread();
-            free(base); //Delete ALL thread memory
+            Thread::destroy(toBeDeleted);
         }
     }
     {
@@ -41,7 +41,7 @@ namespace miosix {
 extern volatile Thread *runningThread;
 extern volatile int kernelRunning;
 extern volatile bool pendingWakeup;
-extern IntrusiveList<SleepData> sleepingList;
+extern IntrusivePriorityQueue<SleepData> sleepingList;
 
 //Static members
 static long long nextPreemption=numeric_limits<long long>::max();
@@ -53,62 +53,94 @@ static long long nextPreemption=numeric_limits<long long>::max();
 bool EDFScheduler::PKaddThread(Thread *thread, EDFSchedulerPriority priority)
 {
     thread->schedData.deadline=priority;
-    add(thread);
+    thread->schedData.thread=thread;
+    {
+        //Note: can't use FastInterruptDisableLock here since this code is
+        //also called *before* the kernel is started.
+        //Using FastInterruptDisableLock would enable interrupts prematurely
+        //and cause all sorts of misterious crashes
+        InterruptDisableLock dLock;
+        thread->schedData.jobStart=IRQgetTime();
+        thread->schedData.next=threadList;
+        threadList=thread;
+        if(thread->flags.isReady()) IRQaddToReadyQueue(thread);
+    }
     return true;
 }
 
 bool EDFScheduler::PKexists(Thread *thread)
 {
-    Thread *walk=head;
-    while(walk!=nullptr)
+    for(Thread *it=threadList;it!=nullptr;it=it->schedData.next)
     {
-        if(walk==thread && (!walk->flags.isDeleted())) return true;
-        walk=walk->schedData.next;
+        if(it==thread) return !it->flags.isDeleted();
     }
     return false;
 }
 
 void EDFScheduler::PKremoveDeadThreads()
 {
-    //Delete all threads at the beginning of the list
-    for(;;)
+    //Deleted threads are not ready, so they have already been removed from
+    //the ready queue by IRQwaitStatusHook(), and IRQfindNextThread() does not
+    //access threadList, so there's no need to disable interrupts here
+    //Special case, threads at the head of the list. The idle thread is never
+    //deleted, so the list can't become empty
+    while(threadList->flags.isDeleted())
     {
-        if(head==nullptr) errorHandler(UNEXPECTED); //Empty list is wrong.
-        if(head->flags.isDeleted()==false) break;
-        Thread *toBeDeleted=head;
-        head=head->schedData.next;
-        void *base=toBeDeleted->watermark;
-        toBeDeleted->~Thread();
-        free(base); //Delete ALL thread memory
+        Thread *toBeDeleted=threadList;
+        threadList=threadList->schedData.next;
+        Thread::destroy(toBeDeleted);
     }
-    //When we get here this->head is not null and does not need to be deleted
-    Thread *walk=head;
-    for(;;)
+    //General case, delete threads not at the head of the list
+    for(Thread *it=threadList;it->schedData.next!=nullptr;)
     {
-        if(walk->schedData.next==nullptr) break;
-        if(walk->schedData.next->flags.isDeleted())
+        if(it->schedData.next->flags.isDeleted()==false)
         {
-            Thread *toBeDeleted=walk->schedData.next;
-            walk->schedData.next=walk->schedData.next->schedData.next;
-            void *base=toBeDeleted->watermark;
-            toBeDeleted->~Thread();
-            free(base); //Delete ALL thread memory
-        } else walk=walk->schedData.next;
+            it=it->schedData.next;
+            continue;
+        }
+        Thread *toBeDeleted=it->schedData.next;
+        it->schedData.next=toBeDeleted->schedData.next;
+        Thread::destroy(toBeDeleted);
     }
 }
 
 void EDFScheduler::PKsetPriority(Thread *thread,
         EDFSchedulerPriority newPriority)
 {
-    remove(thread);
+    //The ready queue is also modified by interrupts, see IRQwaitStatusHook()
+    FastInterruptDisableLock dLock;
+    bool ready=thread->schedData.lastReadyStatus;
+    if(ready) IRQremoveFromReadyQueue(thread);
     thread->schedData.deadline=newPriority;
-    add(thread);
+    if(ready) IRQaddToReadyQueue(thread);
+}
+
+void EDFScheduler::PKendOfJob(Thread *thread, EDFSchedulerPriority oldDeadline)
+{
+    long long now=getTime();
+    long long deadline=oldDeadline.get();
+    if(deadline<now && deadline>=thread->schedData.jobStart)
+        thread->schedData.deadlineMisses++;
+    thread->schedData.jobStart=now;
 }
 
 void EDFScheduler::IRQsetIdleThread(Thread *idleThread)
 {
     idleThread->schedData.deadline=numeric_limits<long long>::max()-1;
-    add(idleThread);
+    idleThread->schedData.thread=idleThread;
+    idleThread->schedData.next=threadList;
+    threadList=idleThread;
+    IRQaddToReadyQueue(idleThread);
+}
+
+void EDFScheduler::IRQwaitStatusHook(Thread *t)
+{
+    if(t->flags.isReady())
+    {
+        if(t->schedData.lastReadyStatus==false) IRQaddToReadyQueue(t);
+    } else {
+        if(t->schedData.lastReadyStatus) IRQremoveFromReadyQueue(t);
+    }
 }
 
 long long EDFScheduler::IRQgetNextPreemption()
@@ -137,87 +169,45 @@ void EDFScheduler::IRQfindNextThread()
     #ifdef WITH_CPU_TIME_COUNTER
     Thread *prev=const_cast<Thread*>(runningThread);
     #endif // WITH_CPU_TIME_COUNTER
-    Thread *walk=head;
-    for(;;)
+    //The first item is the ready thread with the earliest deadline. The idle
+    //thread is always ready, so the queue is never empty
+    Thread *next=readyQueue.front()->thread;
+    runningThread=next;
+    #ifdef WITH_PROCESSES
+    if(const_cast<Thread*>(runningThread)->flags.isInUserspace()==false)
     {
-        if(walk==nullptr) errorHandler(UNEXPECTED);
-        if(walk->flags.isReady())
-        {
-            runningThread=walk;
-            #ifdef WITH_PROCESSES
-            if(const_cast<Thread*>(runningThread)->flags.isInUserspace()==false)
-            {
-                ctxsave=runningThread->ctxsave;
-                MPUConfiguration::IRQdisable();
-            } else {
-                ctxsave=runningThread->userCtxsave;
-                //A kernel thread is never in userspace, so the cast is safe
-                static_cast<Process*>(runningThread->proc)->mpu.IRQenable();
-            }
-            #else //WITH_PROCESSES
-            ctxsave=runningThread->ctxsave;
-            #endif //WITH_PROCESSES
-            IRQsetNextPreemption();
-            #ifdef WITH_CPU_TIME_COUNTER
-            IRQprofileContextSwitch(prev->timeCounterData,walk->timeCounterData,
-                                    IRQgetTime());
-            #endif //WITH_CPU_TIME_COUNTER
-            return;
-        }
-        walk=walk->schedData.next;
+        ctxsave=runningThread->ctxsave;
+        MPUConfiguration::IRQdisable();
+    } else {
+        ctxsave=runningThread->userCtxsave;
+        //A kernel thread is never in userspace, so the cast is safe
+        static_cast<Process*>(runningThread->proc)->mpu.IRQenable();
     }
+    #else //WITH_PROCESSES
+    ctxsave=runningThread->ctxsave;
+    #endif //WITH_PROCESSES
+    IRQsetNextPreemption();
+    #ifdef WITH_CPU_TIME_COUNTER
+    IRQprofileContextSwitch(prev->timeCounterData,next->timeCounterData,
+                            IRQgetTime());
+    #endif //WITH_CPU_TIME_COUNTER
 }
 
-void EDFScheduler::add(Thread *thread)
+void EDFScheduler::IRQaddToReadyQueue(Thread *thread)
 {
-    long long newDeadline=thread->schedData.deadline.get();
-    if(head==nullptr)
-    {
-        head=thread;
-        return;
-    }
-    if(newDeadline<=head->schedData.deadline.get())
-    {
-        thread->schedData.next=head;
-        head=thread;
-        return;
-    }
-    Thread *walk=head;
-    for(;;)
-    {
-        if(walk->schedData.next==nullptr || newDeadline<=
-           walk->schedData.next->schedData.deadline.get())
-        {
-            thread->schedData.next=walk->schedData.next;
-            walk->schedData.next=thread;
-            break;
-        }
-        walk=walk->schedData.next;
-    }
+    thread->schedData.lastReadyStatus=true;
+    readyQueue.push(&thread->schedData);
 }
 
-void EDFScheduler::remove(Thread *thread)
+void EDFScheduler::IRQremoveFromReadyQueue(Thread *thread)
 {
-    if(head==nullptr) errorHandler(UNEXPECTED);
-    if(head==thread)
-    {
-        head=head->schedData.next;
-        return;
-    }
-    Thread *walk=head;
-    for(;;)
-    {
-        if(walk->schedData.next==nullptr) errorHandler(UNEXPECTED);
-        if(walk->schedData.next==thread)
-        {
-            walk->schedData.next=walk->schedData.next->schedData.next;
-            break;
-        }
-        walk=walk->schedData.next;
-    }
+    thread->schedData.lastReadyStatus=false;
+    readyQueue.removeFast(&thread->schedData);
 }
 
-Thread *EDFScheduler::head=nullptr;
+Thread *EDFScheduler::threadList=nullptr;
+IntrusivePriorityQueue<EDFSchedulerData,EDFDeadlineCompare>
+    EDFScheduler::readyQueue;
 
 } //namespace miosix
 
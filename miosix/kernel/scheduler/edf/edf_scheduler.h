@@ -83,6 +83,29 @@ public:
      */
     static void PKsetPriority(Thread *thread, EDFSchedulerPriority newPriority);
 
+    /**
+     * \internal
+     * Called by Thread::setPriority() when a thread sets itself a new deadline,
+     * which marks the end of its current job. If the job finished after the
+     * deadline, the thread deadline miss count is incremented. Deadlines that
+     * were already in the past when they were set are not counted.
+     * \param thread the thread, must be the currently running thread
+     * \param oldDeadline the deadline of the job that just finished. If the
+     * thread has inherited a deadline through a mutex this is still its own
+     * deadline.
+     */
+    static void PKendOfJob(Thread *thread, EDFSchedulerPriority oldDeadline);
+
+    /**
+     * \internal
+     * \param thread thread whose deadline miss count needs to be queried
+     * \return the number of times the thread missed its deadline
+     */
+    static unsigned int getDeadlineMisses(Thread *thread)
+    {
+        return thread->schedData.deadlineMisses;
+    }
+
     /**
      * \internal
      * Get the priority of a thread. Must be callable also with kernel paused
@@ -110,7 +133,7 @@ public:
      * its running status. For example when a thread become sleeping, waiting,
      * deleted or if it exits the sleeping or waiting status
      */
-    static void IRQwaitStatusHook(Thread *t) {}
+    static void IRQwaitStatusHook(Thread *t);
 
     /**
      * This function is used to develop interrupt driven peripheral drivers.<br>
@@ -135,18 +158,25 @@ public:
     
 private:
     /**
-     * Add a thread to the list of threads, keeping the list ordered by deadline
-     * \param thread thread to add
+     * \internal
+     * Add a thread to the ready queue, O(log(n)).
+     * Can only be called with interrupts disabled or within an interrupt.
      */
-    static void add(Thread *thread);
+    static void IRQaddToReadyQueue(Thread *thread);
 
     /**
-     * Remove a thread to the list of threads.
-     * \param thread thread to remove
+     * \internal
+     * Remove a thread from the ready queue, O(log(n)).
+     * Can only be called with interrupts disabled or within an interrupt.
      */
-    static void remove(Thread *thread);
+    static void IRQremoveFromReadyQueue(Thread *thread);
+
+    ///\internal List of all threads, including the idle thread
+    static Thread *threadList;
 
-    static Thread *head;///<\internal Head of threads list, ordered by deadline
+    ///\internal Ready threads, ordered by deadline. The idle thread is always
+    ///ready, so the queue is never empty once the kernel is started
+    static IntrusivePriorityQueue<EDFSchedulerData,EDFDeadlineCompare> readyQueue;
 };
 
 } //namespace miosix
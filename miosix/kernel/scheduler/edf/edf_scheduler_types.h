@@ -28,6 +28,7 @@
 #pragma once
 
 #include "config/miosix_settings.h"
+#include "kernel/intrusive.h"
 #include <limits>
 
 #ifdef SCHED_TYPE_EDF
@@ -135,11 +136,27 @@ inline bool operator!=(EDFSchedulerPriority a, EDFSchedulerPriority b)
  * An instance of this class is embedded in every Thread class. It contains all
  * the per-thread data required by the scheduler.
  */
-class EDFSchedulerData
+class EDFSchedulerData : public IntrusivePriorityQueueItem
 {
 public:
     EDFSchedulerPriority deadline; ///<\internal thread deadline
-    Thread *next=nullptr; ///<\internal list of threads, ordered by deadline
+    Thread *thread=nullptr; ///<\internal thread this data belongs to
+    Thread *next=nullptr; ///<\internal list of all threads
+    long long jobStart=0; ///<\internal time the current deadline was set
+    unsigned int deadlineMisses=0; ///<\internal number of missed deadlines
+    bool lastReadyStatus=false; ///<\internal true if in the ready queue
+};
+
+/**
+ * \internal
+ * Comparison functor that sorts the EDF ready queue by deadline
+ */
+struct EDFDeadlineCompare
+{
+    bool operator()(const EDFSchedulerData& a, const EDFSchedulerData& b) const
+    {
+        return a.deadline.get()<b.deadline.get();
+    }
 };
 
 } //namespace miosix
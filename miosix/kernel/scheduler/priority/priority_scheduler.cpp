@@ -38,11 +38,13 @@ namespace miosix {
 extern volatile Thread *runningThread;
 extern volatile int kernelRunning;
 extern volatile bool pendingWakeup;
-extern IntrusiveList<SleepData> sleepingList;
+extern IntrusivePriorityQueue<SleepData> sleepingList;
 
 //Internal data
 static long long nextPeriodicPreemption=std::numeric_limits<long long>::max();
 
+static_assert(PRIORITY_MAX<=32,"readyBitmap can't hold more than 32 priorities");
+
 //
 // class PriorityScheduler
 //
@@ -51,146 +53,65 @@ bool PriorityScheduler::PKaddThread(Thread *thread,
         PrioritySchedulerPriority priority)
 {
     thread->schedData.priority=priority;
-    if(threadList[priority.get()]==nullptr)
+    thread->schedData.rlEntry.t=thread;
     {
-        threadList[priority.get()]=thread;
-        thread->schedData.next=thread;//Circular list
-    } else {
-        thread->schedData.next=threadList[priority.get()]->schedData.next;
-        threadList[priority.get()]->schedData.next=thread;
+        //Note: can't use FastInterruptDisableLock here since this code is
+        //also called *before* the kernel is started.
+        //Using FastInterruptDisableLock would enable interrupts prematurely
+        //and cause all sorts of misterious crashes
+        InterruptDisableLock dLock;
+        thread->schedData.next=threadList;
+        threadList=thread;
+        if(thread->flags.isReady()) IRQaddToReadyList(thread);
     }
     return true;
 }
 
 bool PriorityScheduler::PKexists(Thread *thread)
 {
-    for(int i=PRIORITY_MAX-1;i>=0;i--)
+    for(Thread *it=threadList;it!=nullptr;it=it->schedData.next)
     {
-        if(threadList[i]==nullptr) continue;
-        Thread *temp=threadList[i];
-        for(;;)
-        {
-            if((temp==thread) && (!temp->flags.isDeleted())) return true;
-            temp=temp->schedData.next;
-            if(temp==threadList[i]) break;
-        }
+        if(it==thread) return !it->flags.isDeleted();
     }
     return false;
 }
 
 void PriorityScheduler::PKremoveDeadThreads()
 {
-    for(int i=PRIORITY_MAX-1;i>=0;i--)
+    //Deleted threads are not ready, so they have already been removed from
+    //the ready lists by IRQwaitStatusHook(), and IRQfindNextThread() does not
+    //access threadList, so there's no need to disable interrupts here
+    //Special case, threads at the head of the list
+    while(threadList!=nullptr && threadList->flags.isDeleted())
     {
-        if(threadList[i]==nullptr) continue;
-        bool first=false;//If false the tail of the list hasn't been calculated
-        Thread *tail=nullptr;//Tail of the list
-        //Special case: removing first element in the list
-        while(threadList[i]->flags.isDeleted())
-        {
-            if(threadList[i]->schedData.next==threadList[i])
-            {
-                //Only one element in the list
-                //Call destructor manually because of placement new
-                void *base=threadList[i]->watermark;
-                threadList[i]->~Thread();
-                free(base); //Delete ALL thread memory
-                threadList[i]=nullptr;
-                break;
-            }
-            //If it is the first time the tail of the list hasn't
-            //been calculated
-            if(first==false)
-            {
-                first=true;
-                tail=threadList[i];
-                while(tail->schedData.next!=threadList[i])
-                    tail=tail->schedData.next;
-            }
-            Thread *d=threadList[i];//Save a pointer to the thread
-            threadList[i]=threadList[i]->schedData.next;//Remove from list
-            //Fix the tail of the circular list
-            tail->schedData.next=threadList[i];
-            //Call destructor manually because of placement new
-            void *base=d->watermark;
-            d->~Thread();
-            free(base);//Delete ALL thread memory
-        }
-        if(threadList[i]==nullptr) continue;
-        //If it comes here, the first item is not nullptr, and doesn't have
-        //to be deleted General case: removing items not at the first
-        //place
-        Thread *temp=threadList[i];
-        for(;;)
+        Thread *toBeDeleted=threadList;
+        threadList=threadList->schedData.next;
+        Thread::destroy(toBeDeleted);
+    }
+    if(threadList==nullptr) return;
+    //General case, delete threads not at the head of the list
+    for(Thread *it=threadList;it->schedData.next!=nullptr;)
+    {
+        if(it->schedData.next->flags.isDeleted()==false)
         {
-            if(temp->schedData.next==threadList[i]) break;
-            if(temp->schedData.next->flags.isDeleted())
-            {
-                Thread *d=temp->schedData.next;//Save a pointer to the thread
-                //Remove from list
-                temp->schedData.next=temp->schedData.next->schedData.next;
-                //Call destructor manually because of placement new
-                void *base=d->watermark;
-                d->~Thread();
-                free(base);//Delete ALL thread memory
-            } else temp=temp->schedData.next;
+            it=it->schedData.next;
+            continue;
         }
+        Thread *toBeDeleted=it->schedData.next;
+        it->schedData.next=toBeDeleted->schedData.next;
+        Thread::destroy(toBeDeleted);
     }
 }
 
 void PriorityScheduler::PKsetPriority(Thread *thread,
         PrioritySchedulerPriority newPriority)
 {
-    PrioritySchedulerPriority oldPriority=thread->PKgetPriority();
-    //First set priority to the new value
+    //The ready lists are also modified by interrupts, see IRQwaitStatusHook()
+    FastInterruptDisableLock dLock;
+    bool ready=thread->schedData.lastReadyStatus;
+    if(ready) IRQremoveFromReadyList(thread);
     thread->schedData.priority=newPriority;
-    //Then remove the thread from its old list
-    if(threadList[oldPriority.get()]==thread)
-    {
-        if(threadList[oldPriority.get()]->schedData.next==
-                threadList[oldPriority.get()])
-        {
-            //Only one element in the list
-            threadList[oldPriority.get()]=nullptr;
-        } else {
-            Thread *tail=threadList[oldPriority.get()];//Tail of the list
-            while(tail->schedData.next!=threadList[oldPriority.get()])
-                tail=tail->schedData.next;
-            //Remove
-            threadList[oldPriority.get()]=
-                    threadList[oldPriority.get()]->schedData.next;
-            //Fix tail of the circular list
-            tail->schedData.next=threadList[oldPriority.get()];
-        }
-    } else {
-        //If it comes here, the first item doesn't have to be removed
-        //General case: removing item not at the first place
-        Thread *temp=threadList[oldPriority.get()];
-        for(;;)
-        {
-            if(temp->schedData.next==threadList[oldPriority.get()])
-            {
-                //After walking all elements in the list the thread wasn't found
-                //This should never happen
-                errorHandler(UNEXPECTED);
-            }
-            if(temp->schedData.next==thread)
-            {
-                //Remove from list
-                temp->schedData.next=temp->schedData.next->schedData.next;
-                break;
-            } else temp=temp->schedData.next;
-        }
-    }
-    //Last insert the thread in the new list
-    if(threadList[newPriority.get()]==nullptr)
-    {
-        threadList[newPriority.get()]=thread;
-        thread->schedData.next=thread;//Circular list
-    } else {
-        thread->schedData.next=threadList[newPriority.get()]->schedData.next;
-        threadList[newPriority.get()]->schedData.next=thread;
-    }
+    if(ready) IRQaddToReadyList(thread);
 }
 
 void PriorityScheduler::IRQsetIdleThread(Thread *idleThread)
@@ -199,6 +120,16 @@ void PriorityScheduler::IRQsetIdleThread(Thread *idleThread)
     idle=idleThread;
 }
 
+void PriorityScheduler::IRQwaitStatusHook(Thread* t)
+{
+    if(t->flags.isReady())
+    {
+        if(t->schedData.lastReadyStatus==false) IRQaddToReadyList(t);
+    } else {
+        if(t->schedData.lastReadyStatus) IRQremoveFromReadyList(t);
+    }
+}
+
 long long PriorityScheduler::IRQgetNextPreemption()
 {
     return nextPeriodicPreemption;
@@ -230,42 +161,41 @@ void PriorityScheduler::IRQfindNextThread()
     #ifdef WITH_CPU_TIME_COUNTER
     Thread *prev=const_cast<Thread*>(runningThread);
     #endif // WITH_CPU_TIME_COUNTER
-    for(int i=PRIORITY_MAX-1;i>=0;i--)
+    if(readyBitmap!=0)
     {
-        if(threadList[i]==nullptr) continue;
-        Thread *temp=threadList[i]->schedData.next;
-        for(;;)
+        //Highest priority with at least one ready thread
+        int i=31-__builtin_clz(readyBitmap);
+        ReadyListItem *item=readyList[i].front();
+        Thread *temp=item->t;
+        //Found a READY thread, so run this one
+        runningThread=temp;
+        #ifdef WITH_PROCESSES
+        if(const_cast<Thread*>(runningThread)->flags.isInUserspace()==false)
         {
-            if(temp->flags.isReady())
-            {
-                //Found a READY thread, so run this one
-                runningThread=temp;
-                #ifdef WITH_PROCESSES
-                if(const_cast<Thread*>(runningThread)->flags.isInUserspace()==false)
-                {
-                    ctxsave=runningThread->ctxsave;
-                    MPUConfiguration::IRQdisable();
-                } else {
-                    ctxsave=runningThread->userCtxsave;
-                    //A kernel thread is never in userspace, so the cast is safe
-                    static_cast<Process*>(runningThread->proc)->mpu.IRQenable();
-                }
-                #else //WITH_PROCESSES
-                ctxsave=temp->ctxsave;
-                #endif //WITH_PROCESSES
-                //Rotate to next thread so that next time the list is walked
-                //a different thread, if available, will be chosen first
-                threadList[i]=temp;
-                #ifndef WITH_CPU_TIME_COUNTER
-                IRQsetNextPreemption(false);
-                #else //WITH_CPU_TIME_COUNTER
-                auto t=IRQsetNextPreemption(false);
-                IRQprofileContextSwitch(prev->timeCounterData,temp->timeCounterData,t);
-                #endif //WITH_CPU_TIME_COUNTER
-                return;
-            } else temp=temp->schedData.next;
-            if(temp==threadList[i]->schedData.next) break;
+            ctxsave=runningThread->ctxsave;
+            MPUConfiguration::IRQdisable();
+        } else {
+            ctxsave=runningThread->userCtxsave;
+            //A kernel thread is never in userspace, so the cast is safe
+            static_cast<Process*>(runningThread->proc)->mpu.IRQenable();
         }
+        #else //WITH_PROCESSES
+        ctxsave=temp->ctxsave;
+        #endif //WITH_PROCESSES
+        //Rotate to next thread so that next time the list is walked
+        //a different thread, if available, will be chosen first
+        if(readyList[i].back()!=item)
+        {
+            readyList[i].pop_front();
+            readyList[i].push_back(item);
+        }
+        #ifndef WITH_CPU_TIME_COUNTER
+        IRQsetNextPreemption(false);
+        #else //WITH_CPU_TIME_COUNTER
+        auto t=IRQsetNextPreemption(false);
+        IRQprofileContextSwitch(prev->timeCounterData,temp->timeCounterData,t);
+        #endif //WITH_CPU_TIME_COUNTER
+        return;
     }
     //No thread found, run the idle thread
     runningThread=idle;
@@ -281,7 +211,25 @@ void PriorityScheduler::IRQfindNextThread()
     #endif //WITH_CPU_TIME_COUNTER
 }
 
-Thread *PriorityScheduler::threadList[PRIORITY_MAX]={nullptr};
+void PriorityScheduler::IRQaddToReadyList(Thread *thread)
+{
+    int i=thread->schedData.priority.get();
+    readyList[i].push_back(&thread->schedData.rlEntry);
+    readyBitmap|=1<<i;
+    thread->schedData.lastReadyStatus=true;
+}
+
+void PriorityScheduler::IRQremoveFromReadyList(Thread *thread)
+{
+    int i=thread->schedData.priority.get();
+    readyList[i].removeFast(&thread->schedData.rlEntry);
+    if(readyList[i].empty()) readyBitmap&=~(1<<i);
+    thread->schedData.lastReadyStatus=false;
+}
+
+Thread *PriorityScheduler::threadList=nullptr;
+IntrusiveList<ReadyListItem> PriorityScheduler::readyList[PRIORITY_MAX];
+unsigned int PriorityScheduler::readyBitmap=0;
 Thread *PriorityScheduler::idle=nullptr;
 
 } //namespace miosix
@@ -111,7 +111,7 @@ public:
      * its running status. For example when a thread become sleeping, waiting,
      * deleted or if it exits the sleeping or waiting status
      */
-    static void IRQwaitStatusHook(Thread* t) {}
+    static void IRQwaitStatusHook(Thread* t);
 
     /**
      * \internal
@@ -137,9 +137,30 @@ public:
 
 private:
 
-    ///\internal Vector of lists of threads, there's one list for each priority
-    ///Each list s a circular list.
-    static Thread *threadList[PRIORITY_MAX];
+    /**
+     * \internal
+     * Add a thread to the ready list of its priority.
+     * Can only be called with interrupts disabled or within an interrupt.
+     */
+    static void IRQaddToReadyList(Thread *thread);
+
+    /**
+     * \internal
+     * Remove a thread from the ready list of its priority.
+     * Can only be called with interrupts disabled or within an interrupt.
+     */
+    static void IRQremoveFromReadyList(Thread *thread);
+
+    ///\internal List of all threads, regardless of their status
+    static Thread *threadList;
+
+    ///\internal Vector of lists of ready threads, there's one list for each
+    ///priority. Threads that are waiting, sleeping or deleted are not in these
+    ///lists, so selecting the next thread does not depend on their number
+    static IntrusiveList<ReadyListItem> readyList[PRIORITY_MAX];
+
+    ///\internal Bit i is set if readyList[i] is not empty
+    static unsigned int readyBitmap;
 
     ///\internal idle thread
     static Thread *idle;
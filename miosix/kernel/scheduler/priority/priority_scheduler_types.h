@@ -28,6 +28,7 @@
 #pragma once
 
 #include "config/miosix_settings.h"
+#include "kernel/intrusive.h"
 
 #ifdef SCHED_TYPE_PRIORITY
 
@@ -116,6 +117,15 @@ inline bool operator!=(PrioritySchedulerPriority a, PrioritySchedulerPriority b)
     return a.get() != b.get();
 }
 
+/**
+ * \internal
+ * Entry of a thread in the per-priority ready lists of the priority scheduler
+ */
+struct ReadyListItem : public IntrusiveListItem
+{
+    Thread *t=nullptr;
+};
+
 /**
  * \internal
  * An instance of this class is embedded in every Thread class. It contains all
@@ -124,12 +134,16 @@ inline bool operator!=(PrioritySchedulerPriority a, PrioritySchedulerPriority b)
 class PrioritySchedulerData
 {
 public:
+    PrioritySchedulerData() : next(nullptr), lastReadyStatus(false) {}
+
     ///Thread priority. Used to speed up the implementation of getPriority.<br>
     ///Note that to change the priority of a thread it is not enough to change
     ///this.<br>It is also necessary to move the thread from the old prority
-    ///list to the new priority list.
+    ///ready list to the new priority ready list.
     PrioritySchedulerPriority priority;
-    Thread *next;///<Pointer to next thread of the same priority. CIRCULAR list
+    Thread *next;///<Pointer to next thread in the list of all threads
+    ReadyListItem rlEntry;///<Entry in the ready list of the thread's priority
+    bool lastReadyStatus;///<True if the thread is in a ready list
 };
 
 } //namespace miosix
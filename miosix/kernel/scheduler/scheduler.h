@@ -32,6 +32,7 @@
 #include "kernel/scheduler/control/control_scheduler.h"
 #include "kernel/scheduler/edf/edf_scheduler.h"
 #include "kernel/cpu_time_counter.h"
+#include "kernel/trace.h"
 
 namespace miosix {
 
@@ -165,7 +166,14 @@ public:
      */
     static void IRQfindNextThread()
     {
+        #ifdef WITH_KERNEL_TRACE
+        Thread *prev=Thread::IRQgetCurrentThread();
         T::IRQfindNextThread();
+        Thread *next=Thread::IRQgetCurrentThread();
+        if(next!=prev) KernelTrace::IRQrecord(TraceEvent::ContextSwitch,next);
+        #else //WITH_KERNEL_TRACE
+        T::IRQfindNextThread();
+        #endif //WITH_KERNEL_TRACE
     }
     
     /**
@@ -45,15 +45,22 @@ extern bool IRQwakeThreads(long long currentTime);///\internal Do not use outsid
  */
 inline bool IRQtimerInterrupt(long long currentTime)
 {
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::IRQrecord(TraceEvent::IrqEntry,0);
+    #endif //WITH_KERNEL_TRACE
     Thread::IRQstackOverflowCheck();
     bool hptw = IRQwakeThreads(currentTime);
+    bool result=true;
     if(currentTime >= Scheduler::IRQgetNextPreemption() || hptw)
     {
         //End of the burst || a higher priority thread has woken up
         Scheduler::IRQfindNextThread();//If the kernel is running, preempt
-        return false;
+        result=false;
     }
-    return true;
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::IRQrecord(TraceEvent::IrqExit,0);
+    #endif //WITH_KERNEL_TRACE
+    return result;
 }
 
 } //namespace miosix
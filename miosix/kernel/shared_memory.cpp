@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "shared_memory.h"
+#include "process_pool.h"
+#include "elf_program.h"
+#include <cstring>
+#include <fcntl.h>
+#include <limits.h>
+
+#ifdef WITH_PROCESSES
+
+using namespace std;
+
+namespace miosix {
+
+//
+// class SharedSegment
+//
+
+int SharedSegment::open(const char *name, unsigned int size, int flags,
+        intrusive_ref_ptr<SharedSegment>& segment)
+{
+    size_t len=strnlen(name,NAME_MAX+1);
+    if(len==0) return -EINVAL;
+    if(len>NAME_MAX) return -ENAMETOOLONG;
+    Lock<FastMutex> l(m);
+    auto it=segments.find(name);
+    if(it!=segments.end())
+    {
+        if((flags & O_CREAT) && (flags & O_EXCL)) return -EEXIST;
+        if(size>it->second->getSize()) return -EINVAL;
+        segment=it->second;
+        return 0;
+    }
+    if((flags & O_CREAT)==0) return -ENOENT;
+    if(size==0 || size>MAX_SHARED_SEGMENT_SIZE) return -EINVAL;
+    segment=intrusive_ref_ptr<SharedSegment>(new SharedSegment(size));
+    segments[name]=segment;
+    return 0;
+}
+
+int SharedSegment::unlink(const char *name)
+{
+    Lock<FastMutex> l(m);
+    //The segment may be deallocated here if no process is attached to it
+    return segments.erase(name)==1 ? 0 : -ENOENT;
+}
+
+SharedSegment::~SharedSegment()
+{
+    ProcessPool::instance().deallocate(base);
+}
+
+SharedSegment::SharedSegment(unsigned int size)
+{
+    tie(base,this->size)=ProgramCache::allocate(size);
+    //Don't leak data of terminated processes to the new segment
+    memset(base,0,this->size);
+}
+
+FastMutex SharedSegment::m;
+map<string,intrusive_ref_ptr<SharedSegment>> SharedSegment::segments;
+
+} //namespace miosix
+
+#endif //WITH_PROCESSES
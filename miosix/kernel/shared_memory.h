@@ -0,0 +1,110 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include "sync.h"
+#include "intrusive.h"
+#include "config/miosix_settings.h"
+
+#ifdef WITH_PROCESSES
+
+namespace miosix {
+
+/**
+ * A memory area allocated in the process pool that can be mapped in multiple
+ * processes at the same time, to let them exchange data without copying it
+ * through the kernel. Segments are identified by name, and are reference
+ * counted so that a segment lives as long as it has a name or it is mapped in
+ * at least one process.
+ */
+class SharedSegment : public IntrusiveRefCounted<SharedSegment>
+{
+public:
+    /**
+     * Open a shared segment, optionally creating it
+     * \param name segment name
+     * \param size size in bytes of the segment to create, rounded up to a
+     * power of two to fit in a memory protection region. If the segment
+     * already exists, it can be zero or a size not greater than the segment
+     * size
+     * \param flags O_CREAT to create the segment if it does not exist, and
+     * O_CREAT|O_EXCL to fail if it already exists
+     * \param segment the segment is returned here on success
+     * \return 0 on success, or a negative error code
+     * \throws bad_alloc if out of memory
+     */
+    static int open(const char *name, unsigned int size, int flags,
+                    intrusive_ref_ptr<SharedSegment>& segment);
+
+    /**
+     * Remove a shared segment name. The segment is deallocated when the last
+     * process mapping it detaches from it
+     * \param name segment name
+     * \return 0 on success, or a negative error code
+     */
+    static int unlink(const char *name);
+
+    /**
+     * \return the base address of the segment, aligned to its size
+     */
+    unsigned int *getBase() const { return base; }
+
+    /**
+     * \return the segment size in bytes, a power of two
+     */
+    unsigned int getSize() const { return size; }
+
+    /**
+     * Destructor, deallocates the segment memory
+     */
+    ~SharedSegment();
+
+    SharedSegment(const SharedSegment&)=delete;
+    SharedSegment& operator=(const SharedSegment&)=delete;
+
+private:
+    /**
+     * Constructor, allocates and zeroes the segment memory
+     * \param size segment size
+     * \throws bad_alloc if out of memory
+     */
+    explicit SharedSegment(unsigned int size);
+
+    unsigned int *base; ///< Segment memory in the process pool
+    unsigned int size;  ///< Segment size in bytes
+
+    static FastMutex m; ///< Protects segments
+    /// Segments that have a name
+    static std::map<std::string,intrusive_ref_ptr<SharedSegment>> segments;
+};
+
+} //namespace miosix
+
+#endif //WITH_PROCESSES
@@ -29,23 +29,12 @@
 #include "kernel.h"
 #include "error.h"
 #include "pthread_private.h"
-#include <algorithm>
+#include "trace.h"
 
 using namespace std;
 
 namespace miosix {
 
-/**
- * Helper lambda to sort threads in a min heap to implement priority inheritance
- * \param lhs first thread to compare
- * \param rhs second thread to compare
- * \return true if lhs->getPriority() < rhs->getPriority()
- */
-static auto PKlowerPriority=[](Thread *lhs, Thread *rhs)
-{
-    return lhs->PKgetPriority().mutexLessOp(rhs->PKgetPriority());
-};
-
 //
 // class FastMutex
 //
@@ -99,12 +88,12 @@ void Mutex::PKlock(PauseKernelLock& dLock)
     }
 
     //Add thread to mutex' waiting queue
-    waiting.push_back(p);
-    push_heap(waiting.begin(),waiting.end(),PKlowerPriority);
+    if(p->mutexWaiting!=nullptr) errorHandler(UNEXPECTED);
+    MutexWaitToken token(p,this);
+    p->mutexWaiting=&token;
+    waiting.push(&token);
 
     //Handle priority inheritance
-    if(p->mutexWaiting!=nullptr) errorHandler(UNEXPECTED);
-    p->mutexWaiting=this;
     if(owner->PKgetPriority().mutexLessOp(p->PKgetPriority()))
     {
         Thread *walk=owner;
@@ -112,14 +101,23 @@ void Mutex::PKlock(PauseKernelLock& dLock)
         {
             Scheduler::PKsetPriority(walk,p->PKgetPriority());
             if(walk->mutexWaiting==nullptr) break;
-            make_heap(walk->mutexWaiting->waiting.begin(),
-                      walk->mutexWaiting->waiting.end(),PKlowerPriority);
-            walk=walk->mutexWaiting->owner;
+            //The priority of walk changed, move it to its new place in the
+            //waiting queue of the mutex it is waiting for
+            Mutex *m=walk->mutexWaiting->mutex;
+            m->waiting.removeFast(walk->mutexWaiting);
+            m->waiting.push(walk->mutexWaiting);
+            walk=m->owner;
         }
     }
 
     //The while is necessary to protect against spurious wakeups
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::record(TraceEvent::MutexBlock,this);
+    #endif //WITH_KERNEL_TRACE
     while(owner!=p) Thread::PKrestartKernelAndWait(dLock);
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::record(TraceEvent::MutexUnblock,this);
+    #endif //WITH_KERNEL_TRACE
 }
 
 void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
@@ -151,12 +149,12 @@ void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
     }
 
     //Add thread to mutex' waiting queue
-    waiting.push_back(p);
-    push_heap(waiting.begin(),waiting.end(),PKlowerPriority);
+    if(p->mutexWaiting!=nullptr) errorHandler(UNEXPECTED);
+    MutexWaitToken token(p,this);
+    p->mutexWaiting=&token;
+    waiting.push(&token);
 
     //Handle priority inheritance
-    if(p->mutexWaiting!=nullptr) errorHandler(UNEXPECTED);
-    p->mutexWaiting=this;
     if(owner->PKgetPriority().mutexLessOp(p->PKgetPriority()))
     {
         Thread *walk=owner;
@@ -164,14 +162,23 @@ void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
         {
             Scheduler::PKsetPriority(walk,p->PKgetPriority());
             if(walk->mutexWaiting==nullptr) break;
-            make_heap(walk->mutexWaiting->waiting.begin(),
-                      walk->mutexWaiting->waiting.end(),PKlowerPriority);
-            walk=walk->mutexWaiting->owner;
+            //The priority of walk changed, move it to its new place in the
+            //waiting queue of the mutex it is waiting for
+            Mutex *m=walk->mutexWaiting->mutex;
+            m->waiting.removeFast(walk->mutexWaiting);
+            m->waiting.push(walk->mutexWaiting);
+            walk=m->owner;
         }
     }
 
     //The while is necessary to protect against spurious wakeups
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::record(TraceEvent::MutexBlock,this);
+    #endif //WITH_KERNEL_TRACE
     while(owner!=p) Thread::PKrestartKernelAndWait(dLock);
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::record(TraceEvent::MutexUnblock,this);
+    #endif //WITH_KERNEL_TRACE
     if(recursiveDepth>=0) recursiveDepth=depth;
 }
 
@@ -241,8 +248,8 @@ bool Mutex::PKunlock(PauseKernelLock& dLock)
         while(walk!=nullptr)
         {
             if(walk->waiting.empty()==false)
-                if(pr.mutexLessOp(walk->waiting.front()->PKgetPriority()))
-                    pr=walk->waiting.front()->PKgetPriority();
+                if(pr.mutexLessOp(walk->waiting.front()->thread->PKgetPriority()))
+                    pr=walk->waiting.front()->thread->PKgetPriority();
             walk=walk->next;
         }
         if(pr!=owner->PKgetPriority()) Scheduler::PKsetPriority(owner,pr);
@@ -252,10 +259,10 @@ bool Mutex::PKunlock(PauseKernelLock& dLock)
     if(waiting.empty()==false)
     {
         //There is at least another thread waiting
-        owner=waiting.front();
-        pop_heap(waiting.begin(),waiting.end(),PKlowerPriority);
-        waiting.pop_back();
-        if(owner->mutexWaiting!=this) errorHandler(UNEXPECTED);
+        MutexWaitToken *first=waiting.front();
+        waiting.pop_front();
+        owner=first->thread;
+        if(owner->mutexWaiting!=first) errorHandler(UNEXPECTED);
         owner->mutexWaiting=nullptr;
         owner->PKwakeup();
         if(owner->mutexLocked==nullptr) owner->savedPriority=owner->PKgetPriority();
@@ -264,12 +271,11 @@ bool Mutex::PKunlock(PauseKernelLock& dLock)
         owner->mutexLocked=this;
         //Handle priority inheritance of new owner
         if(waiting.empty()==false &&
-                owner->PKgetPriority().mutexLessOp(waiting.front()->PKgetPriority()))
-                Scheduler::PKsetPriority(owner,waiting.front()->PKgetPriority());
+                owner->PKgetPriority().mutexLessOp(waiting.front()->thread->PKgetPriority()))
+                Scheduler::PKsetPriority(owner,waiting.front()->thread->PKgetPriority());
         return p->PKgetPriority().mutexLessOp(owner->PKgetPriority());
     } else {
         owner=nullptr; //No threads waiting
-        std::vector<Thread *>().swap(waiting); //Save some RAM
         return false;
     }
 }
@@ -312,8 +318,8 @@ unsigned int Mutex::PKunlockAllDepthLevels(PauseKernelLock& dLock)
         while(walk!=nullptr)
         {
             if(walk->waiting.empty()==false)
-                if(pr.mutexLessOp(walk->waiting.front()->PKgetPriority()))
-                    pr=walk->waiting.front()->PKgetPriority();
+                if(pr.mutexLessOp(walk->waiting.front()->thread->PKgetPriority()))
+                    pr=walk->waiting.front()->thread->PKgetPriority();
             walk=walk->next;
         }
         if(pr!=owner->PKgetPriority()) Scheduler::PKsetPriority(owner,pr);
@@ -323,10 +329,10 @@ unsigned int Mutex::PKunlockAllDepthLevels(PauseKernelLock& dLock)
     if(waiting.empty()==false)
     {
         //There is at least another thread waiting
-        owner=waiting.front();
-        pop_heap(waiting.begin(),waiting.end(),PKlowerPriority);
-        waiting.pop_back();
-        if(owner->mutexWaiting!=this) errorHandler(UNEXPECTED);
+        MutexWaitToken *first=waiting.front();
+        waiting.pop_front();
+        owner=first->thread;
+        if(owner->mutexWaiting!=first) errorHandler(UNEXPECTED);
         owner->mutexWaiting=nullptr;
         owner->PKwakeup();
         if(owner->mutexLocked==nullptr) owner->savedPriority=owner->PKgetPriority();
@@ -335,11 +341,10 @@ unsigned int Mutex::PKunlockAllDepthLevels(PauseKernelLock& dLock)
         owner->mutexLocked=this;
         //Handle priority inheritance of new owner
         if(waiting.empty()==false &&
-                owner->PKgetPriority().mutexLessOp(waiting.front()->PKgetPriority()))
-                Scheduler::PKsetPriority(owner,waiting.front()->PKgetPriority());
+                owner->PKgetPriority().mutexLessOp(waiting.front()->thread->PKgetPriority()))
+                Scheduler::PKsetPriority(owner,waiting.front()->thread->PKgetPriority());
     } else {
         owner=nullptr; //No threads waiting
-        std::vector<Thread *>().swap(waiting); //Save some RAM
     }
     
     if(recursiveDepth<0) return 0;
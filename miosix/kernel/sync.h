@@ -116,6 +116,32 @@ private:
 //Forward declaration
 class ConditionVariable;
 
+/**
+ * \internal
+ * Element of the waiting queue of a Mutex. It is allocated on the stack of the
+ * waiting thread, so locking a Mutex never allocates memory.
+ */
+class MutexWaitToken : public IntrusivePriorityQueueItem
+{
+public:
+    MutexWaitToken(Thread *thread, Mutex *mutex) : thread(thread), mutex(mutex) {}
+    Thread *thread; ///<\internal Waiting thread
+    Mutex *mutex;   ///<\internal Mutex the thread is waiting for
+};
+
+/**
+ * \internal
+ * Orders the waiting queue of a Mutex so that the first thread is the one with
+ * the highest priority. Threads with the same priority are kept in FIFO order.
+ */
+struct MutexWaitTokenCompare
+{
+    bool operator()(const MutexWaitToken& a, const MutexWaitToken& b) const
+    {
+        return b.thread->PKgetPriority().mutexLessOp(a.thread->PKgetPriority());
+    }
+};
+
 /**
  * A mutex class with support for priority inheritance. If a thread tries to
  * enter a critical section which is not free, it will be put to sleep and
@@ -252,8 +278,8 @@ private:
     /// thread that owns this mutex. This field is necessary to make the list.
     Mutex *next;
 
-    /// Waiting thread are stored in this min-heap, sorted by priority
-    std::vector<Thread *> waiting;
+    /// Waiting threads, sorted by priority
+    IntrusivePriorityQueue<MutexWaitToken,MutexWaitTokenCompare> waiting;
 
     /// Used to hold nesting depth for recursive mutexes, -1 if not recursive
     int recursiveDepth;
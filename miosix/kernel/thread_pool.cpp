@@ -0,0 +1,109 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "thread_pool.h"
+#include "kernel/kernel.h"
+#include <cstdlib>
+
+#ifdef WITH_THREAD_POOL
+
+namespace miosix {
+
+ThreadPool::FreeBlock *ThreadPool::freeList[ThreadPool::numClasses]={nullptr};
+unsigned int ThreadPool::freeCount[ThreadPool::numClasses]={0};
+unsigned int ThreadPool::freeBytes=0;
+unsigned int ThreadPool::hits=0;
+unsigned int ThreadPool::misses=0;
+
+ThreadPool::Stats ThreadPool::getStats()
+{
+    PauseKernelLock lock;
+    Stats result;
+    result.hits=hits;
+    result.misses=misses;
+    result.freeBlocks=0;
+    for(int i=0;i<numClasses;i++) result.freeBlocks+=freeCount[i];
+    result.freeBytes=freeBytes;
+    return result;
+}
+
+unsigned int ThreadPool::roundStackSize(unsigned int stacksize)
+{
+    for(int i=0;i<numClasses;i++)
+        if(stacksize<=THREAD_POOL_CLASSES[i]) return THREAD_POOL_CLASSES[i];
+    return stacksize;
+}
+
+void *ThreadPool::allocate(unsigned int stacksize, unsigned int size)
+{
+    int i=sizeClass(stacksize);
+    if(i>=0)
+    {
+        PauseKernelLock lock;
+        if(FreeBlock *result=freeList[i])
+        {
+            freeList[i]=result->next;
+            freeCount[i]--;
+            freeBytes-=size;
+            hits++;
+            return result;
+        }
+        misses++;
+    }
+    return malloc(size);
+}
+
+void ThreadPool::deallocate(void *base, unsigned int stacksize,
+                            unsigned int size)
+{
+    int i=sizeClass(stacksize);
+    if(i>=0)
+    {
+        PauseKernelLock lock;
+        if(freeCount[i]<THREAD_POOL_MAX_FREE)
+        {
+            FreeBlock *block=reinterpret_cast<FreeBlock*>(base);
+            block->next=freeList[i];
+            freeList[i]=block;
+            freeCount[i]++;
+            freeBytes+=size;
+            return;
+        }
+    }
+    free(base);
+}
+
+int ThreadPool::sizeClass(unsigned int stacksize)
+{
+    for(int i=0;i<numClasses;i++)
+        if(stacksize==THREAD_POOL_CLASSES[i]) return i;
+    return -1;
+}
+
+} //namespace miosix
+
+#endif //WITH_THREAD_POOL
@@ -0,0 +1,141 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "config/miosix_settings.h"
+
+#ifdef WITH_THREAD_POOL
+
+namespace miosix {
+
+/**
+ * \addtogroup Kernel
+ * \{
+ */
+
+/**
+ * \internal
+ * Recycles the memory of terminated threads, enabled if the symbol
+ * `WITH_THREAD_POOL` has been defined in config/miosix_settings.h.
+ *
+ * Every thread is allocated as a single block of memory holding both the stack
+ * and the Thread class. The stack size of threads is rounded up to one of the
+ * size classes in THREAD_POOL_CLASSES, and when a thread is deallocated its
+ * block is kept in a free list of its size class instead of being returned to
+ * the heap, up to THREAD_POOL_MAX_FREE blocks per class. Creating a thread of
+ * the same size class then does not need to call malloc(), and applications
+ * that create and destroy threads at a high rate do not fragment the heap.
+ *
+ * Blocks are kept as they are when the thread is deallocated, the stack and
+ * watermark are filled again only when the block is reused, so deallocation
+ * in the idle thread stays cheap. Threads whose stack is larger than the
+ * largest size class are allocated and freed with malloc()/free() as usual.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * Struct used to return the thread pool statistics
+     */
+    struct Stats
+    {
+        /// Number of thread allocations served by the pool
+        unsigned int hits;
+        /// Number of thread allocations that required calling malloc()
+        unsigned int misses;
+        /// Number of blocks currently kept in the pool
+        unsigned int freeBlocks;
+        /// Memory currently kept in the pool, in bytes
+        unsigned int freeBytes;
+    };
+
+    /**
+     * \return the thread pool statistics
+     */
+    static Stats getStats();
+
+    /**
+     * \param stacksize stack size requested for a thread
+     * \return the stack size of the size class the thread belongs to, or
+     * stacksize unchanged if it is larger than the largest size class
+     */
+    static unsigned int roundStackSize(unsigned int stacksize);
+
+    /**
+     * Allocate the memory for a thread
+     * \param stacksize thread stack size, already rounded with roundStackSize()
+     * \param size size of the memory block, including the Thread class
+     * \return the allocated memory or nullptr if there's not enough memory
+     */
+    static void *allocate(unsigned int stacksize, unsigned int size);
+
+    /**
+     * Deallocate the memory of a thread, the memory is returned to the heap if
+     * the pool of its size class is full
+     * \param base memory block previously returned by allocate()
+     * \param stacksize thread stack size, must be the same passed to allocate()
+     * \param size size of the memory block, must be the same passed to
+     * allocate()
+     */
+    static void deallocate(void *base, unsigned int stacksize, unsigned int size);
+
+private:
+    ThreadPool() = delete;
+
+    /**
+     * \param stacksize thread stack size
+     * \return the index of the size class whose stack size is exactly
+     * stacksize, or -1 if there is none
+     */
+    static int sizeClass(unsigned int stacksize);
+
+    /**
+     * Free blocks are linked together through their first bytes
+     */
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    static constexpr int numClasses=sizeof(THREAD_POOL_CLASSES)/
+                                    sizeof(THREAD_POOL_CLASSES[0]);
+
+    static FreeBlock *freeList[numClasses]; ///< Free blocks of each class
+    static unsigned int freeCount[numClasses]; ///< Length of the free lists
+    static unsigned int freeBytes; ///< Memory kept in the free lists
+    static unsigned int hits;   ///< Allocations served by the pool
+    static unsigned int misses; ///< Allocations that called malloc()
+};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
+
+#endif //WITH_THREAD_POOL
@@ -0,0 +1,92 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "time_page.h"
+#include "interfaces/portability.h"
+#include <algorithm>
+
+#ifdef WITH_PROCESSES
+
+using namespace std;
+
+namespace miosix {
+
+/**
+ * The time page padded to the size of its MPU region, so that no other kernel
+ * variable becomes readable by processes
+ */
+union PaddedTimePage
+{
+    TimePage page;
+    char padding[64];
+};
+
+static_assert(sizeof(PaddedTimePage)==64,"TimePage larger than its MPU region");
+
+//Aligned to its (power of two) size so that it fits an MPU region
+static PaddedTimePage padded __attribute__((aligned(64)));
+static TimePage& timePage=padded.page;
+static bool timePageValid=false;
+
+void IRQinitTimePage(const volatile unsigned int *counter,
+        const volatile unsigned int *status, unsigned int overflowMask,
+        unsigned int counterMask, TimeConversionFactor tick2ns)
+{
+    timePage.counterMask=counterMask;
+    timePage.counter=counter;
+    timePage.status=status;
+    timePage.overflowMask=overflowMask;
+    timePage.tick2nsInt=tick2ns.integerPart();
+    timePage.tick2nsFrac=tick2ns.fractionalPart();
+    timePage.sequence++;
+
+    //Map the smallest region containing both registers
+    auto c=const_cast<const unsigned int*>(counter);
+    auto s=const_cast<const unsigned int*>(status);
+    auto first=min(c,s);
+    unsigned int size=(max(c,s)+1-first)*sizeof(unsigned int);
+    auto timerRegion=MPUConfiguration::roundRegionForMPU(first,size);
+    MPUConfiguration::IRQsetTimePageRegions(
+        reinterpret_cast<const unsigned int*>(&padded),sizeof(padded),
+        timerRegion.first,timerRegion.second);
+    timePageValid=true;
+}
+
+void IRQupdateTimePage(long long upperTimeTick)
+{
+    timePage.upperTimeTick=upperTimeTick;
+    timePage.sequence++;
+}
+
+const TimePage *getTimePage()
+{
+    return timePageValid ? &timePage : nullptr;
+}
+
+} //namespace miosix
+
+#endif //WITH_PROCESSES
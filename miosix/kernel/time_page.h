@@ -0,0 +1,92 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "timeconversion.h"
+#include "config/miosix_settings.h"
+
+#ifdef WITH_PROCESSES
+
+namespace miosix {
+
+/**
+ * \internal
+ * The time page lets processes read the time without a syscall. It contains
+ * what is needed to extend the os timer counter to 64 bit with the pending bit
+ * trick and to convert it to nanoseconds, exactly as TimerAdapter does, and is
+ * mapped read-only in all processes together with the timer registers.
+ *
+ * The page is only modified from interrupt context, which can't be interleaved
+ * with userspace code, so it is enough for readers to check that sequence did
+ * not change while they were reading.
+ *
+ * NOTE: the layout must match the one in libsyscalls/crt1.cpp
+ */
+struct TimePage
+{
+    volatile unsigned int sequence;       ///< Incremented after each update
+    unsigned int counterMask;             ///< Valid bits of the counter
+    const volatile unsigned int *counter; ///< Timer counter register
+    const volatile unsigned int *status;  ///< Register with the overflow flag
+    unsigned int overflowMask;            ///< Overflow flag bit in *status
+    unsigned int tick2nsInt;              ///< Tick to ns factor, integer part
+    unsigned int tick2nsFrac;             ///< Tick to ns factor, fraction
+    unsigned int reserved;
+    volatile long long upperTimeTick;     ///< Extended counter upper bits
+};
+
+/**
+ * \internal
+ * Called by the os timer driver at boot, if processes can read its registers
+ * \param counter timer counter register
+ * \param status register containing the timer overflow flag
+ * \param overflowMask bit of the overflow flag
+ * \param counterMask valid bits of the counter register
+ * \param tick2ns conversion factor from timer ticks to nanoseconds
+ */
+void IRQinitTimePage(const volatile unsigned int *counter,
+        const volatile unsigned int *status, unsigned int overflowMask,
+        unsigned int counterMask, TimeConversionFactor tick2ns);
+
+/**
+ * \internal
+ * Called by the os timer driver every time the upper bits of the extended
+ * counter change
+ * \param upperTimeTick new value of the upper bits
+ */
+void IRQupdateTimePage(long long upperTimeTick);
+
+/**
+ * \return the time page, or nullptr if the os timer does not support reading
+ * the time from processes
+ */
+const TimePage *getTimePage();
+
+} //namespace miosix
+
+#endif //WITH_PROCESSES
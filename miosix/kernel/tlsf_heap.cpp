@@ -0,0 +1,669 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "tlsf_heap.h"
+#include <cstring>
+#include <algorithm>
+#ifndef TEST_ALLOC
+#include <new>
+#include <reent.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <errno.h>
+#include "kernel/kernel.h"
+#include "kernel/logging.h"
+#endif //TEST_ALLOC
+
+using namespace std;
+
+#if defined(WITH_TLSF_HEAP) || defined(TEST_ALLOC)
+
+namespace miosix {
+
+/**
+ * \param x a nonzero number
+ * \return the index of the most significant bit set
+ */
+static inline int fls(size_t x)
+{
+    return 8*sizeof(size_t)-1-__builtin_clzl(x);
+}
+
+/**
+ * \param x a nonzero number
+ * \return the index of the least significant bit set
+ */
+static inline int ffs(unsigned int x)
+{
+    return __builtin_ctz(x);
+}
+
+//
+// class TlsfHeap
+//
+
+TlsfHeap::TlsfHeap(void *base, size_t size) : first(nullptr), poolSize(0),
+    freeBytes(0), minFreeBytes(0), flBitmap(0)
+{
+    memset(slBitmap,0,sizeof(slBitmap));
+    memset(lists,0,sizeof(lists));
+    size_t start=(reinterpret_cast<size_t>(base)+ALIGN-1) & ~(ALIGN-1);
+    size_t end=(reinterpret_cast<size_t>(base)+size) & ~(ALIGN-1);
+    //The sentinel block at the end only needs its header, and the first
+    //block's prevPhys is never used
+    if(end<start+headerSize+minBlockSize) return;
+    size_t firstSize=end-headerSize-start;
+    if(firstSize>maxBlockSize) firstSize=maxBlockSize;
+    first=reinterpret_cast<Block*>(start);
+    first->size=firstSize; //Starts allocated, release() frees it
+    Block *sentinel=nextPhys(first);
+    sentinel->size=0; //Allocated, zero size, never merged
+    poolSize=firstSize;
+    release(first);
+    minFreeBytes=freeBytes;
+}
+
+void *TlsfHeap::allocate(size_t size)
+{
+    size_t adjusted=adjustSize(size);
+    if(adjusted==0) return nullptr;
+    Block *b=takeFree(adjusted);
+    if(b==nullptr) return nullptr;
+    trim(b,adjusted);
+    return toPtr(b);
+}
+
+void *TlsfHeap::allocateAligned(size_t alignment, size_t size)
+{
+    if(alignment<=ALIGN) return allocate(size);
+    if(alignment & (alignment-1)) return nullptr;
+    size_t adjusted=adjustSize(size);
+    if(adjusted==0) return nullptr;
+    //Worst case the returned memory is alignment-ALIGN bytes past the
+    //beginning of the block, but the gap before it must be large enough to be
+    //returned to the heap as a block
+    size_t worstCase=adjusted+alignment+minBlockSize;
+    if(worstCase<adjusted) return nullptr;
+    Block *b=takeFree(worstCase);
+    if(b==nullptr) return nullptr;
+    size_t ptr=reinterpret_cast<size_t>(toPtr(b));
+    size_t aligned=(ptr+alignment-1) & ~(alignment-1);
+    if(aligned!=ptr && aligned-ptr<minBlockSize)
+        aligned=(ptr+minBlockSize+alignment-1) & ~(alignment-1);
+    size_t gap=aligned-ptr;
+    if(gap>0)
+    {
+        Block *lead=b;
+        b=reinterpret_cast<Block*>(reinterpret_cast<size_t>(lead)+gap);
+        b->size=blockSize(lead)-gap;
+        lead->size=gap | (lead->size & flagMask);
+        release(lead);
+    }
+    trim(b,adjusted);
+    return toPtr(b);
+}
+
+void *TlsfHeap::reallocate(void *ptr, size_t size)
+{
+    if(ptr==nullptr) return allocate(size);
+    if(size==0)
+    {
+        deallocate(ptr);
+        return nullptr;
+    }
+    size_t adjusted=adjustSize(size);
+    if(adjusted==0) return nullptr;
+    Block *b=fromPtr(ptr);
+    size_t current=blockSize(b);
+    if(adjusted<=current)
+    {
+        trim(b,adjusted);
+        return ptr;
+    }
+    //Try growing in place by absorbing the next block
+    Block *next=nextPhys(b);
+    if(isFree(next) && current+blockSize(next)>=adjusted)
+    {
+        removeFree(next);
+        freeBytes-=blockSize(next);
+        b->size+=blockSize(next);
+        nextPhys(b)->size&=~prevFreeBit;
+        trim(b,adjusted);
+        return ptr;
+    }
+    void *result=allocate(size);
+    if(result==nullptr) return nullptr;
+    memcpy(result,ptr,current-sizeof(size_t));
+    release(b);
+    return result;
+}
+
+void TlsfHeap::deallocate(void *ptr)
+{
+    if(ptr) release(fromPtr(ptr));
+}
+
+size_t TlsfHeap::usableSize(void *ptr)
+{
+    //The allocation can extend over the next block's prevPhys field
+    return blockSize(fromPtr(ptr))-sizeof(size_t);
+}
+
+TlsfHeap::Stats TlsfHeap::getStats() const
+{
+    Stats result;
+    result.size=poolSize;
+    result.freeBytes=freeBytes;
+    result.minFreeBytes=minFreeBytes;
+    result.largestFreeBlock=0;
+    if(flBitmap)
+    {
+        //The largest block is in the highest non empty list, but lists
+        //are not sorted by size
+        int fl=fls(flBitmap);
+        int sl=fls(slBitmap[fl]);
+        size_t largest=0;
+        for(Block *b=lists[fl][sl];b;b=b->nextFree)
+            largest=max(largest,blockSize(b));
+        result.largestFreeBlock=largest-sizeof(size_t);
+    }
+    return result;
+}
+
+bool TlsfHeap::check() const
+{
+    if(first==nullptr) return true;
+    size_t countedFree=0;
+    bool prevFree=false;
+    const Block *prev=nullptr;
+    const Block *b;
+    for(b=first;blockSize(b)!=0;b=nextPhys(b))
+    {
+        if(blockSize(b)<minBlockSize || blockSize(b) & (ALIGN-1)) return false;
+        if(isPrevFree(b)!=prevFree) return false;
+        if(prevFree && b->prevPhys!=prev) return false;
+        if(isFree(b))
+        {
+            if(prevFree) return false; //Free blocks must have been merged
+            countedFree+=blockSize(b);
+            int fl,sl;
+            mapping(blockSize(b),fl,sl);
+            if((flBitmap & 1<<fl)==0 || (slBitmap[fl] & 1<<sl)==0) return false;
+            const Block *it=lists[fl][sl];
+            while(it && it!=b) it=it->nextFree;
+            if(it==nullptr) return false;
+        }
+        prevFree=isFree(b);
+        prev=b;
+    }
+    if(isPrevFree(b)!=prevFree || isFree(b)) return false;
+    if(prevFree && b->prevPhys!=prev) return false;
+    if(countedFree!=freeBytes) return false;
+    for(int i=0;i<flCount;i++)
+    {
+        if(((flBitmap>>i) & 1)!=(slBitmap[i]!=0)) return false;
+        for(int j=0;j<slCount;j++)
+        {
+            if(((slBitmap[i]>>j) & 1)!=(lists[i][j]!=nullptr)) return false;
+            for(const Block *it=lists[i][j];it;it=it->nextFree)
+            {
+                if(isFree(it)==false) return false;
+                if(it->nextFree && it->nextFree->prevFree!=it) return false;
+            }
+        }
+    }
+    return true;
+}
+
+size_t TlsfHeap::adjustSize(size_t size)
+{
+    //Reject sizes that would overflow or that no block can satisfy
+    if(size>maxBlockSize) return 0;
+    size_t result=(size+sizeof(size_t)+ALIGN-1) & ~(ALIGN-1);
+    return result<minBlockSize ? minBlockSize : result;
+}
+
+void TlsfHeap::mapping(size_t size, int& fl, int& sl)
+{
+    if(size<smallBlockSize)
+    {
+        fl=0;
+        sl=size/ALIGN;
+    } else {
+        int msb=fls(size);
+        sl=(size>>(msb-slLog2)) ^ slCount;
+        fl=msb-flShift+1;
+    }
+}
+
+void TlsfHeap::insertFree(Block *b)
+{
+    int fl,sl;
+    mapping(blockSize(b),fl,sl);
+    Block *head=lists[fl][sl];
+    b->nextFree=head;
+    b->prevFree=nullptr;
+    if(head) head->prevFree=b;
+    lists[fl][sl]=b;
+    flBitmap|=1<<fl;
+    slBitmap[fl]|=1<<sl;
+}
+
+void TlsfHeap::removeFree(Block *b)
+{
+    int fl,sl;
+    mapping(blockSize(b),fl,sl);
+    if(b->nextFree) b->nextFree->prevFree=b->prevFree;
+    if(b->prevFree) b->prevFree->nextFree=b->nextFree;
+    else {
+        lists[fl][sl]=b->nextFree;
+        if(b->nextFree==nullptr)
+        {
+            slBitmap[fl]&=~(1<<sl);
+            if(slBitmap[fl]==0) flBitmap&=~(1<<fl);
+        }
+    }
+}
+
+TlsfHeap::Block *TlsfHeap::takeFree(size_t size)
+{
+    //Round up the size to the next list boundary, so that any block in the
+    //list found is large enough, and there's no need to walk the list
+    if(size>=smallBlockSize)
+    {
+        size_t round=(size_t(1)<<(fls(size)-slLog2))-1;
+        if(size+round<size) return nullptr;
+        size+=round;
+    }
+    int fl,sl;
+    mapping(size,fl,sl);
+    if(fl>=flCount) return nullptr;
+    unsigned int slMap=slBitmap[fl] & (~0u<<sl);
+    if(slMap==0)
+    {
+        if(fl+1>=flCount) return nullptr;
+        unsigned int flMap=flBitmap & (~0u<<(fl+1));
+        if(flMap==0) return nullptr;
+        fl=ffs(flMap);
+        slMap=slBitmap[fl];
+    }
+    sl=ffs(slMap);
+    Block *b=lists[fl][sl];
+    removeFree(b);
+    b->size&=~freeBit;
+    nextPhys(b)->size&=~prevFreeBit;
+    freeBytes-=blockSize(b);
+    return b;
+}
+
+void TlsfHeap::release(Block *b)
+{
+    freeBytes+=blockSize(b);
+    b->size|=freeBit;
+    if(isPrevFree(b))
+    {
+        Block *prev=b->prevPhys;
+        removeFree(prev);
+        prev->size+=blockSize(b);
+        b=prev;
+    }
+    Block *next=nextPhys(b);
+    if(isFree(next))
+    {
+        removeFree(next);
+        b->size+=blockSize(next);
+        next=nextPhys(b);
+    }
+    next->prevPhys=b;
+    next->size|=prevFreeBit;
+    insertFree(b);
+}
+
+void TlsfHeap::trim(Block *b, size_t size)
+{
+    size_t excess=blockSize(b)-size;
+    if(excess>=minBlockSize)
+    {
+        b->size-=excess;
+        Block *rest=nextPhys(b);
+        rest->size=excess; //Allocated, previous block allocated
+        release(rest);
+    }
+    //Only now freeBytes reflects the allocation, as takeFree() removes from
+    //the free memory the whole block, including the excess
+    if(freeBytes<minFreeBytes) minFreeBytes=freeBytes;
+}
+
+} //namespace miosix
+
+#ifndef TEST_ALLOC
+
+using namespace miosix;
+
+/**
+ * \return the kernel heap, created the first time this function is called
+ * over the whole memory area between the end of the .bss and _heap_end
+ */
+static TlsfHeap& kernelHeap(struct _reent *r)
+{
+    static TlsfHeap *heap=nullptr;
+    //Statically allocated to allow creating the heap before constructors run
+    alignas(TlsfHeap) static char heapStorage[sizeof(TlsfHeap)];
+    if(heap) return *heap;
+    //Claim all the remaining memory through _sbrk_r, so that the maximum heap
+    //usage reported by getMaxHeap() is correct and the memory can't be
+    //given out twice
+    extern char _heap_end asm("_heap_end"); //defined in the linker script
+    char *base=reinterpret_cast<char*>(_sbrk_r(r,0));
+    _sbrk_r(r,&_heap_end-base);
+    heap=new (heapStorage) TlsfHeap(base,&_heap_end-base);
+    return *heap;
+}
+
+/**
+ * Called when an allocation fails
+ * \return nullptr
+ */
+static void *heapOverflow(struct _reent *r)
+{
+    #ifdef __NO_EXCEPTIONS
+    // When exceptions are disabled operator new would return nullptr, which
+    // would cause undefined behaviour. So when exceptions are disabled,
+    // a heap overflow causes a reboot.
+    errorLog("\n***Heap overflow\n");
+    _exit(1);
+    #endif //__NO_EXCEPTIONS
+    r->_errno=ENOMEM;
+    return nullptr;
+}
+
+namespace miosix {
+
+TlsfHeap::Stats getTlsfHeapStats()
+{
+    PauseKernelLock dLock;
+    return kernelHeap(_REENT).getStats();
+}
+
+} //namespace miosix
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Replace the whole newlib malloc family, both the reentrant and non reentrant
+// versions, so that none of newlib's malloc code gets linked in.
+// Allocation time is now bounded, so it is still safe to pause the kernel
+// as newlib's __malloc_lock does. As with newlib, never allocate memory in
+// interrupt context.
+
+void *_malloc_r(struct _reent *r, size_t size)
+{
+    void *result;
+    {
+        PauseKernelLock dLock;
+        result=kernelHeap(r).allocate(size);
+    }
+    return result ? result : heapOverflow(r);
+}
+
+void _free_r(struct _reent *r, void *ptr)
+{
+    if(ptr==nullptr) return;
+    PauseKernelLock dLock;
+    kernelHeap(r).deallocate(ptr);
+}
+
+void *_realloc_r(struct _reent *r, void *ptr, size_t size)
+{
+    void *result;
+    {
+        PauseKernelLock dLock;
+        result=kernelHeap(r).reallocate(ptr,size);
+    }
+    return result || size==0 ? result : heapOverflow(r);
+}
+
+void *_calloc_r(struct _reent *r, size_t nmemb, size_t size)
+{
+    size_t total;
+    if(__builtin_mul_overflow(nmemb,size,&total)) return heapOverflow(r);
+    void *result=_malloc_r(r,total);
+    if(result) memset(result,0,total);
+    return result;
+}
+
+void *_memalign_r(struct _reent *r, size_t alignment, size_t size)
+{
+    void *result;
+    {
+        PauseKernelLock dLock;
+        result=kernelHeap(r).allocateAligned(alignment,size);
+    }
+    return result ? result : heapOverflow(r);
+}
+
+void *_valloc_r(struct _reent *r, size_t size)
+{
+    return _memalign_r(r,4096,size);
+}
+
+void *_pvalloc_r(struct _reent *r, size_t size)
+{
+    return _memalign_r(r,4096,(size+4095) & ~4095);
+}
+
+size_t _malloc_usable_size_r(struct _reent *r, void *ptr)
+{
+    return ptr ? TlsfHeap::usableSize(ptr) : 0;
+}
+
+struct mallinfo _mallinfo_r(struct _reent *r)
+{
+    TlsfHeap::Stats stats;
+    {
+        PauseKernelLock dLock;
+        stats=kernelHeap(r).getStats();
+    }
+    struct mallinfo result;
+    memset(&result,0,sizeof(result));
+    result.arena=stats.size;
+    result.uordblks=stats.size-stats.freeBytes;
+    result.fordblks=stats.freeBytes;
+    result.usmblks=stats.size-stats.minFreeBytes;
+    return result;
+}
+
+int _malloc_trim_r(struct _reent *r, size_t pad) { return 0; }
+
+void _malloc_stats_r(struct _reent *r) {}
+
+void *malloc(size_t size) { return _malloc_r(_REENT,size); }
+
+void free(void *ptr) { _free_r(_REENT,ptr); }
+
+void *realloc(void *ptr, size_t size) { return _realloc_r(_REENT,ptr,size); }
+
+void *calloc(size_t nmemb, size_t size) { return _calloc_r(_REENT,nmemb,size); }
+
+void *memalign(size_t alignment, size_t size)
+{
+    return _memalign_r(_REENT,alignment,size);
+}
+
+void *valloc(size_t size) { return _valloc_r(_REENT,size); }
+
+void *pvalloc(size_t size) { return _pvalloc_r(_REENT,size); }
+
+size_t malloc_usable_size(void *ptr)
+{
+    return _malloc_usable_size_r(_REENT,ptr);
+}
+
+struct mallinfo mallinfo() { return _mallinfo_r(_REENT); }
+
+int malloc_trim(size_t pad) { return 0; }
+
+void malloc_stats() {}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //TEST_ALLOC
+
+#ifdef TEST_ALLOC
+//g++ -O2 -o th -DTEST_ALLOC tlsf_heap.cpp && ./th
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+
+int main()
+{
+    using namespace miosix;
+    const size_t poolSize=256*1024;
+    vector<char> memory(poolSize+3);
+    TlsfHeap heap(memory.data()+3,poolSize); //Misaligned on purpose
+    struct Allocation
+    {
+        unsigned char *ptr;
+        size_t size;
+        size_t cost; ///< Upper bound of the pool memory used
+        unsigned char fill;
+    };
+    vector<Allocation> allocs;
+    //Keep the working set to half the pool, leaving the rest for rounding to
+    //size classes and fragmentation, so that every allocation must succeed
+    const size_t budget=poolSize/2;
+    size_t live=0;
+    auto cost=[](size_t size, size_t alignment) {
+        return size+alignment+2*TlsfHeap::ALIGN;
+    };
+    srand(42);
+    for(int i=0;i<1000000;i++)
+    {
+        int op=rand()%8;
+        if(live>budget) op=6+op%2; //Free memory instead
+        if(op<4 || allocs.empty())
+        {
+            size_t size=rand()%(op==0 ? 8192 : 256);
+            size_t alignment=op==1 ? size_t(1)<<(rand()%10) : 0;
+            void *p=alignment ? heap.allocateAligned(alignment,size)
+                              : heap.allocate(size);
+            if(p==nullptr)
+            {
+                cout<<"Allocation failed at iteration "<<i<<endl;
+                return 1;
+            }
+            size_t mask=(alignment>TlsfHeap::ALIGN ? alignment : TlsfHeap::ALIGN)-1;
+            if(reinterpret_cast<size_t>(p) & mask)
+            {
+                cout<<"Misaligned allocation"<<endl;
+                return 1;
+            }
+            if(TlsfHeap::usableSize(p)<size)
+            {
+                cout<<"Usable size too small"<<endl;
+                return 1;
+            }
+            Allocation a={reinterpret_cast<unsigned char*>(p),size,
+                cost(size,alignment),static_cast<unsigned char>(rand())};
+            memset(a.ptr,a.fill,size);
+            allocs.push_back(a);
+            live+=a.cost;
+        } else {
+            size_t index=rand()%allocs.size();
+            Allocation& a=allocs[index];
+            for(size_t j=0;j<a.size;j++)
+            {
+                if(a.ptr[j]==a.fill) continue;
+                cout<<"Memory corrupted"<<endl;
+                return 1;
+            }
+            if(op<6)
+            {
+                size_t size=rand()%1024;
+                void *p=heap.reallocate(a.ptr,size);
+                if(p==nullptr && size!=0)
+                {
+                    cout<<"Reallocation failed at iteration "<<i<<endl;
+                    return 1;
+                }
+                live-=a.cost;
+                if(p==nullptr) { allocs.erase(allocs.begin()+index); continue; }
+                a.ptr=reinterpret_cast<unsigned char*>(p);
+                for(size_t j=0;j<min(a.size,size);j++)
+                {
+                    if(a.ptr[j]==a.fill) continue;
+                    cout<<"Memory corrupted by reallocation"<<endl;
+                    return 1;
+                }
+                memset(a.ptr,a.fill,size);
+                a.size=size;
+                a.cost=cost(size,0);
+                live+=a.cost;
+            } else {
+                heap.deallocate(a.ptr);
+                live-=a.cost;
+                allocs.erase(allocs.begin()+index);
+            }
+        }
+        if(i % 1000==0 && heap.check()==false)
+        {
+            cout<<"Heap corrupted at iteration "<<i<<endl;
+            return 1;
+        }
+    }
+    TlsfHeap::Stats stats=heap.getStats();
+    size_t minFreeBytes=stats.minFreeBytes;
+    //At most one allocation past the budget was ever in use
+    if(minFreeBytes+budget+cost(8192,512)<stats.size)
+    {
+        cout<<"Minimum free memory underestimated"<<endl;
+        return 1;
+    }
+    for(auto& a : allocs) heap.deallocate(a.ptr);
+    stats=heap.getStats();
+    if(heap.check()==false || stats.freeBytes!=stats.size ||
+       stats.largestFreeBlock!=stats.size-sizeof(size_t))
+    {
+        cout<<"Heap not empty after freeing everything"<<endl;
+        return 1;
+    }
+    //Requests larger than the pool fail, and don't corrupt the heap
+    if(heap.allocate(poolSize)!=nullptr || heap.check()==false)
+    {
+        cout<<"Allocation larger than the heap succeeded"<<endl;
+        return 1;
+    }
+    cout<<"Test passed, min free "<<minFreeBytes<<"/"<<stats.size<<endl;
+    return 0;
+}
+#endif //TEST_ALLOC
+
+#endif //WITH_TLSF_HEAP || TEST_ALLOC
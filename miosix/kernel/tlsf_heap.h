@@ -0,0 +1,278 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#ifndef TEST_ALLOC
+#include "config/miosix_settings.h"
+#endif //TEST_ALLOC
+#include <cstddef>
+
+#if defined(WITH_TLSF_HEAP) || defined(TEST_ALLOC)
+
+namespace miosix {
+
+/**
+ * \addtogroup Kernel
+ * \{
+ */
+
+/**
+ * \internal
+ * Two-level segregated fit memory allocator, used as the kernel heap in place
+ * of the newlib one if the symbol `WITH_TLSF_HEAP` has been defined in
+ * config/miosix_settings.h.
+ *
+ * Free blocks are kept in an array of free lists indexed by two levels of
+ * size classes: the first level splits sizes in powers of two, the second
+ * level splits each power of two range in SL_COUNT linear ranges. Two
+ * bitmaps record which lists are not empty, so finding a free block large
+ * enough for an allocation, as well as freeing a block and merging it with
+ * its physical neighbours, take a bounded time, independent of the number of
+ * blocks in the heap and of its fragmentation.
+ *
+ * Every block has a header of two words, the first of which overlaps the last
+ * word of the previous block and is used only when the previous block is
+ * free, so the overhead of an allocated block is one word.
+ *
+ * This class is not thread safe, the caller must provide locking.
+ */
+class TlsfHeap
+{
+public:
+    /**
+     * Struct used to return the heap statistics
+     */
+    struct Stats
+    {
+        /// Bytes managed by the heap, including block headers
+        unsigned int size;
+        /// Bytes currently free, including block headers
+        unsigned int freeBytes;
+        /// Minimum number of free bytes since the heap was created
+        unsigned int minFreeBytes;
+        /// Size of the largest allocation that would currently succeed
+        unsigned int largestFreeBlock;
+    };
+
+    /**
+     * Constructor
+     * \param base start of the memory area to manage
+     * \param size size of the memory area in bytes
+     */
+    TlsfHeap(void *base, size_t size);
+
+    /**
+     * \param size size of the requested memory
+     * \return a pointer to the allocated memory, aligned to ALIGN bytes, or
+     * nullptr if there is not enough memory
+     */
+    void *allocate(size_t size);
+
+    /**
+     * \param alignment alignment of the requested memory, must be a power of 2
+     * \param size size of the requested memory
+     * \return a pointer to the allocated memory, or nullptr if there is not
+     * enough memory
+     */
+    void *allocateAligned(size_t alignment, size_t size);
+
+    /**
+     * Resize an allocation, in place if possible
+     * \param ptr pointer previously returned by one of the allocate member
+     * functions, or nullptr to allocate new memory
+     * \param size new size, if zero the memory is deallocated
+     * \return a pointer to the resized memory, or nullptr if there is not
+     * enough memory, in which case the old allocation is left untouched
+     */
+    void *reallocate(void *ptr, size_t size);
+
+    /**
+     * \param ptr pointer previously returned by one of the allocate member
+     * functions, or nullptr, which is ignored
+     */
+    void deallocate(void *ptr);
+
+    /**
+     * \param ptr pointer previously returned by one of the allocate member
+     * functions
+     * \return the number of bytes that can be used starting from ptr
+     */
+    static size_t usableSize(void *ptr);
+
+    /**
+     * \return the heap statistics. Computing the largest free block takes
+     * time proportional to the length of one free list
+     */
+    Stats getStats() const;
+
+    /**
+     * Walks all blocks checking the heap data structures for consistency.
+     * Takes time proportional to the number of blocks, meant for debugging
+     * \return true if the heap is consistent
+     */
+    bool check() const;
+
+    /// Alignment of all allocations and granularity of block sizes
+    static const size_t ALIGN=2*sizeof(void*);
+
+private:
+    TlsfHeap(const TlsfHeap&)=delete;
+    TlsfHeap& operator=(const TlsfHeap&)=delete;
+
+    /**
+     * Block header. The free list pointers are only valid when the block is
+     * free, when it is allocated the memory is returned to the user starting
+     * from nextFree.
+     */
+    struct Block
+    {
+        /// Previous block in memory, only valid if the prevFreeBit is set.
+        /// Overlaps the last word of the previous block
+        Block *prevPhys;
+        /// Block size, measured between the start of two consecutive blocks,
+        /// and flags in the least significant bits
+        size_t size;
+        Block *nextFree; ///< Next block in the same free list
+        Block *prevFree; ///< Previous block in the same free list
+    };
+
+    static const size_t freeBit=1;     ///< This block is free
+    static const size_t prevFreeBit=2; ///< The previous block is free
+    static const size_t flagMask=freeBit | prevFreeBit;
+    /// Bytes between the start of a block and the memory given to the user
+    static const size_t headerSize=offsetof(Block,nextFree);
+    /// Minimum block size, enough to hold a free block header
+    static const size_t minBlockSize=sizeof(Block);
+
+    static const int alignLog2=sizeof(void*)==4 ? 3 : 4;
+    static const int slLog2=4; ///< Log2 of number of second level lists
+    static const int slCount=1<<slLog2;
+    static const int flShift=slLog2+alignLog2;
+    /// Blocks must be smaller than 2^flMax, limits the heap size to 128MB
+    static const int flMax=sizeof(void*)==4 ? 27 : 32;
+    static const int flCount=flMax-flShift+1;
+    /// Below this size blocks are kept in the first level 0 lists, each
+    /// spanning ALIGN bytes
+    static const size_t smallBlockSize=1<<flShift;
+    static const size_t maxBlockSize=(size_t(1)<<flMax)-ALIGN;
+    static_assert(ALIGN==1<<alignLog2,"");
+    static_assert(smallBlockSize/slCount==ALIGN,"");
+
+    static size_t blockSize(const Block *b) { return b->size & ~flagMask; }
+
+    static bool isFree(const Block *b) { return b->size & freeBit; }
+
+    static bool isPrevFree(const Block *b) { return b->size & prevFreeBit; }
+
+    static Block *nextPhys(const Block *b)
+    {
+        return reinterpret_cast<Block*>(reinterpret_cast<size_t>(b)+blockSize(b));
+    }
+
+    static void *toPtr(Block *b)
+    {
+        return reinterpret_cast<char*>(b)+headerSize;
+    }
+
+    static Block *fromPtr(void *ptr)
+    {
+        return reinterpret_cast<Block*>(reinterpret_cast<char*>(ptr)-headerSize);
+    }
+
+    /**
+     * \param size requested allocation size
+     * \return the size of the block needed to satisfy the allocation, or 0
+     * if the allocation is too large
+     */
+    static size_t adjustSize(size_t size);
+
+    /**
+     * Compute the free list indices of a block size
+     * \param size block size
+     * \param fl first level index
+     * \param sl second level index
+     */
+    static void mapping(size_t size, int& fl, int& sl);
+
+    /**
+     * Insert a free block in the free list of its size
+     */
+    void insertFree(Block *b);
+
+    /**
+     * Remove a free block from the free list of its size
+     */
+    void removeFree(Block *b);
+
+    /**
+     * Find a free block of at least the given size, remove it from its free
+     * list and mark it as allocated
+     * \param size block size
+     * \return the block or nullptr if none is large enough
+     */
+    Block *takeFree(size_t size);
+
+    /**
+     * Mark an allocated block as free, merge it with its free neighbours and
+     * insert it in the free lists
+     */
+    void release(Block *b);
+
+    /**
+     * Shrink an allocated block, returning the excess memory to the heap if
+     * it is large enough to form a block. Every allocation ends here, so it
+     * also updates minFreeBytes
+     * \param b allocated block
+     * \param size new block size
+     */
+    void trim(Block *b, size_t size);
+
+    Block *first;            ///< First block of the heap
+    size_t poolSize;         ///< Bytes managed by the heap
+    size_t freeBytes;        ///< Bytes currently free
+    size_t minFreeBytes;     ///< Minimum of freeBytes since creation
+    unsigned int flBitmap;   ///< Bit i set if any list in slBitmap[i] not empty
+    unsigned int slBitmap[flCount]; ///< Bit j set if lists[i][j] not empty
+    Block *lists[flCount][slCount]; ///< Free lists
+};
+
+#ifndef TEST_ALLOC
+/**
+ * \internal
+ * \return the statistics of the kernel heap
+ */
+TlsfHeap::Stats getTlsfHeapStats();
+#endif //TEST_ALLOC
+
+/**
+ * \}
+ */
+
+} //namespace miosix
+
+#endif //WITH_TLSF_HEAP || TEST_ALLOC
@@ -0,0 +1,105 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "trace.h"
+#include "kernel/kernel.h"
+#include "filesystem/devfs/devfs.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef WITH_KERNEL_TRACE
+
+namespace miosix {
+
+/**
+ * Device that removes events from the trace buffer when read
+ */
+class KernelTraceDevice : public Device
+{
+public:
+    KernelTraceDevice() : Device(Device::STREAM) {}
+
+    ssize_t readBlock(void *buffer, size_t size, off_t where) override
+    {
+        //Copy through a temporary, as buffer may be unaligned
+        char *out=reinterpret_cast<char*>(buffer);
+        TraceRecord temp[8];
+        ssize_t result=0;
+        while(size>=sizeof(TraceRecord))
+        {
+            unsigned int n=std::min<size_t>(size/sizeof(TraceRecord),8);
+            n=KernelTrace::read(temp,n);
+            if(n==0) break;
+            memcpy(out+result,temp,n*sizeof(TraceRecord));
+            result+=n*sizeof(TraceRecord);
+            size-=n*sizeof(TraceRecord);
+        }
+        return result;
+    }
+};
+
+TraceRecord KernelTrace::buffer[KERNEL_TRACE_BUFFER_SIZE];
+unsigned int KernelTrace::head=0;
+unsigned int KernelTrace::tail=0;
+unsigned int KernelTrace::lost=0;
+long long KernelTrace::firstLost=0;
+
+unsigned int KernelTrace::read(TraceRecord *records, unsigned int size)
+{
+    unsigned int result=0;
+    while(result<size)
+    {
+        //Copy a few events at a time to keep interrupts disabled for a short
+        //time, as events can be recorded in between
+        FastInterruptDisableLock dLock;
+        if(lost>0)
+        {
+            //Zero also the reserved bytes, records are copied to userspace
+            records[result]=TraceRecord();
+            records[result].timestamp=firstLost;
+            records[result].arg=lost;
+            records[result].event=TraceEvent::Lost;
+            result++;
+            lost=0;
+            continue;
+        }
+        unsigned int n=std::min(std::min(size-result,head-tail),8u);
+        if(n==0) break;
+        for(unsigned int i=0;i<n;i++)
+            records[result++]=buffer[tail++ & (KERNEL_TRACE_BUFFER_SIZE-1)];
+    }
+    return result;
+}
+
+intrusive_ref_ptr<Device> KernelTrace::makeDevice()
+{
+    return intrusive_ref_ptr<Device>(new KernelTraceDevice);
+}
+
+} //namespace miosix
+
+#endif //WITH_KERNEL_TRACE
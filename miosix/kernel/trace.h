@@ -0,0 +1,189 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "config/miosix_settings.h"
+#include "kernel.h"
+#include <cstdint>
+#include "intrusive.h"
+
+#ifdef WITH_KERNEL_TRACE
+
+namespace miosix {
+
+class Device; //Forward declaration
+
+/**
+ * \addtogroup Kernel
+ * \{
+ */
+
+/**
+ * Types of events recorded by KernelTrace. The meaning of the argument of each
+ * event is documented next to it.
+ */
+enum class TraceEvent : unsigned char
+{
+    ContextSwitch=0, ///< A thread was scheduled, arg is the thread
+    IrqEntry=1,      ///< Interrupt entry, arg identifies the interrupt
+    IrqExit=2,       ///< Interrupt exit, arg identifies the interrupt
+    MutexBlock=3,    ///< Thread blocks on a mutex, arg is the mutex
+    MutexUnblock=4,  ///< Thread acquired the mutex it blocked on, arg is the mutex
+    QueueBlock=5,    ///< Thread blocks on a full/empty Queue, arg is the queue
+    QueueUnblock=6,  ///< Thread woken while blocked on a Queue, arg is the queue
+    SyscallEntry=7,  ///< Process syscall entry, arg is the syscall number
+    SyscallExit=8,   ///< Process syscall exit, arg is the syscall number
+    Lost=9           ///< arg events were lost because the buffer was full
+};
+
+/**
+ * A kernel trace event, as stored in the trace buffer and read from /dev/trace
+ */
+struct TraceRecord
+{
+    long long timestamp; ///< Time in nanoseconds
+    unsigned int arg;    ///< Event argument, see TraceEvent
+    TraceEvent event;    ///< Event type
+    unsigned char reserved[3];
+};
+
+static_assert(sizeof(TraceRecord)==16,"TraceRecord binary format changed");
+
+/**
+ * KernelTrace records a timeline of kernel events in a ring buffer of
+ * KERNEL_TRACE_BUFFER_SIZE events. It is enabled only if the symbol
+ * `WITH_KERNEL_TRACE` has been defined in config/miosix_settings.h.
+ *
+ * The kernel records context switches, blocking on Mutex, FastMutex and Queue,
+ * process syscalls and the os timer interrupt. Drivers can record their own
+ * interrupts with IRQrecord(TraceEvent::IrqEntry,id) and
+ * IRQrecord(TraceEvent::IrqExit,id), where id is an identifier of the
+ * interrupt other than 0, which is used by the os timer.
+ *
+ * If the buffer is full, the oldest events are overwritten. The buffer is read
+ * through the /dev/trace device file, and the result can be converted to the
+ * Chrome trace format with _tools/kernel_trace/trace2json.pl
+ */
+class KernelTrace
+{
+public:
+    /**
+     * Record an event. Can only be called with interrupts disabled or within
+     * an interrupt.
+     * \param event event type
+     * \param arg event argument
+     */
+    static void IRQrecord(TraceEvent event, unsigned int arg)
+    {
+        TraceRecord& r=buffer[head & (KERNEL_TRACE_BUFFER_SIZE-1)];
+        if(head-tail==KERNEL_TRACE_BUFFER_SIZE)
+        {
+            //Buffer full, overwrite the oldest event
+            if(lost++==0) firstLost=r.timestamp;
+            tail++;
+        }
+        r.timestamp=IRQgetTime();
+        r.arg=arg;
+        r.event=event;
+        head++;
+    }
+
+    /**
+     * Record an event whose argument is an object address. Can only be called
+     * with interrupts disabled or within an interrupt.
+     * \param event event type
+     * \param arg event argument
+     */
+    template<typename T>
+    static void IRQrecord(TraceEvent event, T *arg)
+    {
+        IRQrecord(event,static_cast<unsigned int>(
+            reinterpret_cast<uintptr_t>(arg)));
+    }
+
+    /**
+     * Record an event. Can be called with interrupts enabled or the kernel
+     * paused.
+     * \param event event type
+     * \param arg event argument
+     */
+    static void record(TraceEvent event, unsigned int arg)
+    {
+        FastInterruptDisableLock dLock;
+        IRQrecord(event,arg);
+    }
+
+    /**
+     * Record an event whose argument is an object address. Can be called with
+     * interrupts enabled or the kernel paused.
+     * \param event event type
+     * \param arg event argument
+     */
+    template<typename T>
+    static void record(TraceEvent event, T *arg)
+    {
+        FastInterruptDisableLock dLock;
+        IRQrecord(event,arg);
+    }
+
+    /**
+     * Remove events from the buffer.
+     * \param records events are copied here, oldest first. If events were
+     * lost since the last call, the first event is a TraceEvent::Lost with
+     * the timestamp of the first lost event
+     * \param size maximum number of events to copy
+     * \return the number of events copied
+     */
+    static unsigned int read(TraceRecord *records, unsigned int size);
+
+    /**
+     * \return a device that removes events from the buffer when read, used by
+     * DevFs to create /dev/trace. Reads return only whole TraceRecords
+     */
+    static intrusive_ref_ptr<Device> makeDevice();
+
+private:
+    KernelTrace() = delete;
+
+    static_assert((KERNEL_TRACE_BUFFER_SIZE & (KERNEL_TRACE_BUFFER_SIZE-1))==0,
+                  "KERNEL_TRACE_BUFFER_SIZE must be a power of 2");
+
+    static TraceRecord buffer[KERNEL_TRACE_BUFFER_SIZE];
+    static unsigned int head; ///< Number of events written since boot
+    static unsigned int tail; ///< Number of events removed since boot
+    static unsigned int lost; ///< Events lost since last read
+    static long long firstLost; ///< Timestamp of the first lost event
+};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
+
+#endif //WITH_KERNEL_TRACE
@@ -554,44 +554,43 @@ pipe:
 /* TODO: missing syscalls: access */
 
 /**
- * miosix::getTime, nonstandard syscall
+ * __gettime, read the time with a syscall, used when the time page is not
+ * available
  * \return long long time in nanoseconds, relative to clock monotonic
  */
-.section .text._ZN6miosix7getTimeEv
-.global _ZN6miosix7getTimeEv
-.type _ZN6miosix7getTimeEv, %function
-_ZN6miosix7getTimeEv:
+.section .text.__gettime
+.global __gettime
+.type __gettime, %function
+__gettime:
 	movs r0, #4
 	movs r3, #38
 	svc  0
 	bx   lr
 
 /**
- * clock_gettime
- * \param clockid which clock
- * \param tp struct timespec*
- * \return in Miosix this syscall always returns 0, if the clockid is wrong
- * the default clock is returned
- */
-.section .text.clock_gettime
-.global clock_gettime
-.type clock_gettime, %function
-clock_gettime:
-	push {r4, lr}
-	movs r4, r1
-	movs r3, #38
+ * __timepage, get the address of the time page
+ * \return the address of the time page, or 0 if not available
+ */
+.section .text.__timepage
+.global __timepage
+.type __timepage, %function
+__timepage:
+	movs r3, #68
 	svc  0
-	adr  r3, .L500
-	ldrd r2, [r3]
-	bl   __aeabi_ldivmod
-	strd r0, [r4]
-	str  r2, [r4, #8]
-	movs r0, #0
-	pop  {r4, pc}
-	.align 2
-.L500:
-	.word 1000000000
-	.word 0
+	bx   lr
+
+/**
+ * __ringsubmit, execute the operations queued in a syscall ring
+ * \param ring ring header
+ * \return the number of executed operations, or a negative error code
+ */
+.section .text.__ringsubmit
+.global __ringsubmit
+.type __ringsubmit, %function
+__ringsubmit:
+	movs r3, #69
+	svc  0
+	bx   lr
 
 /**
  * clock_settime
@@ -779,6 +778,135 @@ getppid:
 
 /* TODO: missing syscalls: getuid, getgid, geteuid, getegid, setuid, setgid */
 
+/**
+ * __extendheap, grow the process image to make room for the heap
+ * \param size requested size in bytes
+ * \param start the start of the new memory area is stored here
+ * \return the size of the new memory area, or a negative error code
+ */
+.section .text.__extendheap
+.global __extendheap
+.type __extendheap, %function
+__extendheap:
+	movs r3, #59
+	svc  0
+	bx   lr
+
+/**
+ * __shmattach, map a shared segment in the process address space
+ * \param name segment name
+ * \param size segment size
+ * \param flags O_CREAT and O_EXCL are supported
+ * \param addr the segment address is stored here
+ * \return the segment size, or a negative error code
+ */
+.section .text.__shmattach
+.global __shmattach
+.type __shmattach, %function
+__shmattach:
+	mov  r12, r3    /* addr moved to 4th syscall parameter (r12) */
+	movs r3, #60
+	svc  0
+	bx   lr
+
+/**
+ * __shmdetach, unmap the attached shared segment
+ * \return 0 on success, or a negative error code
+ */
+.section .text.__shmdetach
+.global __shmdetach
+.type __shmdetach, %function
+__shmdetach:
+	movs r3, #61
+	svc  0
+	bx   lr
+
+/**
+ * __shmunlink, remove a shared segment name
+ * \param name segment name
+ * \return 0 on success, or a negative error code
+ */
+.section .text.__shmunlink
+.global __shmunlink
+.type __shmunlink, %function
+__shmunlink:
+	movs r3, #62
+	svc  0
+	bx   lr
+
+/**
+ * __threadcreate, create a thread in the process
+ * \param entry entry point, receiving arg in r0, sp in r1 and the tid in r2
+ * \param arg parameter passed to the entry point
+ * \param stack base address of the thread stack
+ * \param size stack size
+ * \return the thread id, or a negative error code
+ */
+.section .text.__threadcreate
+.global __threadcreate
+.type __threadcreate, %function
+__threadcreate:
+	mov  r12, r3    /* size moved to 4th syscall parameter (r12) */
+	movs r3, #63
+	svc  0
+	bx   lr
+
+/**
+ * __threadexit, terminate the calling thread
+ * \param result value returned to the thread joining this one
+ */
+.section .text.__threadexit
+.global __threadexit
+.type __threadexit, %function
+__threadexit:
+	movs r3, #64
+	svc  0
+
+/**
+ * __threadjoin, wait for a thread to terminate
+ * \param tid thread id
+ * \param result value passed to thread exit is stored here
+ * \param options 0 or WNOHANG
+ * \return 0 on success, or a negative error code
+ */
+.section .text.__threadjoin
+.global __threadjoin
+.type __threadjoin, %function
+__threadjoin:
+	movs r3, #65
+	svc  0
+	bx   lr
+
+/**
+ * __futexwait, block if the word at the given address has the given value
+ * \param addr address
+ * \param expected expected value
+ * \param timeout absolute timeout in nanoseconds, negative to wait forever
+ * \return 0 when woken, or a negative error code
+ */
+.section .text.__futexwait
+.global __futexwait
+.type __futexwait, %function
+__futexwait:
+	mov  r12, r3    /* timeout high word moved to 4th syscall parameter (r12) */
+	movs r3, #66
+	svc  0
+	bx   lr
+
+/**
+ * __futexwake, wake threads blocked on the given address
+ * \param addr address
+ * \param count maximum number of threads to wake
+ * \return the number of woken threads
+ */
+.section .text.__futexwake
+.global __futexwake
+.type __futexwake, %function
+__futexwake:
+	movs r3, #67
+	svc  0
+	bx   lr
+
 /* common jump target for all failing syscalls with 32 bit return value */
 .section .text.__seterrno32
 syscallfailed32:
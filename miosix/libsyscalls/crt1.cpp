@@ -28,6 +28,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <climits>
 #include <errno.h>
 #include <unistd.h>
 #include <pthread.h>
@@ -57,10 +58,158 @@ static AtexitBlock *head = nullptr; ///< Head of the AtexitBlock list
 /// Mutex to protect the heap
 static pthread_mutex_t mallocMutex=PTHREAD_MUTEX_RECURSIVE_INITIALIZER_NP;
 
+/// Futex based lock protecting the internal state of all pthread_mutex_t,
+/// 0 if free, 1 if locked, 2 if locked and other threads are waiting
 /// TODO: to avoid mutex contention we'll need to extend the pthread_mutex_t
 /// struct with a per-mutex flag
 static int globalFlag=0;
 
+namespace __cxxabiv1
+{
+
+struct __cxa_exception; //A forward declaration of this one is enough
+
+/*
+ * This struct was taken from libsupc++/unwind-cxx.h Unfortunately that file
+ * is not deployed in the gcc installation so we can't just #include it.
+ * It is required on a per-thread basis to make C++ exceptions thread safe.
+ */
+struct __cxa_eh_globals
+{
+    __cxa_exception *caughtExceptions;
+    unsigned int uncaughtExceptions;
+    //Should be __ARM_EABI_UNWINDER__ but that's only usable inside gcc
+    #ifdef __ARM_EABI__
+    __cxa_exception* propagatingExceptions;
+    #endif //__ARM_EABI__
+};
+
+} //namespace __cxxabiv1
+
+/**
+ * Per-thread data of threads spawned with pthread_create(). Slots are only
+ * reused and never deallocated, so the list can be walked without locking
+ */
+struct ThreadSlot
+{
+    ThreadSlot *next;              ///< Next slot, nullptr if last
+    char * volatile stack;         ///< Thread stack, nullptr if slot unused
+    unsigned int stackSize;        ///< Thread stack size
+    void *(*start)(void *);        ///< Thread entry point
+    void *arg;                     ///< Thread entry point argument
+    volatile int tid;              ///< Thread id
+    bool used;                     ///< True if the slot is in use
+    bool detached;                 ///< True if the thread is detached
+    struct _reent reent;           ///< Per-thread C standard library state
+    __cxxabiv1::__cxa_eh_globals eh; ///< Per-thread C++ exception state
+};
+
+static ThreadSlot * volatile slots=nullptr; ///< Head of the ThreadSlot list
+/// Mutex to protect the allocation of ThreadSlot
+static pthread_mutex_t slotsMutex=PTHREAD_MUTEX_INITIALIZER;
+constexpr int mainThreadTid=1; ///< The kernel always gives tid 1 to main()
+
+/**
+ * \return the ThreadSlot of the calling thread, or nullptr if the caller is
+ * the main thread. As each thread has its own stack, the slot is found by
+ * looking at the stack pointer
+ */
+static ThreadSlot *currentSlot()
+{
+    const char *sp;
+    asm volatile("mov %0, sp" : "=r"(sp));
+    for(ThreadSlot *walk=slots;walk;walk=walk->next)
+    {
+        const char *stack=walk->stack;
+        if(sp>=stack && sp<stack+walk->stackSize) return walk;
+    }
+    return nullptr;
+}
+
+/**
+ * Data needed to read the time without a syscall, mapped read-only in the
+ * process by the kernel.
+ * NOTE: the layout must match the one in kernel/time_page.h
+ */
+struct TimePage
+{
+    volatile unsigned int sequence;       ///< Incremented after each update
+    unsigned int counterMask;             ///< Valid bits of the counter
+    const volatile unsigned int *counter; ///< Timer counter register
+    const volatile unsigned int *status;  ///< Register with the overflow flag
+    unsigned int overflowMask;            ///< Overflow flag bit in *status
+    unsigned int tick2nsInt;              ///< Tick to ns factor, integer part
+    unsigned int tick2nsFrac;             ///< Tick to ns factor, fraction
+    unsigned int reserved;
+    volatile long long upperTimeTick;     ///< Extended counter upper bits
+};
+
+// implemented in crt0.s
+extern "C" long long __gettime();
+extern "C" const TimePage *__timepage();
+
+/**
+ * \return the time page, or nullptr if the kernel does not provide it
+ */
+static const TimePage *getTimePage()
+{
+    static const TimePage *page=nullptr;
+    static bool queried=false;
+    //Threads racing here all get the same result, so no need to lock
+    if(queried==false)
+    {
+        page=__timepage();
+        queried=true;
+    }
+    return page;
+}
+
+/**
+ * Multiply a 64 bit number by a 32.32 fixed point one, discarding the
+ * fractional part of the result. Same algorithm as the kernel TimeConversion
+ */
+static unsigned long long mul64x32d32(unsigned long long a,
+                                      unsigned int bi, unsigned int bf)
+{
+    unsigned int aLo=a & 0xffffffff;
+    unsigned int aHi=a>>32;
+    unsigned long long result=static_cast<unsigned long long>(bi)*aLo;
+    result+=static_cast<unsigned long long>(bf)*aHi;
+    result+=(static_cast<unsigned long long>(bf)*aLo)>>32;
+    result+=static_cast<unsigned long long>(bi*aHi)<<32;
+    return result;
+}
+
+namespace miosix {
+
+/**
+ * \return the time in nanoseconds, relative to clock monotonic. If the kernel
+ * provides a time page, the time is read from the timer without a syscall
+ */
+long long getTime()
+{
+    const TimePage *p=getTimePage();
+    if(p==nullptr) return __gettime();
+    for(;;)
+    {
+        unsigned int sequence=p->sequence;
+        asm volatile("":::"memory");
+        unsigned long long upper=p->upperTimeTick;
+        unsigned int mask=p->counterMask;
+        //The pending bit trick, as done by the kernel in TimerAdapter
+        unsigned int counter=*p->counter & mask;
+        unsigned long long tick=upper | counter;
+        if((*p->status & p->overflowMask) && (*p->counter & mask)>=counter)
+            tick+=static_cast<unsigned long long>(mask)+1;
+        asm volatile("":::"memory");
+        //If the kernel updated the page while we were reading, try again
+        if(p->sequence!=sequence) continue;
+        return mul64x32d32(tick,p->tick2nsInt,p->tick2nsFrac);
+    }
+}
+
+} //namespace miosix
+
 extern "C" {
 
 /**
@@ -189,7 +338,17 @@ void *__dso_handle=(void*) &__dso_handle;
 const char *__processHeapEnd;
 const char *__processStackEnd;
 // used by memoryprofiling
-const char *__maxUsedHeap=nullptr;
+unsigned int __heapExtension=0; ///< Bytes added to the heap by __extendheap
+unsigned int __maxHeapUsage=0;  ///< Max bytes returned by _sbrk_r
+
+/**
+ * \internal
+ * Grow the process image to make room for the heap, implemented in crt0.s
+ * \param size requested size in bytes
+ * \param start the start of the new memory area is stored here
+ * \return the size of the new memory area, or a negative error code
+ */
+int __extendheap(unsigned int size, char **start);
 
 /**
  * \internal
@@ -201,11 +360,32 @@ void *_sbrk_r(struct _reent *ptr, ptrdiff_t incr)
     extern char _end asm("_end"); //defined in the linker script
     //This holds the current end of the heap (static)
     static char *curHeapEnd=&_end;
+    //This holds the start and end of the memory area where the heap currently
+    //is, which is past the main stack if the process image has been extended
+    static const char *curHeapStart=&_end;
+    static const char *curHeapLimit=nullptr;
+    //This holds the heap usage in bytes, for memoryprofiling
+    static unsigned int heapUsage=0;
     //This holds the previous end of the heap
     char *prevHeapEnd;
 
+    if(curHeapLimit==nullptr) curHeapLimit=__processHeapEnd;
+    if(incr>0 && curHeapEnd+incr>curHeapLimit)
+    {
+        //Try growing the process image. Unless the image was already extended
+        //the new memory is not contiguous with the heap, which malloc supports
+        //at the cost of wasting the end of the current area
+        char *start;
+        int added=__extendheap(incr,&start);
+        if(added>=incr)
+        {
+            if(start!=curHeapLimit) curHeapStart=curHeapEnd=start;
+            curHeapLimit=start+added;
+            __heapExtension+=added;
+        }
+    }
     prevHeapEnd=curHeapEnd;
-    if(curHeapEnd+incr>__processHeapEnd)
+    if(curHeapEnd+incr>curHeapLimit || curHeapEnd+incr<curHeapStart)
     {
         //bad, heap overflow
         #ifdef __NO_EXCEPTIONS
@@ -219,7 +399,8 @@ void *_sbrk_r(struct _reent *ptr, ptrdiff_t incr)
         #endif //__NO_EXCEPTIONS
     }
     curHeapEnd+=incr;
-    if(curHeapEnd>__maxUsedHeap) __maxUsedHeap=curHeapEnd;
+    heapUsage+=incr;
+    if(heapUsage>__maxHeapUsage) __maxHeapUsage=heapUsage;
     return reinterpret_cast<void*>(prevHeapEnd);
 }
 
@@ -248,8 +429,8 @@ void __malloc_unlock()
  */
 struct _reent *__getreent()
 {
-    // For now processes can't have threads, so always return the global one
-    return _GLOBAL_REENT;
+    ThreadSlot *slot=currentSlot();
+    return slot ? &slot->reent : _GLOBAL_REENT;
 }
 
 
@@ -384,6 +565,16 @@ int _getpid_r(struct _reent* ptr)
     return getpid();
 }
 
+int clock_gettime(clockid_t clockid, struct timespec *tp)
+{
+    //In Miosix all clocks are the same, if the clockid is wrong the default
+    //clock is returned
+    long long t=miosix::getTime();
+    tp->tv_sec=t/1000000000;
+    tp->tv_nsec=t%1000000000;
+    return 0;
+}
+
 clock_t times(struct tms *tim)
 {
     struct timespec tp;
@@ -461,17 +652,268 @@ static int atomicCompareAndSwap(volatile int *p, int prev, int next)
     return result;
 }
 
+static int atomicSwap(volatile int *p, int next)
+{
+    int result;
+    do {
+        result=__LDREXW(p);
+    } while(__STREXW(next,p));
+    asm volatile("":::"memory");
+    return result;
+}
+
+static int atomicAddExchange(volatile int *p, int incr)
+{
+    int result;
+    do {
+        result=__LDREXW(p);
+    } while(__STREXW(result+incr,p));
+    asm volatile("":::"memory");
+    return result;
+}
+
+//
+// Thread support
+// ==============
+
+/**
+ * \internal
+ * Create a thread in the calling process, implemented in crt0.s
+ * \param entry entry point, receiving arg in r0, sp in r1 and the tid in r2
+ * \param arg parameter passed to the entry point
+ * \param stack base address of the thread stack
+ * \param size stack size
+ * \return the thread id, or a negative error code
+ */
+int __threadcreate(void (*entry)(ThreadSlot*,void*,int), void *arg,
+                   void *stack, unsigned int size);
+
+/**
+ * \internal
+ * Terminate the calling thread, implemented in crt0.s
+ * \param result value returned to the thread joining this one
+ */
+void __threadexit(void *result) __attribute__((noreturn));
+
+/**
+ * \internal
+ * Wait for a thread to terminate, implemented in crt0.s
+ * \param tid thread id
+ * \param result value passed to thread exit is stored here
+ * \param options 0 or WNOHANG
+ * \return 0 on success, or a negative error code
+ */
+int __threadjoin(int tid, void **result, int options);
+
+/**
+ * \internal
+ * Block if *addr==expected, implemented in crt0.s
+ * \param timeout absolute timeout in nanoseconds, negative to wait forever
+ * \return 0 when woken, or a negative error code
+ */
+int __futexwait(volatile int *addr, int expected, long long timeout=-1);
+
+/**
+ * \internal
+ * Wake up to count threads blocked on addr, implemented in crt0.s
+ * \return the number of woken threads
+ */
+int __futexwake(volatile int *addr, int count);
+
+/**
+ * \internal
+ * Entry point of threads spawned with pthread_create()
+ */
+static void threadLauncher(ThreadSlot *slot, void *sp, int tid)
+{
+    slot->tid=tid;
+    __threadexit(slot->start(slot->arg));
+}
+
+/**
+ * \internal
+ * Release the slot of a thread that has been joined
+ */
+static void releaseSlot(ThreadSlot *slot)
+{
+    char *stack=slot->stack;
+    slot->stack=nullptr; //Before freeing, so no thread can match its stack
+    _reclaim_reent(&slot->reent);
+    free(stack);
+    pthread_mutex_lock(&slotsMutex);
+    slot->tid=0;
+    slot->used=false;
+    pthread_mutex_unlock(&slotsMutex);
+}
+
+/**
+ * \internal
+ * Release the slots of detached threads that have terminated
+ */
+static void reapDetachedThreads()
+{
+    for(ThreadSlot *walk=slots;walk;walk=walk->next)
+    {
+        if(walk->used==false || walk->detached==false) continue;
+        void *result;
+        if(__threadjoin(walk->tid,&result,WNOHANG)==0) releaseSlot(walk);
+    }
+}
+
+int pthread_create(pthread_t *pthread, const pthread_attr_t *attr,
+    void *(*start)(void *), void *arg)
+{
+    unsigned int stackSize=2048;
+    bool detached=false;
+    if(attr!=nullptr)
+    {
+        stackSize=attr->stacksize;
+        detached=attr->detachstate==PTHREAD_CREATE_DETACHED;
+    }
+    reapDetachedThreads();
+    char *stack=static_cast<char*>(malloc(stackSize));
+    if(stack==nullptr) return EAGAIN;
+
+    pthread_mutex_lock(&slotsMutex);
+    ThreadSlot *slot=slots;
+    while(slot && slot->used) slot=slot->next;
+    if(slot==nullptr)
+    {
+        slot=static_cast<ThreadSlot*>(calloc(1,sizeof(ThreadSlot)));
+        if(slot==nullptr)
+        {
+            pthread_mutex_unlock(&slotsMutex);
+            free(stack);
+            return EAGAIN;
+        }
+        slot->next=slots;
+        slots=slot;
+    }
+    slot->used=true;
+    pthread_mutex_unlock(&slotsMutex);
+
+    slot->start=start;
+    slot->arg=arg;
+    slot->detached=detached;
+    _REENT_INIT_PTR(&slot->reent);
+    memset(&slot->eh,0,sizeof(slot->eh));
+    slot->stackSize=stackSize;
+    slot->stack=stack; //Last, the thread becomes visible to currentSlot()
+    int tid=__threadcreate(threadLauncher,slot,stack,stackSize);
+    if(tid<0)
+    {
+        releaseSlot(slot);
+        return -tid;
+    }
+    slot->tid=tid;
+    *pthread=(pthread_t)tid;
+    return 0;
+}
+
+int pthread_join(pthread_t pthread, void **value_ptr)
+{
+    int tid=(int)pthread;
+    ThreadSlot *slot=slots;
+    while(slot && (slot->used==false || slot->tid!=tid)) slot=slot->next;
+    if(slot==nullptr) return ESRCH;
+    if(slot->detached) return EINVAL;
+    void *result;
+    int error=__threadjoin(tid,&result,0);
+    if(error<0) return -error;
+    if(value_ptr) *value_ptr=result;
+    releaseSlot(slot);
+    return 0;
+}
+
+int pthread_detach(pthread_t pthread)
+{
+    int tid=(int)pthread;
+    ThreadSlot *slot=slots;
+    while(slot && (slot->used==false || slot->tid!=tid)) slot=slot->next;
+    if(slot==nullptr) return ESRCH;
+    slot->detached=true;
+    reapDetachedThreads();
+    return 0;
+}
+
+void pthread_exit(void *value_ptr)
+{
+    __threadexit(value_ptr);
+}
+
+pthread_t pthread_self()
+{
+    ThreadSlot *slot=currentSlot();
+    return (pthread_t)(slot ? slot->tid : mainThreadTid);
+}
+
+int pthread_equal(pthread_t t1, pthread_t t2)
+{
+    return t1==t2;
+}
+
+int pthread_attr_init(pthread_attr_t *attr)
+{
+    //We only use two fields of pthread_attr_t so initialize only these
+    attr->detachstate=PTHREAD_CREATE_JOINABLE;
+    attr->stacksize=2048;
+    return 0;
+}
+
+int pthread_attr_destroy(pthread_attr_t *attr)
+{
+    return 0; //That was easy
+}
+
+int pthread_attr_getdetachstate(const pthread_attr_t *attr, int *detachstate)
+{
+    *detachstate=attr->detachstate;
+    return 0;
+}
+
+int pthread_attr_setdetachstate(pthread_attr_t *attr, int detachstate)
+{
+    if(detachstate!=PTHREAD_CREATE_JOINABLE &&
+       detachstate!=PTHREAD_CREATE_DETACHED) return EINVAL;
+    attr->detachstate=detachstate;
+    return 0;
+}
+
+int pthread_attr_getstacksize(const pthread_attr_t *attr, size_t *stacksize)
+{
+    *stacksize=attr->stacksize;
+    return 0;
+}
+
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t stacksize)
+{
+    if(stacksize<1024) return EINVAL;
+    attr->stacksize=stacksize;
+    return 0;
+}
+
+//
+// Mutex support
+// =============
+
 static void enterCriticalSection(pthread_mutex_t *m)
 {
     //TODO: when we add the flag in the mutex stop using the global flag
-    while(atomicCompareAndSwap(&globalFlag,0,1)!=0) pthread_yield();
+    int c=atomicCompareAndSwap(&globalFlag,0,1);
+    if(c==0) return;
+    //Contended, mark that there are waiters and block until the lock is free
+    if(c!=2) c=atomicSwap(&globalFlag,2);
+    while(c!=0)
+    {
+        __futexwait(&globalFlag,2);
+        c=atomicSwap(&globalFlag,2);
+    }
 }
 
 static void leaveCriticalSection(pthread_mutex_t *m)
 {
     //TODO: when we add the flag in the mutex stop using the global flag
-    globalFlag=0;
-    asm volatile("":::"memory");
+    if(atomicSwap(&globalFlag,0)==2) __futexwake(&globalFlag,1);
 }
 
 class CriticalSectionUnlock; //Forward decl
@@ -489,15 +931,27 @@ private:
 class CriticalSectionUnlock
 {
 public:
-    CriticalSectionUnlock(CriticalSectionLock l) :m(l.m) { leaveCriticalSection(m); }
+    CriticalSectionUnlock(CriticalSectionLock& l) :m(l.m) { leaveCriticalSection(m); }
     ~CriticalSectionUnlock() { enterCriticalSection(m); }
 private:
     pthread_mutex_t *m;
 };
 
-void *getCurrentThread()
+static void *getCurrentThread()
 {
-    return reinterpret_cast<void*>(1); //TODO: stub we need a syscall for that
+    return reinterpret_cast<void*>(pthread_self());
+}
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
+{
+    mutex->owner=nullptr;
+    mutex->first=nullptr;
+    //No need to initialize mutex->last
+    if(attr!=nullptr)
+    {
+        mutex->recursive= attr->recursive==PTHREAD_MUTEX_RECURSIVE ? 0 : -1;
+    } else mutex->recursive=-1;
+    return 0;
 }
 
 int pthread_mutex_lock(pthread_mutex_t *mutex)
@@ -538,109 +992,265 @@ int pthread_mutex_lock(pthread_mutex_t *mutex)
     while(mutex->owner!=p)
     {
         CriticalSectionUnlock unlock(lock);
-        //TODO: to improve performance we need
-        //1) a syscall to ask the OS to block the thread
-        //2) a way to atomically exit the critical section and block, otherwise
-        //   we have a race condition if the wakeup occurs in between
-        pthread_yield();
+        //pthread_mutex_unlock clears waiting.thread before waking us, so if
+        //the wakeup occurs before we block the futex returns immediately
+        __futexwait(reinterpret_cast<volatile int*>(&waiting.thread),
+                    reinterpret_cast<int>(p));
     }
     return 0;
 }
-int pthread_mutex_unlock(pthread_mutex_t *mutex)
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex)
 {
     CriticalSectionLock lock(mutex);
-    if(mutex->recursive>0)
+    void *p=getCurrentThread();
+    if(mutex->owner==nullptr)
     {
-        mutex->recursive--;
+        mutex->owner=p;
         return 0;
     }
-    if(mutex->first!=nullptr)
+    if(mutex->owner==p && mutex->recursive>=0)
     {
-        //TODO: once the code to block a thread in pthread_mutex_lock is added
-        //here we need to call the syscall to wake it up
-        mutex->owner=mutex->first->thread;
-        mutex->first=mutex->first->next;
+        mutex->recursive++;
         return 0;
     }
-    mutex->owner=nullptr;
+    return EBUSY;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+    WaitingList *w;
+    {
+        CriticalSectionLock lock(mutex);
+        if(mutex->recursive>0)
+        {
+            mutex->recursive--;
+            return 0;
+        }
+        w=mutex->first;
+        if(w==nullptr)
+        {
+            mutex->owner=nullptr;
+            return 0;
+        }
+        //Hand the mutex over to the first waiting thread
+        mutex->owner=w->thread;
+        mutex->first=w->next;
+        w->thread=nullptr;
+    }
+    //The waiting thread may have already returned, but the futex syscall only
+    //uses the address as a key and never dereferences it
+    __futexwake(reinterpret_cast<volatile int*>(&w->thread),1);
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex)
+{
+    if(mutex->owner!=nullptr) return EBUSY;
     return 0;
 }
 
-int pthread_mutex_destroy(pthread_mutex_t *mutex) { return 0; }
 int pthread_setcancelstate(int state, int *oldstate) { return 0; }
 
+//
+// Condition variable API
+//
+
+//The two words of pthread_cond_t are used as a sequence number incremented
+//by each signal/broadcast, which waiting threads use as futex word, and as the
+//number of waiting threads, which is only modified with the mutex locked and
+//allows signal/broadcast not to enter the kernel if nobody is waiting.
+//NOTE: the only clock supported for pthread_cond_timedwait is CLOCK_MONOTONIC
+
+static_assert(sizeof(pthread_cond_t)==2*sizeof(int),"Invalid pthread_cond_t size");
+
+static inline volatile int *condWords(pthread_cond_t *cond)
+{
+    return reinterpret_cast<volatile int*>(cond);
+}
+
+static int condWait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                    long long timeout)
+{
+    volatile int *w=condWords(cond);
+    int sequence=w[0];
+    w[1]++;
+    pthread_mutex_unlock(mutex);
+    int result=__futexwait(&w[0],sequence,timeout);
+    pthread_mutex_lock(mutex);
+    w[1]--;
+    return result==-ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+static void condWake(pthread_cond_t *cond, int count)
+{
+    volatile int *w=condWords(cond);
+    if(w[1]==0) return; //Nobody waiting, no need to enter the kernel
+    atomicAddExchange(&w[0],1);
+    __futexwake(&w[0],count);
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+    //attr is currently not considered
+    volatile int *w=condWords(cond);
+    w[0]=0;
+    w[1]=0;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond)
+{
+    if(condWords(cond)[1]!=0) return EBUSY;
+    return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    return condWait(cond,mutex,-1);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                           const struct timespec *abstime)
+{
+    long long timeout=static_cast<long long>(abstime->tv_sec)*1000000000LL
+                    + abstime->tv_nsec;
+    return condWait(cond,mutex,timeout<0 ? 0 : timeout);
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+    condWake(cond,1);
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+    condWake(cond,INT_MAX);
+    return 0;
+}
+
+//
+// Once API
+//
+
+/// pthread_once_t is too small to be used as a futex word, so threads waiting
+/// for any pthread_once to complete wait on this counter instead
+static int onceCounter=0;
+
+/**
+ * \internal
+ * Set the state of a pthread_once_t and wake the threads waiting on it
+ */
+static void onceComplete(pthread_once_t *once, char state)
+{
+    {
+        CriticalSectionLock lock(nullptr);
+        once->init_executed=state;
+        onceCounter++;
+    }
+    __futexwake(&onceCounter,INT_MAX);
+}
+
 int pthread_once(pthread_once_t *once, void (*func)())
 {
-    //TODO: make thread-safe when processes can spawn threads
     if(once==nullptr || func==nullptr || once->is_initialized!=1) return EINVAL;
-    if(once->init_executed==0)
+
+    for(;;)
     {
+        int counter=0;
+        bool first=false;
+        {
+            CriticalSectionLock lock(nullptr);
+            switch(once->init_executed)
+            {
+                case 0: //We're the first ones (or previous call has thrown)
+                    once->init_executed=1;
+                    first=true;
+                    break;
+                case 1: //Call started but not ended
+                    counter=onceCounter;
+                    break;
+                default: //Already called, return immediately
+                    return 0;
+            }
+        }
+        if(first) break;
+        __futexwait(&onceCounter,counter); //Wait for a call to complete
+    }
+
+    #ifdef __NO_EXCEPTIONS
+    func();
+    #else //__NO_EXCEPTIONS
+    try {
         func();
-        once->init_executed=2; //We succeeded
+    } catch(...) {
+        onceComplete(once,0); //We failed, let some other thread try
+        throw;
     }
+    #endif //__NO_EXCEPTIONS
+    onceComplete(once,2); //We succeeded
     return 0;
 }
 
 } // extern "C"
 
+/*
+ * The guard states are 0 (not initialized), 2 (initialization in progress)
+ * and 1 (initialized). The ABI requires bit 0 to be set when initialized as
+ * the compiler inlines that check to skip calling __cxa_guard_acquire
+ */
 union MiosixGuard
 {
-    //miosix::Thread *owner;
-    unsigned int flag;
+    int flag;
 };
 
 namespace __cxxabiv1
 {
 
-struct __cxa_exception; //A forward declaration of this one is enough
-
-/*
- * This struct was taken from libsupc++/unwind-cxx.h Unfortunately that file
- * is not deployed in the gcc installation so we can't just #include it.
- * It is required on a per-thread basis to make C++ exceptions thread safe.
- */
-struct __cxa_eh_globals
-{
-    __cxa_exception *caughtExceptions;
-    unsigned int uncaughtExceptions;
-    //Should be __ARM_EABI_UNWINDER__ but that's only usable inside gcc
-    #ifdef __ARM_EABI__
-    __cxa_exception* propagatingExceptions;
-    #endif //__ARM_EABI__
-};
-
 static __cxa_eh_globals eh = { 0 };
 
 extern "C" __cxa_eh_globals* __cxa_get_globals_fast()
 {
-    return &eh; //TODO: one per-thread when processes can spawn threads
+    ThreadSlot *slot=currentSlot();
+    return slot ? &slot->eh : &eh;
 }
 
 extern "C" __cxa_eh_globals* __cxa_get_globals()
 {
-    return &eh; //TODO: one per-thread when processes can spawn threads
+    ThreadSlot *slot=currentSlot();
+    return slot ? &slot->eh : &eh;
 }
 
 extern "C" int __cxa_guard_acquire(__guard *g)
 {
-    //TODO: make thread-safe when processes can spawn threads
     volatile MiosixGuard *guard=reinterpret_cast<volatile MiosixGuard*>(g);
-    if(guard->flag==1) return 0; //Object already initialized, good
-    return 1;
+    for(;;)
+    {
+        switch(atomicCompareAndSwap(&guard->flag,0,2))
+        {
+            case 0: //We're the first ones, initialize the object
+                return 1;
+            case 1: //Object already initialized, good
+                return 0;
+            default: //Initialization in progress in another thread, wait
+                __futexwait(&guard->flag,2);
+        }
+    }
 }
 
 extern "C" void __cxa_guard_release(__guard *g) noexcept
 {
-    //TODO: make thread-safe when processes can spawn threads
     volatile MiosixGuard *guard=reinterpret_cast<volatile MiosixGuard*>(g);
     guard->flag=1;
+    __futexwake(&guard->flag,INT_MAX);
 }
 
 extern "C" void __cxa_guard_abort(__guard *g) noexcept
 {
-    //TODO: make thread-safe when processes can spawn threads
     volatile MiosixGuard *guard=reinterpret_cast<volatile MiosixGuard*>(g);
     guard->flag=0;
+    __futexwake(&guard->flag,INT_MAX);
 }
 
 } //namespace __cxxabiv1
@@ -0,0 +1,94 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "futex.h"
+#include <errno.h>
+
+// implemented in crt0.s
+extern "C" int __futexwait(volatile int *addr, int expected, long long timeout);
+extern "C" int __futexwake(volatile int *addr, int count);
+
+namespace miosix {
+
+int futexWait(volatile int *addr, int expected, long long timeout)
+{
+    int result=__futexwait(addr,expected,timeout);
+    if(result<0)
+    {
+        errno=-result;
+        return -1;
+    }
+    return 0;
+}
+
+int futexWake(volatile int *addr, int count)
+{
+    return __futexwake(addr,count);
+}
+
+//
+// class Semaphore
+//
+
+void Semaphore::signal()
+{
+    __atomic_add_fetch(&count,1,__ATOMIC_SEQ_CST);
+    //If the waiting thread has not yet blocked, the futex wait fails as the
+    //count is no longer zero, so the wakeup can't be lost
+    if(waiting>0) __futexwake(&count,1);
+}
+
+void Semaphore::wait()
+{
+    timedWait(-1);
+}
+
+TimedWaitResult Semaphore::timedWait(long long absTime)
+{
+    while(tryWait()==false)
+    {
+        __atomic_add_fetch(&waiting,1,__ATOMIC_SEQ_CST);
+        int result=__futexwait(&count,0,absTime);
+        __atomic_sub_fetch(&waiting,1,__ATOMIC_SEQ_CST);
+        if(result==-ETIMEDOUT) return tryWait() ? TimedWaitResult::NoTimeout
+                                                : TimedWaitResult::Timeout;
+    }
+    return TimedWaitResult::NoTimeout;
+}
+
+bool Semaphore::tryWait()
+{
+    int c=count;
+    while(c>0)
+    {
+        if(__atomic_compare_exchange_n(&count,&c,c-1,true,__ATOMIC_SEQ_CST,
+            __ATOMIC_SEQ_CST)) return true;
+    }
+    return false;
+}
+
+} //namespace miosix
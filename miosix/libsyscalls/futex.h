@@ -0,0 +1,115 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+namespace miosix {
+
+/**
+ * Block the calling thread until woken by futexWake(), if the word at the
+ * given address contains the expected value. Checking the value and blocking
+ * is atomic with respect to futexWake(), so wakeups can't be lost.
+ * Futexes are private to a process, threads of different processes can't
+ * wake each other even if they wait on a shared memory segment.
+ * \param addr address of the futex word, must be aligned to 4 bytes
+ * \param expected the thread blocks only if *addr==expected
+ * \param timeout absolute time in nanoseconds (CLOCK_MONOTONIC) after which
+ * the wait times out, or a negative value to wait forever
+ * \return 0 if woken, -1 on failure with errno set to EAGAIN if *addr did not
+ * contain the expected value, or ETIMEDOUT if the timeout expired
+ */
+int futexWait(volatile int *addr, int expected, long long timeout=-1);
+
+/**
+ * Wake threads blocked in futexWait() on an address
+ * \param addr address of the futex word
+ * \param count maximum number of threads to wake
+ * \return the number of woken threads
+ */
+int futexWake(volatile int *addr, int count);
+
+/**
+ * Possible return values of timed wait operations
+ */
+enum class TimedWaitResult
+{
+    NoTimeout,
+    Timeout
+};
+
+/**
+ * Counting semaphore for threads of a process. Signaling a semaphore nobody
+ * is waiting on and waiting on a semaphore with a nonzero count never enter
+ * the kernel, otherwise threads block through a futex.
+ */
+class Semaphore
+{
+public:
+    /**
+     * Constructor
+     * \param initialCount initial semaphore count
+     */
+    Semaphore(unsigned int initialCount=0) : count(initialCount), waiting(0) {}
+
+    /**
+     * Increment the semaphore count, waking a waiting thread if any
+     */
+    void signal();
+
+    /**
+     * Wait until the count is positive, then decrement it
+     */
+    void wait();
+
+    /**
+     * Wait until the count is positive, then decrement it, or until the
+     * timeout expires
+     * \param absTime absolute timeout in nanoseconds (CLOCK_MONOTONIC)
+     * \return whether the wait timed out
+     */
+    TimedWaitResult timedWait(long long absTime);
+
+    /**
+     * Decrement the count if it is positive, without blocking
+     * \return true if the count was decremented
+     */
+    bool tryWait();
+
+    /**
+     * \return the semaphore count
+     */
+    unsigned int getCount() const { return count; }
+
+    Semaphore(const Semaphore&)=delete;
+    Semaphore& operator=(const Semaphore&)=delete;
+
+private:
+    volatile int count;   ///< Semaphore count, also the futex word
+    volatile int waiting; ///< Number of threads blocked in wait
+};
+
+} //namespace miosix
@@ -34,7 +34,8 @@
 // declared in crt1.cpp
 extern const char *__processHeapEnd;
 extern const char *__processStackEnd;
-extern const char *__maxUsedHeap;
+extern unsigned int __heapExtension;
+extern unsigned int __maxHeapUsage;
 
 namespace miosix {
 
@@ -110,17 +111,14 @@ unsigned int MemoryProfiling::getCurrentFreeStack()
 unsigned int MemoryProfiling::getHeapSize()
 {
     extern char _end asm("_end"); //defined in the linker script
+    //The heap may have been extended past the main stack
     return reinterpret_cast<unsigned int>(__processHeapEnd)
-         - reinterpret_cast<unsigned int>(&_end);
+         - reinterpret_cast<unsigned int>(&_end) + __heapExtension;
 }
 
 unsigned int MemoryProfiling::getAbsoluteFreeHeap()
 {
-    //Make sure __maxUsedHeap is initialized
-    _sbrk_r(__getreent(),0);
-
-    return reinterpret_cast<unsigned int>(__processHeapEnd)
-         - reinterpret_cast<unsigned int>(__maxUsedHeap);
+    return getHeapSize()-__maxHeapUsage;
 }
 
 unsigned int MemoryProfiling::getCurrentFreeHeap()
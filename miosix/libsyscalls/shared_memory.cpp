@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "shared_memory.h"
+#include <errno.h>
+
+// implemented in crt0.s
+extern "C" int __shmattach(const char *name, unsigned int size, int flags,
+                           void **addr);
+extern "C" int __shmdetach();
+extern "C" int __shmunlink(const char *name);
+
+namespace miosix {
+
+void *shmAttach(const char *name, unsigned int size, int flags,
+                unsigned int *actualSize)
+{
+    void *addr;
+    int result=__shmattach(name,size,flags,&addr);
+    if(result<0)
+    {
+        errno=-result;
+        return nullptr;
+    }
+    if(actualSize) *actualSize=result;
+    return addr;
+}
+
+int shmDetach()
+{
+    int result=__shmdetach();
+    if(result<0)
+    {
+        errno=-result;
+        return -1;
+    }
+    return 0;
+}
+
+int shmUnlink(const char *name)
+{
+    int result=__shmunlink(name);
+    if(result<0)
+    {
+        errno=-result;
+        return -1;
+    }
+    return 0;
+}
+
+} //namespace miosix
@@ -0,0 +1,67 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <fcntl.h>
+
+namespace miosix {
+
+/**
+ * Map a shared memory segment in the process, optionally creating it.
+ * Shared segments allow processes to exchange data without copying it through
+ * the kernel. A process can have only one segment attached at a time, and
+ * segments are detached on exit and execve.
+ * \param name segment name
+ * \param size size of the segment to create, rounded up to a power of two.
+ * When attaching to an existing segment it can be zero
+ * \param flags O_CREAT to create the segment if it does not exist, and
+ * O_CREAT|O_EXCL to fail if it already exists
+ * \param actualSize if not null, the segment size is stored here
+ * \return a pointer to the segment, whose content is zero when it is
+ * created, or nullptr on failure, with errno set
+ */
+void *shmAttach(const char *name, unsigned int size, int flags=0,
+                unsigned int *actualSize=nullptr);
+
+/**
+ * Unmap the shared segment attached to the process. Syscalls that other
+ * threads of the process started before the segment was unmapped can still
+ * access it until they complete
+ * \return 0 on success, -1 on failure, with errno set
+ */
+int shmDetach();
+
+/**
+ * Remove a shared segment name. Processes already attached to the segment can
+ * keep using it, and its memory is deallocated when the last one detaches
+ * \param name segment name
+ * \return 0 on success, -1 on failure, with errno set
+ */
+int shmUnlink(const char *name);
+
+} //namespace miosix
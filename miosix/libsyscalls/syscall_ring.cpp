@@ -0,0 +1,118 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "syscall_ring.h"
+#include <errno.h>
+#include <new>
+
+// implemented in crt0.s
+extern "C" int __ringsubmit(void *ring);
+
+namespace miosix {
+
+// Must match the Syscall enum in kernel/process.h
+static const unsigned int opRead=4;
+static const unsigned int opWrite=5;
+static const unsigned int opLseek=6;
+static const unsigned int opFstat=9;
+
+SyscallRing::SyscallRing(unsigned int size) : consumed(0)
+{
+    unsigned int entryCount=1;
+    while(entryCount<size) entryCount<<=1;
+    void *mem=::operator new(sizeof(Header)+entryCount*sizeof(Entry));
+    ring=reinterpret_cast<Header*>(mem);
+    entries=reinterpret_cast<Entry*>(ring+1);
+    ring->mask=entryCount-1;
+    ring->head=0;
+    ring->tail=0;
+    ring->reserved=0;
+}
+
+bool SyscallRing::read(int fd, void *buf, size_t size)
+{
+    return queue(opRead,fd,buf,size);
+}
+
+bool SyscallRing::write(int fd, const void *buf, size_t size)
+{
+    return queue(opWrite,fd,buf,size);
+}
+
+bool SyscallRing::lseek(int fd, off_t pos, int whence)
+{
+    return queue(opLseek,fd,nullptr,whence,pos);
+}
+
+bool SyscallRing::fstat(int fd, struct stat *pstat)
+{
+    return queue(opFstat,fd,pstat,0);
+}
+
+int SyscallRing::submit()
+{
+    if(pending()==0) return 0;
+    int result=__ringsubmit(ring);
+    if(result<0)
+    {
+        errno=-result;
+        return -1;
+    }
+    return result;
+}
+
+bool SyscallRing::getCompletion(long long& result)
+{
+    if(consumed==ring->head) return false;
+    result=entries[consumed & ring->mask].result;
+    consumed++;
+    return true;
+}
+
+SyscallRing::~SyscallRing()
+{
+    ::operator delete(ring);
+}
+
+bool SyscallRing::queue(unsigned int op, int fd, const void *ptr,
+                        unsigned int arg, long long offset)
+{
+    //Slots are freed only when their completion is retrieved
+    unsigned int tail=ring->tail;
+    if(tail-consumed>ring->mask) return false;
+    Entry& e=entries[tail & ring->mask];
+    e.op=op;
+    e.fd=fd;
+    e.ptr=reinterpret_cast<unsigned int>(ptr);
+    e.arg=arg;
+    e.offset=offset;
+    e.result=0;
+    ring->tail=tail+1;
+    return true;
+}
+
+} //namespace miosix
@@ -0,0 +1,154 @@
+/***************************************************************************
+ *   Copyright (C) 2024 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <sys/types.h>
+
+struct stat;
+
+namespace miosix {
+
+/**
+ * A syscall ring allows a process to queue a batch of file operations and
+ * submit them to the kernel with a single syscall, paying the syscall overhead
+ * once per batch instead of once per operation. Operations are executed in
+ * the order they were queued, and their results are retrieved in the same
+ * order with getCompletion().
+ *
+ * Buffers passed to read(), write() and fstat() must remain valid until the
+ * corresponding completion has been retrieved.
+ * A SyscallRing can't be used concurrently by multiple threads.
+ */
+class SyscallRing
+{
+public:
+    /**
+     * Constructor
+     * \param size maximum number of queued operations, rounded up to a
+     * power of two
+     */
+    explicit SyscallRing(unsigned int size);
+
+    /**
+     * Queue a read operation
+     * \param fd file descriptor
+     * \param buf buffer where read data is stored
+     * \param size buffer size
+     * \return false if the ring is full
+     */
+    bool read(int fd, void *buf, size_t size);
+
+    /**
+     * Queue a write operation
+     * \param fd file descriptor
+     * \param buf data to write
+     * \param size buffer size
+     * \return false if the ring is full
+     */
+    bool write(int fd, const void *buf, size_t size);
+
+    /**
+     * Queue an lseek operation
+     * \param fd file descriptor
+     * \param pos offset
+     * \param whence SEEK_SET, SEEK_CUR or SEEK_END
+     * \return false if the ring is full
+     */
+    bool lseek(int fd, off_t pos, int whence);
+
+    /**
+     * Queue an fstat operation
+     * \param fd file descriptor
+     * \param pstat where the file information is stored
+     * \return false if the ring is full
+     */
+    bool fstat(int fd, struct stat *pstat);
+
+    /**
+     * Execute all queued operations
+     * \return the number of executed operations, or -1 on failure with errno
+     * set
+     */
+    int submit();
+
+    /**
+     * Retrieve the result of the oldest executed operation whose result has
+     * not yet been retrieved, freeing its slot in the ring
+     * \param result the operation result, as returned by the corresponding
+     * syscall, or a negative error code
+     * \return false if there are no executed operations to retrieve
+     */
+    bool getCompletion(long long& result);
+
+    /**
+     * \return the number of queued operations not yet executed
+     */
+    unsigned int pending() const { return ring->tail-ring->head; }
+
+    /**
+     * Destructor
+     */
+    ~SyscallRing();
+
+    SyscallRing(const SyscallRing&)=delete;
+    SyscallRing& operator=(const SyscallRing&)=delete;
+
+private:
+    /**
+     * Queue an operation
+     * \return false if the ring is full
+     */
+    bool queue(unsigned int op, int fd, const void *ptr, unsigned int arg,
+               long long offset=0);
+
+    /// Layout shared with the kernel, see kernel/process.h
+    struct Header
+    {
+        unsigned int mask;
+        volatile unsigned int head;
+        volatile unsigned int tail;
+        unsigned int reserved;
+    };
+
+    /// Layout shared with the kernel, see kernel/process.h
+    struct Entry
+    {
+        unsigned int op;
+        int fd;
+        unsigned int ptr;
+        unsigned int arg;
+        long long offset;
+        long long result;
+    };
+
+    Header *ring;         ///< Ring header, followed by the entries
+    Entry *entries;       ///< Ring entries
+    unsigned int consumed; ///< Index of the next completion to retrieve
+};
+
+} //namespace miosix
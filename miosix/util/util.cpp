@@ -33,6 +33,9 @@
 #include <malloc.h>
 #include "util.h"
 #include "kernel/kernel.h"
+#include "kernel/tlsf_heap.h"
+#include "kernel/process_pool.h"
+#include "kernel/elf_program.h"
 #include "stdlib_integration/libc_integration.h"
 #include "config/miosix_settings.h" //For WATERMARK_FILL and STACK_FILL
 
@@ -65,6 +68,35 @@ void MemoryProfiling::print()
             curFreeStack,absFreeStack,
             heapSize,heapSize-curFreeHeap,heapSize-absFreeHeap,
             curFreeHeap,absFreeHeap);
+    #ifdef WITH_TLSF_HEAP
+    iprintf("Fragmentation: %u%%\n",getHeapFragmentation());
+    #endif //WITH_TLSF_HEAP
+    #ifdef WITH_THREAD_POOL
+    ThreadPool::Stats pool=getThreadPoolStats();
+    iprintf("Thread pool statistics.\n"
+            "Allocations (pooled/malloc): %u/%u\n"
+            "Free (blocks/bytes): %u/%u\n",
+            pool.hits,pool.misses,pool.freeBlocks,pool.freeBytes);
+    #endif //WITH_THREAD_POOL
+    #ifdef WITH_PROCESSES
+    ProcessPool::Stats processPool=ProcessPool::instance().getStats();
+    unsigned int fragmentation=0;
+    if(processPool.freeBytes)
+        fragmentation=100-static_cast<unsigned long long>(
+            processPool.largestFreeBlock)*100/processPool.freeBytes;
+    iprintf("Process pool statistics.\n"
+            "Size: %u\n"
+            "Free (total/largest block): %u/%u\n"
+            "Fragmentation: %u%%\n",
+            processPool.size,processPool.freeBytes,
+            processPool.largestFreeBlock,fragmentation);
+    ProgramCache::Stats cache=ProgramCache::getStats();
+    iprintf("Program cache statistics.\n"
+            "Loads (hits/misses): %u/%u\n"
+            "Retained bytes: %u\n"
+            "Evictions: %u\n",
+            cache.hits,cache.misses,cache.retainedBytes,cache.evictions);
+    #endif //WITH_PROCESSES
 }
 
 unsigned int MemoryProfiling::getStackSize()
@@ -116,6 +148,12 @@ unsigned int MemoryProfiling::getHeapSize()
 
 unsigned int MemoryProfiling::getAbsoluteFreeHeap()
 {
+    #ifdef WITH_TLSF_HEAP
+    //The TLSF heap claims all the memory at once, so the maximum heap end is
+    //meaningless, use the heap own statistics
+    TlsfHeap::Stats stats=getTlsfHeapStats();
+    return getHeapSize()-(stats.size-stats.minFreeBytes);
+    #else //WITH_TLSF_HEAP
     //This extern variable is defined in the linker script
     //Pointer to end of heap
     extern char _heap_end asm("_heap_end");
@@ -123,6 +161,7 @@ unsigned int MemoryProfiling::getAbsoluteFreeHeap()
     unsigned int maxHeap=getMaxHeap();
 
     return reinterpret_cast<unsigned int>(&_heap_end) - maxHeap;
+    #endif //WITH_TLSF_HEAP
 }
 
 unsigned int MemoryProfiling::getCurrentFreeHeap()
@@ -131,6 +170,23 @@ unsigned int MemoryProfiling::getCurrentFreeHeap()
     return getHeapSize()-mallocData.uordblks;
 }
 
+#ifdef WITH_TLSF_HEAP
+unsigned int MemoryProfiling::getHeapFragmentation()
+{
+    TlsfHeap::Stats stats=getTlsfHeapStats();
+    if(stats.freeBytes==0) return 0;
+    return 100-static_cast<unsigned long long>(stats.largestFreeBlock)*100/
+               stats.freeBytes;
+}
+#endif //WITH_TLSF_HEAP
+
+#ifdef WITH_THREAD_POOL
+ThreadPool::Stats MemoryProfiling::getThreadPoolStats()
+{
+    return ThreadPool::getStats();
+}
+#endif //WITH_THREAD_POOL
+
 /**
  * \internal
  * used by memDump
@@ -163,13 +219,17 @@ void memDump(const void *start, int len)
 
 #ifdef WITH_CPU_TIME_COUNTER
 
-static void printSingleThreadInfo(Thread *self, Thread *thread,
-    int approxDt, long long newTime, long long oldTime, bool isIdleThread,
-    bool isNewThread)
+static void printSingleThreadInfo(Thread *self,
+    const CPUTimeCounter::Data& data, int approxDt, long long oldTime,
+    bool isIdleThread, bool isNewThread)
 {
-    long long threadDt = newTime - oldTime;
+    Thread *thread = data.thread;
+    long long threadDt = data.usedCpuTime - oldTime;
     int perc = static_cast<int>(threadDt >> 16) * 100 / approxDt;
     iprintf("%p %10lld ns (%2d.%1d%%)", thread, threadDt, perc / 10, perc % 10);
+    #ifdef SCHED_TYPE_EDF
+    if(data.deadlineMisses) iprintf(" %u missed", data.deadlineMisses);
+    #endif // SCHED_TYPE_EDF
     if(isIdleThread)
     {
         iprintf(" (idle)");
@@ -218,8 +278,8 @@ void CPUProfiler::print()
             oldIt++;
         }
         // Found a thread that exists in both lists
-        printSingleThreadInfo(self, newIt->thread, approxDt, newIt->usedCpuTime,
-            oldIt->usedCpuTime, isIdleThread, false);
+        printSingleThreadInfo(self, *newIt, approxDt, oldIt->usedCpuTime,
+            isIdleThread, false);
         isIdleThread = false;
         newIt++;
         oldIt++;
@@ -234,8 +294,7 @@ void CPUProfiler::print()
     // Print info about newly created threads
     while(newIt != newInfo.end())
     {
-        printSingleThreadInfo(self, newIt->thread, approxDt, newIt->usedCpuTime,
-            0, isIdleThread, true);
+        printSingleThreadInfo(self, *newIt, approxDt, 0, isIdleThread, true);
         isIdleThread = false;
         newIt++;
     }
@@ -34,6 +34,7 @@
 #define UTIL_H
 
 #include "kernel/cpu_time_counter.h"
+#include "kernel/thread_pool.h"
 #include <vector>
 
 namespace miosix {
@@ -99,6 +100,24 @@ public:
      */
     static unsigned int getCurrentFreeHeap();
 
+    #ifdef WITH_TLSF_HEAP
+    /**
+     * \return heap fragmentation, as a percentage.<br>
+     * It is zero if all the free heap can be allocated with a single malloc,
+     * and approaches 100 as the free heap is split in many small blocks.
+     */
+    static unsigned int getHeapFragmentation();
+    #endif //WITH_TLSF_HEAP
+
+    #ifdef WITH_THREAD_POOL
+    /**
+     * \return statistics about the pool used to recycle the memory of
+     * terminated threads.<br>
+     * Memory kept in the pool is not part of the free heap.
+     */
+    static ThreadPool::Stats getThreadPoolStats();
+    #endif //WITH_THREAD_POOL
+
 private:
     //All member functions static, disallow creating instances
     MemoryProfiling();